@@ -105,6 +105,9 @@ setInputValue(current_modem_sniffer_enabled == 1, "modem-sniffer-yes", "modem-sn
 
 {% if components.hsio_settings %}
 selectListValue("select_hsioindex", current_hsioindex);
+{% if tweaks.fujinet_pc %}
+setInputValue(current_hsio_auto == 1, "hsio-auto-yes", "hsio-auto-no");
+{% endif %}
 {% endif %}
 
 {% if components.program_recorder %}
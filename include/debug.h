@@ -16,13 +16,15 @@
 
 #if defined(DEBUG) || !defined(NO_DEBUG_PRINT)
 #include <utils.h>
+#include <fnLog.h>
 /*
   Debugging Macros
+  Messages are queued and printed by the log writer thread, see fnLog.h
 */
-    #define Debug_print(...) util_debug_printf(nullptr, __VA_ARGS__)
-    #define Debug_printf(...) util_debug_printf(__VA_ARGS__)
-    #define Debug_println(...) util_debug_printf("%s\n", __VA_ARGS__)
-    #define Debug_printv(format, ...) {util_debug_printf( ANSI_YELLOW "[%s:%u] %s(): " ANSI_GREEN_BOLD format ANSI_RESET "\r\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);}
+    #define Debug_print(...) util_debug_printf(LOG_LEVEL_DEBUG, __FILE__, nullptr, __VA_ARGS__)
+    #define Debug_printf(...) util_debug_printf(LOG_LEVEL_DEBUG, __FILE__, __VA_ARGS__)
+    #define Debug_println(...) util_debug_printf(LOG_LEVEL_DEBUG, __FILE__, "%s\n", __VA_ARGS__)
+    #define Debug_printv(format, ...) {util_debug_printf(LOG_LEVEL_VERBOSE, __FILE__, ANSI_YELLOW "[%s:%u] %s(): " ANSI_GREEN_BOLD format ANSI_RESET "\r\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);}
 
     #define HEAP_CHECK(x) Debug_printf("HEAP CHECK %s " x "\r\n", heap_caps_check_integrity_all(true) ? "PASSED":"FAILED")
 #else
@@ -0,0 +1,301 @@
+#include "fnBlockCache.h"
+
+#include <string.h>
+
+#include "../../include/debug.h"
+
+#include "fnConfig.h"
+#include "fnFileCache.h"
+#include "fujiHost.h"
+
+fnBlockCache blockCache;
+
+FileHandler *fnBlockCache::wrap(FileHandler *f, fujiHost *host, const char *filename, uint32_t prefetch_size)
+{
+    // budget follows config, excess is evicted by next put()
+    uint64_t budget = (uint64_t)Config.get_diskcache_block_cache() * 1024;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _budget = budget;
+    }
+    bool prefetch = prefetch_size > 0 && prefetch_size <= (uint64_t)Config.get_diskcache_prefetch() * 1024;
+
+    // local files are served from OS page cache
+    if (f == nullptr || host == nullptr || filename == nullptr || host->get_type() == HOSTTYPE_LOCAL ||
+        (budget < BLOCKCACHE_BLOCK_SIZE && !prefetch))
+        return f;
+
+    std::string identity = std::string(host->get_hostname()) + ":" + filename;
+    FileHandlerCache *handler = new FileHandlerCache(f, acquire(identity));
+    if (prefetch)
+        handler->prefetch(prefetch_size);
+    return handler;
+}
+
+uint32_t fnBlockCache::acquire(const std::string &identity)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (auto &i : _images)
+    {
+        if (i.second.identity == identity)
+        {
+            i.second.refs++;
+            return i.first;
+        }
+    }
+
+    uint32_t image = _next_image++;
+    if (_next_image == 0)
+        _next_image = 1;
+    image_info &info = _images[image];
+    info.identity = identity;
+    info.refs = 1;
+    Debug_printf("Block cache: image #%u \"%s\"\r\n", image, identity.c_str());
+    return image;
+}
+
+void fnBlockCache::release(uint32_t image)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto i = _images.find(image);
+    if (i == _images.end() || --i->second.refs > 0)
+        return;
+    // image may be changed by others while it's not mounted
+    if (!i->second.local.empty())
+        Debug_printf("Block cache: image #%u local copy dropped\r\n", image);
+    _images.erase(i);
+    _erase_image_blocks(image);
+}
+
+void fnBlockCache::_erase_image_blocks(uint32_t image)
+{
+    for (auto it = _lru.begin(); it != _lru.end();)
+    {
+        auto next = std::next(it);
+        if ((uint32_t)(it->key >> 32) == image)
+            _erase(it);
+        it = next;
+    }
+}
+
+void fnBlockCache::_erase(std::list<cached_block>::iterator it)
+{
+    _used -= it->data.size();
+    _index.erase(it->key);
+    _lru.erase(it);
+}
+
+// Store block into local copy of the image, block must be within the copy
+void fnBlockCache::_local_store(uint32_t image, image_info &info, uint32_t block, const uint8_t *data, uint32_t len)
+{
+    uint64_t offset = (uint64_t)block * BLOCKCACHE_BLOCK_SIZE;
+    uint64_t expected = info.local.size() - offset;
+    if (expected > BLOCKCACHE_BLOCK_SIZE)
+        expected = BLOCKCACHE_BLOCK_SIZE;
+    // short read, image is not what prefetch was started for
+    if (len != expected)
+        return;
+
+    memcpy(info.local.data() + offset, data, len);
+    if (!info.local_have[block])
+    {
+        info.local_have[block] = true;
+        if (--info.local_missing == 0)
+            Debug_printf("Block cache: image #%u is local now\r\n", image);
+    }
+}
+
+bool fnBlockCache::prefetch_begin(uint32_t image, uint32_t size)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto i = _images.find(image);
+    if (i == _images.end() || size == 0 || !i->second.local.empty())
+        return false;
+
+    image_info &info = i->second;
+    uint32_t nblocks = (size + BLOCKCACHE_BLOCK_SIZE - 1) / BLOCKCACHE_BLOCK_SIZE;
+    info.local.resize(size);
+    info.local_have.assign(nblocks, false);
+    info.local_missing = nblocks;
+
+    // move blocks read so far into the copy
+    for (auto it = _lru.begin(); it != _lru.end();)
+    {
+        auto next = std::next(it);
+        uint32_t block = (uint32_t)it->key;
+        if ((uint32_t)(it->key >> 32) == image)
+        {
+            if (block < nblocks)
+                _local_store(image, info, block, it->data.data(), it->data.size());
+            _erase(it);
+        }
+        it = next;
+    }
+
+    Debug_printf("Block cache: prefetch of image #%u, %u bytes\r\n", image, size);
+    return true;
+}
+
+int fnBlockCache::get(uint32_t image, uint32_t block, uint32_t offset, uint8_t *buf, uint32_t len)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto im = _images.find(image);
+    if (im != _images.end() && !im->second.local.empty())
+    {
+        image_info &info = im->second;
+        if (block < info.local_have.size() ? info.local_have[block] : info.local_missing == 0)
+        {
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            uint64_t start = (uint64_t)block * BLOCKCACHE_BLOCK_SIZE + offset;
+            // complete copy is the whole image, nothing past its end
+            if (start >= info.local.size())
+                return 0;
+            if (len > info.local.size() - start)
+                len = info.local.size() - start;
+            if (len > BLOCKCACHE_BLOCK_SIZE - offset)
+                len = BLOCKCACHE_BLOCK_SIZE - offset;
+            memcpy(buf, info.local.data() + start, len);
+            return len;
+        }
+    }
+
+    auto i = _index.find(_key(image, block));
+    if (i == _index.end())
+        return -1;
+
+    _lru.splice(_lru.begin(), _lru, i->second);
+    _hits.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<uint8_t> &data = i->second->data;
+    if (offset >= data.size())
+        return 0;
+    if (len > data.size() - offset)
+        len = data.size() - offset;
+    memcpy(buf, data.data() + offset, len);
+    return len;
+}
+
+bool fnBlockCache::contains(uint32_t image, uint32_t block)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto im = _images.find(image);
+    if (im != _images.end() && block < im->second.local_have.size() && im->second.local_have[block])
+        return true;
+    return _index.count(_key(image, block)) != 0;
+}
+
+uint64_t fnBlockCache::generation(uint32_t image)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto i = _images.find(image);
+    return i == _images.end() ? 0 : i->second.generation;
+}
+
+void fnBlockCache::put(uint32_t image, uint32_t block, const uint8_t *data, uint32_t len, uint64_t generation)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _misses.fetch_add(1, std::memory_order_relaxed);
+
+    auto i = _images.find(image);
+    if (i == _images.end() || i->second.generation != generation)
+        return;
+    // prefetched image, outside of budget
+    if (block < i->second.local_have.size())
+    {
+        _local_store(image, i->second, block, data, len);
+        return;
+    }
+    if (len > _budget)
+        return;
+
+    uint64_t key = _key(image, block);
+    auto b = _index.find(key);
+    if (b != _index.end())
+        _erase(b->second);
+
+    while (!_lru.empty() && _used + len > _budget)
+    {
+        _erase(std::prev(_lru.end()));
+        _evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    _lru.push_front(cached_block{key, std::vector<uint8_t>(data, data + len)});
+    _index[key] = _lru.begin();
+    _used += len;
+}
+
+void fnBlockCache::update(uint32_t image, uint64_t offset, const uint8_t *data, size_t len)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto i = _images.find(image);
+    if (i == _images.end())
+        return;
+    i->second.generation++;
+
+    image_info &info = i->second;
+    if (!info.local.empty())
+    {
+        if (offset + len <= info.local.size())
+            memcpy(info.local.data() + offset, data, len);
+        else
+        {
+            // image grows, it's no longer what was prefetched
+            Debug_printf("Block cache: image #%u grows, local copy dropped\r\n", image);
+            info.local.clear();
+            info.local.shrink_to_fit();
+            info.local_have.clear();
+            info.local_missing = 0;
+        }
+    }
+
+    while (len > 0)
+    {
+        uint32_t block = offset / BLOCKCACHE_BLOCK_SIZE;
+        uint32_t boff = offset % BLOCKCACHE_BLOCK_SIZE;
+        size_t n = BLOCKCACHE_BLOCK_SIZE - boff;
+        if (n > len)
+            n = len;
+
+        auto b = _index.find(_key(image, block));
+        if (b != _index.end())
+        {
+            std::vector<uint8_t> &bd = b->second->data;
+            // write past end of short block grows the file, read it again
+            if (boff + n <= bd.size())
+                memcpy(bd.data() + boff, data, n);
+            else
+                _erase(b->second);
+        }
+        offset += n;
+        data += n;
+        len -= n;
+    }
+}
+
+blockcache_stats fnBlockCache::get_stats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    blockcache_stats s;
+    s.hits = _hits.load(std::memory_order_relaxed);
+    s.misses = _misses.load(std::memory_order_relaxed);
+    s.evictions = _evictions.load(std::memory_order_relaxed);
+    s.used = _used;
+    s.budget = _budget;
+    s.images = _images.size();
+    s.local = 0;
+    s.local_images = 0;
+    for (auto &i : _images)
+    {
+        s.local += i.second.local.size();
+        if (!i.second.local.empty() && i.second.local_missing == 0)
+            s.local_images++;
+    }
+    return s;
+}
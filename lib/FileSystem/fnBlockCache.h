@@ -0,0 +1,114 @@
+#ifndef _FN_BLOCKCACHE_H
+#define _FN_BLOCKCACHE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "fnFile.h"
+
+#define BLOCKCACHE_BLOCK_SIZE 4096
+
+class fujiHost;
+
+/*
+ * Block cache shared by all mounted disk images
+ *
+ * Image files on network hosts are wrapped by FileHandlerCache, which reads
+ * them in blocks of BLOCKCACHE_BLOCK_SIZE bytes through this cache. Blocks
+ * are keyed by image (host name and path) and block number, so the same
+ * image mounted in several slots shares them. Least recently used blocks
+ * are dropped when the memory budget from config is exceeded, blocks of an
+ * image are dropped when its last handle is closed.
+ *
+ * Writes go to the image immediately and update cached blocks, there is
+ * one cache per image, so all handles see the same data.
+ * Thread safe, media may be read by worker pool jobs.
+ *
+ * Small images can be prefetched whole (see FileHandlerCache::prefetch()),
+ * their blocks are then held in a local copy of the image outside of the
+ * budget and never evicted. Once the copy is complete the image is read
+ * from memory only.
+ */
+
+struct blockcache_stats
+{
+    uint64_t hits;          // block reads served from memory
+    uint64_t misses;        // blocks read from backend
+    uint64_t evictions;
+    uint64_t used;          // bytes held
+    uint64_t budget;
+    unsigned int images;    // images with open handles
+    uint64_t local;         // bytes held in local copies of prefetched images
+    unsigned int local_images; // prefetched images with complete local copy
+};
+
+class fnBlockCache
+{
+private:
+    struct cached_block
+    {
+        uint64_t key;
+        std::vector<uint8_t> data;  // shorter than block size at end of file
+    };
+    struct image_info
+    {
+        std::string identity;
+        int refs = 0;
+        uint64_t generation = 0;    // bumped by every write
+        std::vector<uint8_t> local;     // whole image, empty if not prefetched
+        std::vector<bool> local_have;   // blocks present in local copy
+        uint32_t local_missing = 0;
+    };
+
+    std::mutex _mutex;
+    std::list<cached_block> _lru;   // most recently used first
+    std::unordered_map<uint64_t, std::list<cached_block>::iterator> _index;
+    std::map<uint32_t, image_info> _images;
+    uint32_t _next_image = 1;
+    uint64_t _used = 0;
+    uint64_t _budget = 0;
+
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _evictions{0};
+
+    static uint64_t _key(uint32_t image, uint32_t block) { return ((uint64_t)image << 32) | block; }
+    void _erase(std::list<cached_block>::iterator it);
+    void _erase_image_blocks(uint32_t image);
+    void _local_store(uint32_t image, image_info &info, uint32_t block, const uint8_t *data, uint32_t len);
+
+public:
+    // Wrap file handler of image from given host, returns f itself if the image is not cached
+    // Image of prefetch_size bytes is prefetched whole if it's not over the limit from config
+    FileHandler *wrap(FileHandler *f, fujiHost *host, const char *filename, uint32_t prefetch_size = 0);
+
+    // Register handle of the image, returns image id
+    uint32_t acquire(const std::string &identity);
+    // Handle closed, cached blocks are dropped with the last one
+    void release(uint32_t image);
+
+    // Copy up to len bytes from offset within cached block,
+    // returns bytes copied (0 at end of file) or -1 if the block is not cached
+    int get(uint32_t image, uint32_t block, uint32_t offset, uint8_t *buf, uint32_t len);
+    bool contains(uint32_t image, uint32_t block);
+    // Current write generation of the image, blocks read before a write must not be stored
+    uint64_t generation(uint32_t image);
+    // Store block read from backend, ignored if the image was written since generation
+    void put(uint32_t image, uint32_t block, const uint8_t *data, uint32_t len, uint64_t generation);
+    // Bytes were written to the image at offset
+    void update(uint32_t image, uint64_t offset, const uint8_t *data, size_t len);
+    // Start local copy of the image, false if it has one already
+    bool prefetch_begin(uint32_t image, uint32_t size);
+
+    blockcache_stats get_stats();
+};
+
+extern fnBlockCache blockCache;
+
+#endif // _FN_BLOCKCACHE_H
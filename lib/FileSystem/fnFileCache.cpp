@@ -0,0 +1,324 @@
+#include <errno.h>
+#include <string.h>
+
+#include "fnFileCache.h"
+#include "fnBlockCache.h"
+#include "fnTaskManager.h"
+#include "../../include/debug.h"
+
+
+FileHandlerCache::FileHandlerCache(FileHandler *fh, uint32_t image) : _fh(fh), _image(image)
+{
+}
+
+
+FileHandlerCache::~FileHandlerCache()
+{
+    close(false);
+}
+
+
+int FileHandlerCache::close(bool destroy)
+{
+    int result = 0;
+    // waits for prefetch job in progress
+    if (_prefetch_task != nullptr)
+        taskMgr.abort_task(_prefetch_tid);
+    if (_fh != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(_fh_mutex);
+        result = _fh->close();
+        _fh = nullptr;
+        blockCache.release(_image);
+    }
+    if (destroy) delete this;
+    return result;
+}
+
+
+// Seek of wrapped handler, skipped if it's already there
+int FileHandlerCache::_fh_seek(long int off)
+{
+    if (off == _fh_position)
+        return 0;
+    int result = _fh->seek(off, SEEK_SET);
+    _fh_position = result == 0 ? off : -1;
+    return result;
+}
+
+
+int FileHandlerCache::seek(long int off, int whence)
+{
+    if (_fh == nullptr)
+        return -1;
+
+    long int new_pos;
+    switch (whence)
+    {
+    case SEEK_SET:
+        new_pos = off;
+        break;
+    case SEEK_CUR:
+        new_pos = _position + off;
+        break;
+    case SEEK_END:
+    {
+        // size is known to wrapped handler only
+        std::lock_guard<std::mutex> lock(_fh_mutex);
+        _fh_position = -1;
+        if (_fh->seek(off, SEEK_END) != 0)
+            return -1;
+        new_pos = _fh->tell();
+        _fh_position = new_pos;
+        break;
+    }
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (new_pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    _position = new_pos;
+    return 0;
+}
+
+
+long int FileHandlerCache::tell()
+{
+    return _position;
+}
+
+
+size_t FileHandlerCache::read(void *ptr, size_t size, size_t count)
+{
+    if (_fh == nullptr || size == 0)
+        return 0;
+
+    uint8_t *out = (uint8_t *)ptr;
+    size_t requested = size * count;
+    size_t done = 0;
+
+    while (done < requested)
+    {
+        uint32_t block = _position / BLOCKCACHE_BLOCK_SIZE;
+        uint32_t boff = _position % BLOCKCACHE_BLOCK_SIZE;
+        size_t want = requested - done;
+
+        int n = blockCache.get(_image, block, boff, out + done, want < BLOCKCACHE_BLOCK_SIZE ? want : BLOCKCACHE_BLOCK_SIZE);
+        if (n < 0)
+        {
+            // fetch this and following missing blocks of the request at once
+            uint32_t last = (_position + want - 1) / BLOCKCACHE_BLOCK_SIZE;
+            uint32_t nblocks = 1;
+            while (block + nblocks <= last && !blockCache.contains(_image, block + nblocks))
+                nblocks++;
+
+            _fetch_buf.resize(nblocks * BLOCKCACHE_BLOCK_SIZE);
+            uint64_t generation;
+            size_t got;
+            {
+                std::lock_guard<std::mutex> lock(_fh_mutex);
+                generation = blockCache.generation(_image);
+                if (_fh_seek((long int)block * BLOCKCACHE_BLOCK_SIZE) != 0)
+                    break;
+                got = _fh->read(_fetch_buf.data(), 1, _fetch_buf.size());
+                _fh_position = got == _fetch_buf.size() ? _fh_position + got : -1;
+            }
+
+            for (uint32_t i = 0; i < nblocks && got > i * BLOCKCACHE_BLOCK_SIZE; i++)
+            {
+                size_t len = got - i * BLOCKCACHE_BLOCK_SIZE;
+                if (len > BLOCKCACHE_BLOCK_SIZE)
+                    len = BLOCKCACHE_BLOCK_SIZE;
+                blockCache.put(_image, block + i, _fetch_buf.data() + i * BLOCKCACHE_BLOCK_SIZE, len, generation);
+            }
+
+            // copy from what was fetched, cache may have refused it
+            n = got > boff ? got - boff : 0;
+            if ((size_t)n > want)
+                n = want;
+            memcpy(out + done, _fetch_buf.data() + boff, n);
+        }
+        if (n == 0)
+            break; // end of file
+
+        done += n;
+        _position += n;
+    }
+
+    return done / size;
+}
+
+
+size_t FileHandlerCache::write(const void *ptr, size_t size, size_t count)
+{
+    if (_fh == nullptr)
+        return 0;
+
+    // prefetch must not read between write and cache update
+    std::lock_guard<std::mutex> lock(_fh_mutex);
+    if (_fh_seek(_position) != 0)
+        return 0;
+
+    size_t written = _fh->write(ptr, size, count);
+    if (written != count)
+        _fh_position = -1;
+    else
+        _fh_position += written * size;
+
+    blockCache.update(_image, _position, (const uint8_t *)ptr, written * size);
+    _position += written * size;
+    return written;
+}
+
+
+int FileHandlerCache::flush()
+{
+    if (_fh == nullptr)
+        return -1;
+    std::lock_guard<std::mutex> lock(_fh_mutex);
+    return _fh->flush();
+}
+
+
+void FileHandlerCache::prefetch(uint32_t size)
+{
+    if (_fh == nullptr || _prefetch_task != nullptr || !blockCache.prefetch_begin(_image, size))
+        return;
+
+    fnPrefetchTask *task = new fnPrefetchTask(this, size);
+    _prefetch_tid = taskMgr.submit_task(task);
+    if (_prefetch_tid == 0)
+    {
+        // blocks are copied as they are read
+        delete task;
+        return;
+    }
+    _prefetch_task = task;
+}
+
+
+// Read blocks into cache, runs in worker pool thread
+// returns 1 on success, 0 at end of file, -1 on error
+int FileHandlerCache::_prefetch_chunk(uint32_t block, uint32_t count)
+{
+    // skip blocks read by disk meanwhile
+    while (count > 0 && blockCache.contains(_image, block))
+    {
+        block++;
+        count--;
+    }
+    if (count == 0)
+        return 1;
+
+    std::vector<uint8_t> buf(count * BLOCKCACHE_BLOCK_SIZE);
+    uint64_t generation;
+    size_t got;
+    {
+        std::lock_guard<std::mutex> lock(_fh_mutex);
+        if (_fh == nullptr)
+            return -1;
+        generation = blockCache.generation(_image);
+        if (_fh_seek((long int)block * BLOCKCACHE_BLOCK_SIZE) != 0)
+            return -1;
+        got = _fh->read(buf.data(), 1, buf.size());
+        _fh_position = got == buf.size() ? _fh_position + got : -1;
+    }
+
+    for (uint32_t i = 0; i < count && got > i * BLOCKCACHE_BLOCK_SIZE; i++)
+    {
+        size_t len = got - i * BLOCKCACHE_BLOCK_SIZE;
+        if (len > BLOCKCACHE_BLOCK_SIZE)
+            len = BLOCKCACHE_BLOCK_SIZE;
+        blockCache.put(_image, block + i, buf.data() + i * BLOCKCACHE_BLOCK_SIZE, len, generation);
+    }
+    return got == buf.size() ? 1 : 0;
+}
+
+
+fnPrefetchTask::fnPrefetchTask(FileHandlerCache *handler, uint32_t size) : _handler(handler)
+{
+    _blocks = (size + BLOCKCACHE_BLOCK_SIZE - 1) / BLOCKCACHE_BLOCK_SIZE;
+}
+
+
+fnPrefetchTask::~fnPrefetchTask()
+{
+    if (_job)
+        _job->wait();
+    _handler->_prefetch_task = nullptr;
+}
+
+
+int fnPrefetchTask::get_progress()
+{
+    return _blocks == 0 ? 100 : _next * 100 / _blocks;
+}
+
+
+bool fnPrefetchTask::waiting()
+{
+    return _job && !_job->done();
+}
+
+
+void fnPrefetchTask::_submit()
+{
+    uint32_t block = _next;
+    uint32_t count = _blocks - _next;
+    if (count > BLOCKCACHE_PREFETCH_BLOCKS)
+        count = BLOCKCACHE_PREFETCH_BLOCKS;
+    _next += count;
+
+    FileHandlerCache *handler = _handler;
+    _job = workerPool.submit([handler, block, count]() { return handler->_prefetch_chunk(block, count); });
+}
+
+
+int fnPrefetchTask::start()
+{
+    Debug_printf("Prefetch #%d: %u blocks of image #%u\r\n", _id, _blocks, _handler->_image);
+    if (_blocks > 0)
+        _submit();
+    return 0;
+}
+
+
+int fnPrefetchTask::abort()
+{
+    Debug_printf("Prefetch #%d: aborted at %d%%\r\n", _id, get_progress());
+    if (_job)
+        _job->wait();
+    return 0;
+}
+
+
+int fnPrefetchTask::step()
+{
+    if (_job)
+    {
+        if (!_job->done())
+            return 0;
+        int result = _job->result();
+        _job.reset();
+        if (result < 0)
+        {
+            Debug_printf("Prefetch #%d: read failed\r\n", _id);
+            return -1;
+        }
+        if (result == 0)
+            _next = _blocks; // image is shorter than expected
+    }
+
+    if (_next >= _blocks)
+    {
+        Debug_printf("Prefetch #%d: done\r\n", _id);
+        return 1;
+    }
+    _submit();
+    return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef _FN_FILECACHE_
+#define _FN_FILECACHE_
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "fnFile.h"
+#include "fnTask.h"
+#include "fnWorkerPool.h"
+
+#define BLOCKCACHE_PREFETCH_BLOCKS 1    // blocks per prefetch read, foreground read waits for one at most
+
+class fnPrefetchTask;
+
+/*
+ * File handler reading the wrapped one through fnBlockCache
+ * Owns the wrapped handler, closes it on close(). Misses of consecutive
+ * blocks are fetched with single backend read.
+ *
+ * prefetch() starts background task copying the whole image into the
+ * block cache, reads of blocks not copied yet still go to the wrapped
+ * handler. Wrapped handler is used by the task from worker pool thread,
+ * every access to it is serialized by _fh_mutex.
+ */
+
+class FileHandlerCache : public FileHandler
+{
+    friend class fnPrefetchTask;
+
+protected:
+    FileHandler *_fh;
+    uint32_t _image;
+    long int _position = 0;
+    long int _fh_position = -1;     // position of wrapped handler, -1 = unknown
+    std::vector<uint8_t> _fetch_buf;
+    std::mutex _fh_mutex;
+    fnPrefetchTask *_prefetch_task = nullptr;
+    uint8_t _prefetch_tid = 0;
+
+    int _fh_seek(long int off);
+    int _prefetch_chunk(uint32_t block, uint32_t count);
+
+public:
+    FileHandlerCache(FileHandler *fh, uint32_t image);
+    virtual ~FileHandlerCache() override;
+
+    virtual int close(bool destroy=true) override;
+    virtual int seek(long int off, int whence) override;
+    virtual long int tell() override;
+    virtual size_t read(void *ptr, size_t size, size_t count) override;
+    virtual size_t write(const void *ptr, size_t size, size_t count) override;
+    virtual int flush() override;
+
+    // Copy whole image of size bytes into block cache in background
+    void prefetch(uint32_t size);
+};
+
+/*
+ * Task copying image into block cache, one job of BLOCKCACHE_PREFETCH_BLOCKS
+ * at a time is run by worker pool, so the backend is never busy for long
+ * with prefetch when disk read comes.
+ */
+
+class fnPrefetchTask : public fnTask
+{
+public:
+    fnPrefetchTask(FileHandlerCache *handler, uint32_t size);
+    virtual ~fnPrefetchTask() override;
+    virtual int get_progress() override;
+    virtual bool waiting() override;
+
+protected:
+    virtual int start() override;
+    virtual int abort() override;
+    virtual int step() override;
+
+private:
+    void _submit();
+
+    FileHandlerCache *_handler;
+    uint32_t _blocks;
+    uint32_t _next = 0;
+    std::shared_ptr<fnJob> _job;
+};
+
+#endif //_FN_FILECACHE_
@@ -0,0 +1,418 @@
+#include <errno.h>
+#include <string.h>
+#include <vector>
+
+#include "fnFileOverlay.h"
+#include "../../include/debug.h"
+
+#include "fnConfig.h"
+#include "fnFsSD.h"
+#include "fujiHost.h"
+#include "utils.h"
+
+#define OVERLAY_HEADER_LEN (OVERLAY_MAGIC_LEN + 14)
+#define OVERLAY_RECORD_LEN (4 + OVERLAY_BLOCK_SIZE)
+
+
+FileHandlerOverlay *FileHandlerOverlay::open(FileHandler *f, fujiHost *host, const char *filename)
+{
+    // local files are as fast as the delta and writes to them are expected
+    if (f == nullptr || host == nullptr || filename == nullptr || !Config.get_diskcache_overlay() ||
+        host->get_type() == HOSTTYPE_LOCAL || !fnSDFAT.running())
+        return nullptr;
+
+    std::string identity = std::string(host->get_hostname()) + ":" + filename;
+    char path[32];
+    snprintf(path, sizeof(path), OVERLAY_DIR "/%08x.ovl", (unsigned)util_fnv1a(identity));
+
+    FileHandlerOverlay *overlay = new FileHandlerOverlay(f, identity, path);
+    if (f->seek(0, SEEK_END) == 0)
+    {
+        long int end = f->tell();
+        overlay->_base_size = end > 0 ? end : 0;
+    }
+    overlay->_size = overlay->_base_size;
+    overlay->_base_hash = overlay->_hash_base();
+
+    if (!overlay->_load())
+    {
+        // wrapped handler goes back to the caller
+        overlay->_fh = nullptr;
+        delete overlay;
+        return nullptr;
+    }
+    Debug_printf("Overlay for \"%s\" in \"%s\", %u changed blocks\r\n",
+                 identity.c_str(), path, (unsigned)overlay->_blocks.size());
+    return overlay;
+}
+
+
+FileHandlerOverlay::FileHandlerOverlay(FileHandler *fh, const std::string &identity, const std::string &path) :
+    _fh(fh), _identity(identity), _path(path)
+{
+}
+
+
+FileHandlerOverlay::~FileHandlerOverlay()
+{
+    close(false);
+}
+
+
+int FileHandlerOverlay::close(bool destroy)
+{
+    int result = 0;
+    if (_delta != nullptr)
+    {
+        fclose(_delta);
+        _delta = nullptr;
+    }
+    if (_fh != nullptr)
+    {
+        result = _fh->close();
+        _fh = nullptr;
+    }
+    if (destroy) delete this;
+    return result;
+}
+
+
+// FNV-1a of first and last block of wrapped image, cheap check that the delta was made for it
+uint32_t FileHandlerOverlay::_hash_base()
+{
+    std::string ends;
+    uint8_t buf[OVERLAY_BLOCK_SIZE];
+    uint32_t len = _base_size < OVERLAY_BLOCK_SIZE ? _base_size : OVERLAY_BLOCK_SIZE;
+    if (_fh->seek(0, SEEK_SET) == 0 && _fh->read(buf, 1, len) == len)
+        ends.append((const char *)buf, len);
+    if (_base_size > OVERLAY_BLOCK_SIZE &&
+        _fh->seek(_base_size - len, SEEK_SET) == 0 && _fh->read(buf, 1, len) == len)
+        ends.append((const char *)buf, len);
+    return util_fnv1a(ends);
+}
+
+
+// Read delta file left by previous mount, returns false if it belongs to another image or is broken
+bool FileHandlerOverlay::_load()
+{
+    _delta = fnSDFAT.file_open(_path.c_str(), "rb+");
+    if (_delta == nullptr)
+        return true; // nothing changed yet
+
+    uint8_t hdr[OVERLAY_HEADER_LEN];
+    if (fread(hdr, 1, sizeof(hdr), _delta) != sizeof(hdr) || memcmp(hdr, OVERLAY_MAGIC, OVERLAY_MAGIC_LEN) != 0)
+    {
+        Debug_printf("Overlay \"%s\" is not valid, not used\r\n", _path.c_str());
+        return false;
+    }
+    uint32_t size = hdr[8] | (hdr[9] << 8) | (hdr[10] << 16) | ((uint32_t)hdr[11] << 24);
+    uint32_t base_size = hdr[12] | (hdr[13] << 8) | (hdr[14] << 16) | ((uint32_t)hdr[15] << 24);
+    uint32_t base_hash = hdr[16] | (hdr[17] << 8) | (hdr[18] << 16) | ((uint32_t)hdr[19] << 24);
+    uint16_t idlen = UINT16_FROM_HILOBYTES(hdr[21], hdr[20]);
+    std::string identity(idlen, '\0');
+    if (fread(&identity[0], 1, idlen, _delta) != idlen || identity != _identity)
+    {
+        Debug_printf("Overlay \"%s\" belongs to another image, not used\r\n", _path.c_str());
+        return false;
+    }
+    if (base_size != _base_size || base_hash != _base_hash)
+    {
+        // changes were made to other content, applying them would corrupt the image
+        Debug_printf("Image \"%s\" changed since overlay \"%s\" was made, overlay discarded\r\n",
+                     _identity.c_str(), _path.c_str());
+        _drop_delta();
+        return true;
+    }
+
+    // record cut by crash is dropped, next one overwrites it
+    long int start = OVERLAY_HEADER_LEN + idlen;
+    fseek(_delta, 0, SEEK_END);
+    long int end = ftell(_delta);
+    _append_at = start;
+    uint8_t rec[4];
+    while (_append_at + OVERLAY_RECORD_LEN <= end)
+    {
+        if (fseek(_delta, _append_at, SEEK_SET) != 0 || fread(rec, 1, sizeof(rec), _delta) != sizeof(rec))
+            return false;
+        uint32_t block = rec[0] | (rec[1] << 8) | (rec[2] << 16) | ((uint32_t)rec[3] << 24);
+        _blocks[block] = _append_at + sizeof(rec);
+        _append_at += OVERLAY_RECORD_LEN;
+    }
+    _size = size;
+    return true;
+}
+
+
+bool FileHandlerOverlay::_create()
+{
+    fnSDFAT.create_path(OVERLAY_DIR);
+    _delta = fnSDFAT.file_open(_path.c_str(), "wb+");
+    if (_delta == nullptr)
+    {
+        Debug_printf("Failed to create overlay \"%s\"\r\n", _path.c_str());
+        return false;
+    }
+
+    uint16_t idlen = _identity.size();
+    uint8_t hdr[OVERLAY_HEADER_LEN] = {};
+    memcpy(hdr, OVERLAY_MAGIC, OVERLAY_MAGIC_LEN);
+    for (int i = 0; i < 4; i++)
+    {
+        hdr[12 + i] = (uint8_t)(_base_size >> (8 * i));
+        hdr[16 + i] = (uint8_t)(_base_hash >> (8 * i));
+    }
+    hdr[20] = LOBYTE_FROM_UINT16(idlen);
+    hdr[21] = HIBYTE_FROM_UINT16(idlen);
+    if (fwrite(hdr, 1, sizeof(hdr), _delta) != sizeof(hdr) ||
+        fwrite(_identity.data(), 1, idlen, _delta) != idlen || !_store_size())
+    {
+        Debug_printf("Failed to write overlay \"%s\"\r\n", _path.c_str());
+        _drop_delta();
+        return false;
+    }
+    _append_at = OVERLAY_HEADER_LEN + idlen;
+    return true;
+}
+
+
+bool FileHandlerOverlay::_store_size()
+{
+    uint8_t size[4] = {(uint8_t)_size, (uint8_t)(_size >> 8), (uint8_t)(_size >> 16), (uint8_t)(_size >> 24)};
+    return fseek(_delta, OVERLAY_MAGIC_LEN, SEEK_SET) == 0 && fwrite(size, 1, sizeof(size), _delta) == sizeof(size);
+}
+
+
+void FileHandlerOverlay::_drop_delta()
+{
+    if (_delta != nullptr)
+    {
+        fclose(_delta);
+        _delta = nullptr;
+    }
+    fnSDFAT.remove(_path.c_str());
+    _blocks.clear();
+    _append_at = 0;
+}
+
+
+// Read from wrapped image, bytes past its end (image grown by writes) are zero
+size_t FileHandlerOverlay::_base_read(long int off, uint8_t *buf, size_t len)
+{
+    size_t n = 0;
+    if (off < (long int)_base_size)
+    {
+        size_t want = _base_size - off;
+        if (want > len)
+            want = len;
+        if (_fh->seek(off, SEEK_SET) != 0)
+            return 0;
+        n = _fh->read(buf, 1, want);
+        if (n != want)
+            return n;
+    }
+    memset(buf + n, 0, len - n);
+    return len;
+}
+
+
+int FileHandlerOverlay::seek(long int off, int whence)
+{
+    if (_fh == nullptr)
+        return -1;
+
+    long int new_pos;
+    switch (whence)
+    {
+    case SEEK_SET:
+        new_pos = off;
+        break;
+    case SEEK_CUR:
+        new_pos = _position + off;
+        break;
+    case SEEK_END:
+        new_pos = (long int)_size + off;
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (new_pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    _position = new_pos;
+    return 0;
+}
+
+
+long int FileHandlerOverlay::tell()
+{
+    return _position;
+}
+
+
+size_t FileHandlerOverlay::read(void *ptr, size_t size, size_t count)
+{
+    if (_fh == nullptr || size == 0 || _position >= (long int)_size)
+        return 0;
+
+    uint8_t *out = (uint8_t *)ptr;
+    size_t requested = size * count;
+    size_t available = _size - (size_t)_position;
+    if (requested > available)
+        requested = available;
+    size_t done = 0;
+
+    while (done < requested)
+    {
+        uint32_t block = _position / OVERLAY_BLOCK_SIZE;
+        uint32_t boff = _position % OVERLAY_BLOCK_SIZE;
+        size_t n = requested - done;
+
+        auto b = _blocks.find(block);
+        if (b != _blocks.end())
+        {
+            if (n > OVERLAY_BLOCK_SIZE - boff)
+                n = OVERLAY_BLOCK_SIZE - boff;
+            if (fseek(_delta, b->second + boff, SEEK_SET) != 0 || fread(out + done, 1, n, _delta) != n)
+                break;
+        }
+        else
+        {
+            // unchanged bytes up to next changed block with single read
+            auto next = _blocks.upper_bound(block);
+            if (next != _blocks.end() && (long int)next->first * OVERLAY_BLOCK_SIZE - _position < (long int)n)
+                n = (long int)next->first * OVERLAY_BLOCK_SIZE - _position;
+            size_t got = _base_read(_position, out + done, n);
+            if (got != n)
+            {
+                done += got;
+                _position += got;
+                break;
+            }
+        }
+        done += n;
+        _position += n;
+    }
+
+    return done / size;
+}
+
+
+size_t FileHandlerOverlay::write(const void *ptr, size_t size, size_t count)
+{
+    if (_fh == nullptr || size == 0)
+        return 0;
+    if (_delta == nullptr && !_create())
+        return 0;
+
+    const uint8_t *in = (const uint8_t *)ptr;
+    size_t requested = size * count;
+    size_t done = 0;
+
+    while (done < requested)
+    {
+        uint32_t block = _position / OVERLAY_BLOCK_SIZE;
+        uint32_t boff = _position % OVERLAY_BLOCK_SIZE;
+        size_t n = requested - done;
+        if (n > OVERLAY_BLOCK_SIZE - boff)
+            n = OVERLAY_BLOCK_SIZE - boff;
+
+        auto b = _blocks.find(block);
+        if (b == _blocks.end())
+        {
+            // first change of the block, record starts with its current content
+            uint8_t rec[OVERLAY_RECORD_LEN] = {(uint8_t)block, (uint8_t)(block >> 8), (uint8_t)(block >> 16), (uint8_t)(block >> 24)};
+            if (_base_read((long int)block * OVERLAY_BLOCK_SIZE, rec + 4, OVERLAY_BLOCK_SIZE) != OVERLAY_BLOCK_SIZE)
+                break;
+            memcpy(rec + 4 + boff, in + done, n);
+            if (fseek(_delta, _append_at, SEEK_SET) != 0 || fwrite(rec, 1, sizeof(rec), _delta) != sizeof(rec))
+                break;
+            _blocks[block] = _append_at + 4;
+            _append_at += sizeof(rec);
+        }
+        else if (fseek(_delta, b->second + boff, SEEK_SET) != 0 || fwrite(in + done, 1, n, _delta) != n)
+            break;
+
+        done += n;
+        _position += n;
+    }
+
+    if (_position > (long int)_size)
+    {
+        _size = _position;
+        _store_size();
+    }
+    fflush(_delta);
+
+    return done / size;
+}
+
+
+int FileHandlerOverlay::flush()
+{
+    if (_fh == nullptr)
+        return -1;
+    return _delta == nullptr ? 0 : fflush(_delta);
+}
+
+
+// Changed blocks are written in runs of contiguous blocks, one seek and write per run
+bool FileHandlerOverlay::commit()
+{
+    if (_fh == nullptr)
+        return false;
+    if (_blocks.empty())
+        return true;
+
+    std::vector<uint8_t> run;
+    long int run_start = 0;
+    uint8_t data[OVERLAY_BLOCK_SIZE];
+    bool ok = true;
+
+    for (auto it = _blocks.begin(); ok && it != _blocks.end(); ++it)
+    {
+        long int off = (long int)it->first * OVERLAY_BLOCK_SIZE;
+        size_t len = _size - off < OVERLAY_BLOCK_SIZE ? _size - off : OVERLAY_BLOCK_SIZE;
+        if (fseek(_delta, it->second, SEEK_SET) != 0 || fread(data, 1, len, _delta) != len)
+        {
+            ok = false;
+            break;
+        }
+        if (!run.empty() && run_start + (long int)run.size() != off)
+        {
+            ok = _fh->seek(run_start, SEEK_SET) == 0 && _fh->write(run.data(), 1, run.size()) == run.size();
+            run.clear();
+        }
+        if (run.empty())
+            run_start = off;
+        run.insert(run.end(), data, data + len);
+    }
+    if (ok && !run.empty())
+        ok = _fh->seek(run_start, SEEK_SET) == 0 && _fh->write(run.data(), 1, run.size()) == run.size();
+    if (ok)
+        ok = _fh->flush() == 0;
+
+    if (!ok)
+    {
+        Debug_printf("Overlay commit to \"%s\" failed, changes kept\r\n", _identity.c_str());
+        return false;
+    }
+
+    Debug_printf("Overlay committed %u blocks to \"%s\"\r\n", (unsigned)_blocks.size(), _identity.c_str());
+    if (_size > _base_size)
+        _base_size = _size;
+    _base_hash = _hash_base();
+    _drop_delta();
+    return true;
+}
+
+
+void FileHandlerOverlay::discard()
+{
+    Debug_printf("Overlay of \"%s\": %u changed blocks discarded\r\n", _identity.c_str(), (unsigned)_blocks.size());
+    _drop_delta();
+    _size = _base_size;
+}
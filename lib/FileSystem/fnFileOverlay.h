@@ -0,0 +1,81 @@
+#ifndef _FN_FILEOVERLAY_
+#define _FN_FILEOVERLAY_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+
+#include "fnFile.h"
+
+#define OVERLAY_DIR "/.overlay"     // on SD, see FileHandlerOverlay::open()
+#define OVERLAY_MAGIC "FNOVLY02"
+#define OVERLAY_MAGIC_LEN 8
+#define OVERLAY_BLOCK_SIZE 128      // smallest sector size
+
+class fujiHost;
+
+/*
+ * Copy-on-write overlay of disk image on network host
+ *
+ * Writes never reach the wrapped (base) image, changed blocks of
+ * OVERLAY_BLOCK_SIZE bytes are kept in a delta file on SD instead and reads
+ * take them from there. The image stays untouched until commit() writes the
+ * changed blocks into it, discard() drops them. Delta file is named after
+ * hash of host name and image path, it survives unmount and is used again
+ * on next mount of the same image. Delta made for a different image content
+ * (base size or hash of its first and last block changed, e.g. the image was
+ * replaced on the server) is discarded on mount.
+ *
+ * Delta file: OVERLAY_MAGIC, image size (4 bytes LE), base image size
+ * (4 bytes LE), base image hash (4 bytes LE), identity length (2 bytes LE),
+ * identity ("host:path"), followed by records of
+ *   block number (4 bytes LE), block data
+ * Every block has one record, it's rewritten in place when written again.
+ *
+ * Owns the wrapped handler, closes it on close().
+ */
+
+class FileHandlerOverlay : public FileHandler
+{
+protected:
+    FileHandler *_fh;
+    std::string _identity;
+    std::string _path;
+    FILE *_delta = nullptr;
+    std::map<uint32_t, long> _blocks;   // changed block -> offset of its data in delta file
+    long _append_at = 0;                // where next record goes
+    uint32_t _base_size = 0;            // size of wrapped image
+    uint32_t _base_hash = 0;            // hash of first and last block of wrapped image
+    uint32_t _size = 0;                 // size of image with changes
+    long int _position = 0;
+
+    FileHandlerOverlay(FileHandler *fh, const std::string &identity, const std::string &path);
+
+    uint32_t _hash_base();
+    bool _load();
+    bool _create();
+    bool _store_size();
+    void _drop_delta();
+    size_t _base_read(long int off, uint8_t *buf, size_t len);
+
+public:
+    // Overlay for image from given host, nullptr if writes should go to the image (disabled in config, local host)
+    static FileHandlerOverlay *open(FileHandler *f, fujiHost *host, const char *filename);
+    virtual ~FileHandlerOverlay() override;
+
+    virtual int close(bool destroy=true) override;
+    virtual int seek(long int off, int whence) override;
+    virtual long int tell() override;
+    virtual size_t read(void *ptr, size_t size, size_t count) override;
+    virtual size_t write(const void *ptr, size_t size, size_t count) override;
+    virtual int flush() override;
+
+    size_t changed_blocks() { return _blocks.size(); }
+    // Write changed blocks into the image, false on error (changes are kept)
+    bool commit();
+    // Forget changed blocks
+    void discard();
+};
+
+#endif //_FN_FILEOVERLAY_
@@ -11,6 +11,7 @@
 #include "fnSystem.h"
 #include "bus.h"
 #include "fnUDP.h"
+#include "fnTrace.h"
 
 #include "utils.h"
 
@@ -1226,6 +1227,8 @@ const char *tnfs_getcwd(tnfsMountInfo *m_info)
  */
 bool _tnfs_transaction(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_size)
 {
+    fnTraceSpan span("tnfs", "transaction");
+    span.arg("command", pkt.command);
     fnUDP udp;
 
     // Keep copy of 1st payload byte
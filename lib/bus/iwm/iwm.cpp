@@ -1,6 +1,7 @@
 #ifdef BUILD_APPLE
 #include "iwm.h"
 #include "fnSystem.h"
+#include "fnEventLoop.h"
 #if SMARTPORT != SLIP
 #include "fnHardwareTimer.h"
 #endif
@@ -835,6 +836,17 @@ void iwmBus::disableDevice(uint8_t device_id)
   p->device_active = false;
 }
 
+// Register with event loop, SLIP request thread wakes the main loop when a new request arrives
+void iwmBus::prepare_wait()
+{
+#if SMARTPORT == SLIP
+  if (smartport.request_pending() || sp_command_mode == sp_cmd_state_t::command)
+    eventLoop.add_timeout(0);
+#else
+  eventLoop.add_timeout(0);
+#endif
+}
+
 // Give devices an opportunity to clean up before a reboot
 void iwmBus::shutdown()
 {
@@ -301,6 +301,7 @@ public:
   // these things stay for the most part
   void setup();
   void service();
+  void prepare_wait();
   void shutdown();
 
   int numDevices();
@@ -31,6 +31,7 @@
 #include "../slip/Request.h"
 #include "fnConfig.h"
 #include "fnDNS.h"
+#include "fnEventLoop.h"
 
 #define PHASE_IDLE   0b0000
 #define PHASE_ENABLE 0b1010
@@ -110,9 +111,8 @@ int iwm_slip::iwm_send_packet_spi()
 {
   auto data = current_response->serialize();
 
-  // Some debug to remove
   char *msg = util_hexdump(data.data(), data.size());
-  printf("iwm_slip::iwm_send_packet_spi\nresponse data (not including SLIP):\n%s\n", msg);
+  Debug_printf("iwm_slip::iwm_send_packet_spi\nresponse data (not including SLIP):\n%s\n", msg);
   free(msg);
 
   // send the data
@@ -131,10 +131,11 @@ void iwm_slip::spi_end()
 
 void iwm_slip::encode_packet(uint8_t source, iwm_packet_type_t packet_type, uint8_t status, const uint8_t* data, uint16_t num)
 {
-  std::cout << "\niwm_slip::encode_packet\nsource: " << static_cast<unsigned int>(source) << ", packet type: " << ipt2str(packet_type) << ", status: " << static_cast<unsigned int>(status) << ", num: " << static_cast<unsigned int>(num) << std::endl;
+  Debug_printf("\niwm_slip::encode_packet\nsource: %u, packet type: %s, status: %u, num: %u\n",
+               (unsigned int)source, ipt2str(packet_type).c_str(), (unsigned int)status, (unsigned int)num);
   if (num > 0) {
     char *msg = util_hexdump(data, num);
-    printf("%s\n", msg);
+    Debug_printf("%s\n", msg);
     free(msg);
   }
 
@@ -149,10 +150,10 @@ size_t iwm_slip::decode_data_packet(uint8_t* output_data)
   current_request->copy_payload(output_data);
 
   auto payload_size = current_request->payload_size();
-  std::cout << "\niwm_slip::decode_data_packet\nrequest payload size: " << payload_size << ", data:" << std::endl;
+  Debug_printf("\niwm_slip::decode_data_packet\nrequest payload size: %u, data:\n", (unsigned int)payload_size);
   if (payload_size > 0) {
     char *msg = util_hexdump(output_data, payload_size);
-    printf("%s\n", msg);
+    Debug_printf("%s\n", msg);
     free(msg);
   }
 
@@ -225,15 +226,25 @@ void iwm_slip::wait_for_requests() {
     auto request_data = connection_->wait_for_request();
     if (!request_data.empty()) {
       char *msg = util_hexdump(request_data.data(), request_data.size());
-      printf("\nNEW Request data:\n%s\n", msg);
+      Debug_printf("\nNEW Request data:\n%s\n", msg);
       free(msg);
 
-      std::lock_guard<std::mutex> lock(queue_mutex_);
-      request_queue_.push(request_data);
+      {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        request_queue_.push(request_data);
+      }
+      // let the main loop know there is a request to process
+      eventLoop.wakeup();
     }
   }
 }
 
+bool iwm_slip::request_pending()
+{
+  std::lock_guard<std::mutex> lock(queue_mutex_);
+  return !request_queue_.empty();
+}
+
 iwm_slip smartport;
 
 #endif
@@ -65,6 +65,7 @@ public:
   void close_connection(int sock);
   bool connect_to_server(std::string host, int port);
   void wait_for_requests();
+  bool request_pending();
 
   uint8_t packet_buffer[PACKET_LEN];
   size_t packet_size;
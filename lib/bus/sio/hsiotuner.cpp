@@ -0,0 +1,115 @@
+#ifdef BUILD_ATARI
+
+#include "hsiotuner.h"
+
+#include <string.h>
+
+#include "../../include/debug.h"
+
+#include "fnConfig.h"
+#include "sio.h"
+
+
+int sioHsioTuner::slot(int index)
+{
+    if (index == HSIO_DISABLED_INDEX || index == 40)
+        return HSIO_TUNER_STANDARD_SLOT;
+    if (index >= 0 && index <= 16)
+        return index;
+    return -1;
+}
+
+void sioHsioTuner::reset(int index)
+{
+    _suggested = index;
+    _win_frames = 0;
+    _win_errors = 0;
+}
+
+void sioHsioTuner::frame(int slot)
+{
+    if (slot < 0)
+        return;
+    _stats[slot].frames++;
+    if (slot != _suggested)
+        return;
+    _win_frames++;
+    _decide();
+}
+
+void sioHsioTuner::error(int slot)
+{
+    if (slot < 0)
+        return;
+    _stats[slot].errors++;
+    if (slot != _suggested)
+        return;
+    _win_errors++;
+    _decide();
+}
+
+void sioHsioTuner::nak(int slot)
+{
+    if (slot >= 0)
+        _stats[slot].naks++;
+}
+
+void sioHsioTuner::get_stats(hsio_link_stats stats[HSIO_TUNER_SLOTS])
+{
+    memcpy(stats, _stats, sizeof(_stats));
+}
+
+// index has high overall error rate
+bool sioHsioTuner::_unreliable(int index)
+{
+    hsio_link_stats &s = _stats[index];
+    if (s.frames < HSIO_TUNE_WINDOW)
+        return s.errors >= HSIO_TUNE_MAX_ERRORS;
+    return (uint64_t)s.errors * 1000 > (uint64_t)s.frames * HSIO_TUNE_BAD_PERMILLE;
+}
+
+void sioHsioTuner::_decide()
+{
+    if (_suggested < 0 || _suggested > 16)
+        return;
+
+    // slower: 0 .. 10 -> 16 (38400 baud), nothing slower to try
+    int slower = _suggested == SIO_HISPEED_LOWEST_INDEX ? SIO_HISPEED_x2_INDEX : _suggested + 1;
+    if (_suggested == SIO_HISPEED_x2_INDEX)
+        slower = -1;
+
+    if (_win_errors >= HSIO_TUNE_MAX_ERRORS)
+    {
+        if (slower >= 0)
+            _step(slower, "too many errors");
+        else
+            reset(_suggested);
+        return;
+    }
+    if (_win_frames < HSIO_TUNE_WINDOW)
+        return;
+
+    uint64_t errors = (uint64_t)_win_errors * 1000;
+    if (errors > (uint64_t)_win_frames * HSIO_TUNE_BAD_PERMILLE && slower >= 0)
+        _step(slower, "high error rate");
+    else if (errors <= (uint64_t)_win_frames * HSIO_TUNE_CLEAN_PERMILLE)
+    {
+        // faster: 16 -> 10 .. 0
+        int faster = _suggested == SIO_HISPEED_x2_INDEX ? SIO_HISPEED_LOWEST_INDEX : _suggested - 1;
+        if (faster >= 0 && !_unreliable(faster))
+            _step(faster, "clean link");
+        else
+            reset(_suggested);
+    }
+    else
+        reset(_suggested);
+}
+
+void sioHsioTuner::_step(int index, const char *why)
+{
+    Debug_printf("HSIO tuner: index %d -> %d (%s, %u errors in %u frames)\n",
+                 _suggested, index, why, _win_errors, _win_frames);
+    reset(index);
+}
+
+#endif /* BUILD_ATARI */
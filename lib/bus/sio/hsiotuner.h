@@ -0,0 +1,64 @@
+#ifndef HSIOTUNER_H
+#define HSIOTUNER_H
+
+#include <stdint.h>
+
+/*
+ * Automatic HSIO index selection from link error rates
+ *
+ * Command frames, link errors (bad command/data frame checksums, broken
+ * command frames) and NAKs are counted per HSIO index the bus was running at.
+ * Every HSIO_TUNE_WINDOW frames at high speed the tuner decides: clean window
+ * moves the suggested index one step faster (toward 0), high error rate moves
+ * it one step slower. Indexes which already proved unreliable are not tried
+ * again. Bad command frames followed by speed toggle are the computer talking
+ * at the other speed, not link errors, the bus reports them only after a good
+ * frame at the same speed. The suggestion is advertised to the computer on next HSIO index
+ * request ('?' command), running transfer speed is never changed under it.
+ */
+
+#define HSIO_TUNER_SLOTS 18             // HSIO index 0 .. 16 and standard speed
+#define HSIO_TUNER_STANDARD_SLOT 17     // 19200 baud (HSIO disabled or index 40)
+#define HSIO_TUNE_WINDOW 256            // frames at high speed between decisions
+#define HSIO_TUNE_CLEAN_PERMILLE 2      // error rate to step faster
+#define HSIO_TUNE_BAD_PERMILLE 20       // error rate to step slower (and to never retry the index)
+#define HSIO_TUNE_MAX_ERRORS 8          // errors in window to step slower immediately
+
+struct hsio_link_stats
+{
+    uint32_t frames;                    // command frames received
+    uint32_t errors;                    // checksum and framing errors
+    uint32_t naks;                      // NAKs sent
+};
+
+class sioHsioTuner
+{
+public:
+    // start tuning from index, HSIO_DISABLED_INDEX stops tuning
+    void reset(int index);
+
+    // link events at given slot (see slot())
+    void frame(int slot);
+    void error(int slot);
+    void nak(int slot);
+
+    // index to advertise to the computer
+    int suggested() { return _suggested; }
+
+    // slot for HSIO index, -1 if not tracked
+    static int slot(int index);
+    void get_stats(hsio_link_stats stats[HSIO_TUNER_SLOTS]);
+
+private:
+    void _decide();
+    void _step(int index, const char *why);
+    bool _unreliable(int index);
+
+    hsio_link_stats _stats[HSIO_TUNER_SLOTS] = {};
+    int _suggested = -1;
+    // current decision window at _suggested index
+    uint32_t _win_frames = 0;
+    uint32_t _win_errors = 0;
+};
+
+#endif // HSIOTUNER_H
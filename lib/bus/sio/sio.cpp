@@ -10,8 +10,11 @@
 #include "siocpm.h"
 
 #include "fnSystem.h"
+#include "fnEventLoop.h"
 #include "fnConfig.h"
 #include "fnDNS.h"
+#include "fnMetrics.h"
+#include "fnTrace.h"
 // #include "led.h"
 #include "utils.h"
 
@@ -42,6 +45,9 @@ uint8_t sio_checksum(uint8_t *buf, unsigned short len)
 */
 void virtualDevice::bus_to_computer(uint8_t *buf, uint16_t len, bool err)
 {
+    if (!_async_respond)
+        return; // computer is not waiting anymore
+
     // Write data frame to computer
     Debug_printf("->SIO write %hu bytes\n", len);
 #ifdef VERBOSE_SIO
@@ -51,16 +57,10 @@ void virtualDevice::bus_to_computer(uint8_t *buf, uint16_t len, bool err)
     Debug_print("\n");
 #endif
 
-    // Write ERROR or COMPLETE status
-    if (err == true)
-        sio_error();
-    else
-        sio_complete();
-
-    // Write data frame
-    fnSioCom.write(buf, len);
-    // Write checksum
-    fnSioCom.write(sio_checksum(buf, len));
+    // Write ERROR or COMPLETE status, data frame and checksum together
+    fnSystem.delay_microseconds(DELAY_T5);
+    fnSioCom.write_response(err ? 'E' : 'C', buf, len, sio_checksum(buf, len));
+    Debug_println(err ? "ERROR!" : "COMPLETE!");
 
     fnSioCom.flush();
 }
@@ -104,6 +104,8 @@ uint8_t virtualDevice::bus_to_peripheral(uint8_t *buf, unsigned short len)
 
     if (ck_rcv != ck_tst)
     {
+        busMetrics.data_checksum_error(_devnum);
+        SIO.linkError();
         sio_nak();
         // return false; // apc
     }
@@ -119,6 +121,8 @@ void virtualDevice::sio_nak()
     fnSioCom.write('N');
     fnSioCom.flush();
     SIO.set_command_processed(true);
+    busMetrics.nak(_devnum);
+    SIO.linkNak();
     Debug_println("NAK!");
 }
 
@@ -150,6 +154,11 @@ void virtualDevice::sio_late_ack()
 // SIO COMPLETE
 void virtualDevice::sio_complete()
 {
+    if (!_async_respond)
+    {
+        Debug_println("COMPLETE! (dropped)");
+        return;
+    }
     fnSystem.delay_microseconds(DELAY_T5);
     fnSioCom.write('C');
     Debug_println("COMPLETE!");
@@ -158,6 +167,11 @@ void virtualDevice::sio_complete()
 // SIO ERROR
 void virtualDevice::sio_error()
 {
+    if (!_async_respond)
+    {
+        Debug_println("ERROR! (dropped)");
+        return;
+    }
     fnSystem.delay_microseconds(DELAY_T5);
     fnSioCom.write('E');
     Debug_println("ERROR!");
@@ -167,17 +181,168 @@ void virtualDevice::sio_error()
 void virtualDevice::sio_high_speed()
 {
     Debug_print("sio HSIO INDEX\n");
-    int index = SIO.getHighSpeedIndex();
+    int index = SIO.negotiateHighSpeedIndex();
     uint8_t hsd = index == HSIO_DISABLED_INDEX ? 40 : (uint8_t)index;
     bus_to_computer((uint8_t *)&hsd, 1, false);
+
+    // computer uses new index from now on, follow it if we are at high speed
+    if (index != SIO.getHighSpeedIndex())
+    {
+        bool high = SIO.getBaudrate() != SIO_STANDARD_BAUDRATE;
+        SIO.setHighSpeedIndex(index);
+        if (high)
+            SIO.setBaudrate(SIO.getHighSpeedBaud());
+    }
 }
 
 systemBus virtualDevice::sio_get_bus() { return SIO; }
 
+// Deadline policy from config for given device
+static fnConfig::deadline_policy deadline_policy_for(int devnum)
+{
+    if (devnum >= SIO_DEVICEID_DISK && devnum <= SIO_DEVICEID_DISK_LAST)
+        return Config.get_deadline_disk();
+    if (devnum >= SIO_DEVICEID_FN_NETWORK && devnum <= SIO_DEVICEID_FN_NETWORK_LAST)
+        return Config.get_deadline_network();
+    return fnConfig::DEADLINE_WAIT;
+}
+
+// Run blocking work on worker pool, finish command when done
+void virtualDevice::sio_async(std::function<int()> work, std::function<void(int)> finish, bool exclusive)
+{
+    _async_frame = cmdFrame;
+    _async_cmd_seq = SIO.command_seq();
+    _async_finish = finish;
+    _async_exclusive = exclusive;
+    _async_policy = deadline_policy_for(_devnum);
+    _async_timeout = sio_command_timeout();
+    _async_timed_out = false;
+    _async_start_us = SIO.command_start_us();
+    _async_set_deadline();
+    _async_job = workerPool.submit(work);
+}
+
+// Send timed ERROR shortly before the computer gives up waiting
+void virtualDevice::_async_set_deadline()
+{
+    if (_async_policy == fnConfig::DEADLINE_WAIT)
+    {
+        _async_deadline = 0;
+        return;
+    }
+    int timeout = _async_timeout * SIO_TIMEOUT_UNIT_MS - Config.get_deadline_margin();
+    _async_deadline = fnSystem.millis() + (timeout > 0 ? timeout : 0);
+}
+
+// Call finish function for completed work
+void virtualDevice::_async_complete(bool respond)
+{
+    std::shared_ptr<fnJob> job = _async_job;
+    std::function<void(int)> finish = _async_finish;
+    _async_job = nullptr;
+    _async_finish = nullptr;
+
+    _async_respond = respond;
+    finish(job->result());
+    _async_respond = true;
+
+    if (respond)
+        busMetrics.command_latency(_async_frame.device, _async_frame.comnd, sio_host_type(),
+                                   fnSystem.micros() - _async_start_us);
+}
+
+// Pass command frame to device, wait for pending async work it depends on first
+void systemBus::_sio_dispatch(virtualDevice *devicep, cmdFrame_t &frame)
+{
+    // computer is retrying the command we sent timed ERROR for, give it the result when ready
+    if (devicep->_async_job != nullptr && devicep->_async_timed_out &&
+        devicep->_async_policy == fnConfig::DEADLINE_RETRY &&
+        devicep->_async_frame.commanddata == frame.commanddata)
+    {
+        Debug_printf("Retry of pending command for device %02x\n", devicep->_devnum);
+        _activeDev = devicep;
+        devicep->sio_late_ack();
+        devicep->_async_cmd_seq = _command_seq;
+        devicep->_async_timed_out = false;
+        devicep->_async_set_deadline();
+        return;
+    }
+
+    for (auto d : _daisyChain)
+    {
+        if (d->_async_job != nullptr && (d == devicep || d->_async_exclusive))
+        {
+            Debug_printf("Waiting for device %02x pending command\n", d->_devnum);
+            d->_async_job->wait();
+            d->_async_complete(false);
+        }
+    }
+    _activeDev = devicep;
+    // handle command
+    bool processed = _command_processed;
+    devicep->sio_process(frame.commanddata, frame.checksum);
+
+    // latency of commands finished here, async ones are recorded on completion
+    if (!processed && _command_processed && !devicep->sio_async_pending())
+        busMetrics.command_latency(frame.device, frame.comnd, devicep->sio_host_type(),
+                                   fnSystem.micros() - _command_start_us);
+}
+
+// Finish async commands with completed work, handle missed deadlines
+void systemBus::_sio_process_async()
+{
+    uint64_t ms = fnSystem.millis();
+
+    for (auto devicep : _daisyChain)
+    {
+        if (devicep->_async_job == nullptr)
+            continue;
+
+        // computer is waiting for response if there was no other command since the work was submitted
+        bool waiting = (devicep->_async_cmd_seq == _command_seq) && !devicep->_async_timed_out;
+
+        if (devicep->_async_job->done())
+        {
+            // keep the result for a while after timed ERROR, computer is likely to retry
+            if (!waiting && devicep->_async_timed_out && devicep->_async_cmd_seq == _command_seq &&
+                devicep->_async_policy == fnConfig::DEADLINE_RETRY && ms < devicep->_async_deadline)
+                continue;
+            devicep->_async_complete(waiting);
+        }
+        else if (devicep->_async_deadline != 0 && ms >= devicep->_async_deadline)
+        {
+            if (waiting)
+            {
+                Debug_printf("Device %02x missed command deadline\n", devicep->_devnum);
+                busMetrics.deadline_missed(devicep->_devnum);
+                devicep->sio_timed_error();
+                devicep->_async_timed_out = true;
+                devicep->_async_deadline = ms + SIO_RETRY_HOLD_MS;
+            }
+            else
+                devicep->_async_deadline = 0; // computer moved on or retry hold time is over
+        }
+    }
+}
+
+// Some device has work running which blocks other commands
+bool systemBus::async_exclusive_pending()
+{
+    for (auto devicep : _daisyChain)
+    {
+        if (devicep->_async_job != nullptr && devicep->_async_exclusive)
+            return true;
+    }
+    return false;
+}
+
 // Read and process a command frame from SIO
 void systemBus::_sio_process_cmd()
 {
+    fnTraceSpan span("sio", "command");
     _command_processed = false;
+    _command_seq++;
+    _command_start_us = fnSystem.micros();
 
     if (_modemDev != nullptr && _modemDev->modemActive)
     {
@@ -198,6 +363,7 @@ void systemBus::_sio_process_cmd()
         if (rxbytes == 1+sizeof(tempFrame))
         {
             // COMMAND deaserted during read
+            _link_errors_pending++;
             // Switch to/from hispeed SIO if we get enough failed commands
             _command_frame_counter++;
             if (COMMAND_FRAME_SPEED_CHANGE_THRESHOLD == _command_frame_counter)
@@ -240,11 +406,18 @@ void systemBus::_sio_process_cmd()
 
     Debug_printf("CF: %02x %02x %02x %02x %02x\n",
                  tempFrame.device, tempFrame.comnd, tempFrame.aux1, tempFrame.aux2, tempFrame.cksum);
+    span.arg("device", tempFrame.device);
+    span.arg("command", tempFrame.comnd);
 
     uint8_t ck = sio_checksum((uint8_t *)&tempFrame.commanddata, sizeof(tempFrame.commanddata)); // Calculate Checksum
     if (ck == tempFrame.checksum)
     {
         _command_frame_counter = 0;
+        // bad frames since the last good one at this speed were link errors
+        int slot = _link_slot();
+        for (; _link_errors_pending > 0; _link_errors_pending--)
+            _hsio_tuner.error(slot);
+        _hsio_tuner.frame(slot);
         if (tempFrame.device == SIO_DEVICEID_DISK && _fujiDev != nullptr && _fujiDev->boot_config)
         {
             _activeDev = _fujiDev->bootdisk();
@@ -257,8 +430,7 @@ void systemBus::_sio_process_cmd()
             else
             {
                 Debug_println("FujiNet CONFIG boot");
-                // handle command
-                _activeDev->sio_process(tempFrame.commanddata, tempFrame.checksum);
+                _sio_dispatch(_activeDev, tempFrame);
             }
         }
         else
@@ -267,36 +439,27 @@ void systemBus::_sio_process_cmd()
             if (tempFrame.device == SIO_DEVICEID_TYPE3POLL)
             {
                 Debug_println("SIO TYPE3 POLL");
-                for (auto devicep : _daisyChain)
+                for (auto devicep : _type3Listeners)
                 {
-                    if (devicep->listen_to_type3_polls)
-                    {
-                        Debug_printf("Sending TYPE3 poll to dev %x\n", devicep->_devnum);
-                        _activeDev = devicep;
-                        // handle command
-                        _activeDev->sio_process(tempFrame.commanddata, tempFrame.checksum);
-                    }
+                    Debug_printf("Sending TYPE3 poll to dev %x\n", devicep->_devnum);
+                    _sio_dispatch(devicep, tempFrame);
                 }
             }
             else
             {
                 // find device, ack and pass control
                 // or go back to WAIT
-                for (auto devicep : _daisyChain)
-                {
-                    if (tempFrame.device == devicep->_devnum)
-                    {
-                        _activeDev = devicep;
-                        // handle command
-                        _activeDev->sio_process(tempFrame.commanddata, tempFrame.checksum);
-                    }
-                }
+                virtualDevice *devicep = _dispatchTable[tempFrame.device];
+                if (devicep != nullptr)
+                    _sio_dispatch(devicep, tempFrame);
             }
         }
     } // valid checksum
     else
     {
         Debug_print("CHECKSUM_ERROR\n");
+        busMetrics.command_checksum_error();
+        _link_errors_pending++;
         // Switch to/from hispeed SIO if we get enough failed frame checksums
         _command_frame_counter++;
         if (COMMAND_FRAME_SPEED_CHANGE_THRESHOLD == _command_frame_counter)
@@ -344,8 +507,8 @@ void systemBus::_sio_process_queue()
  */
 void systemBus::service()
 {
-    do
-    {
+    // Send COMPLETE/ERROR for commands running on worker pool
+    _sio_process_async();
 
     // Check for any messages in our queue (this should always happen, even if any other special
     // modes disrupt normal SIO handling - should probably make a separate task for this)
@@ -374,7 +537,7 @@ void systemBus::service()
     if (_cpmDev != nullptr && _cpmDev->cpmActive && Config.get_cpm_enabled())
     {
         _cpmDev->sio_handle_cpm();
-        continue;
+        return; // break!
     }
 
     // check if cassette is mounted and enabled first
@@ -442,10 +605,57 @@ void systemBus::service()
             _netDev[i]->sio_poll_interrupt();
     }
 
-    // poll with 1 ms interval
-    //   true  = SIO port needs handling
-    //   false = no SIO "event" ocurred within interval
-    } while (fnSioCom.poll(1));
+    // Device timers, not while work which may share their objects is running
+    if (!async_exclusive_pending())
+    {
+        uint64_t now = fnSystem.millis();
+        for (auto devicep : _daisyChain)
+        {
+            uint64_t deadline = devicep->sio_timer_deadline();
+            if (deadline != 0 && deadline <= now && devicep->_async_job == nullptr)
+                devicep->sio_timer();
+        }
+    }
+}
+
+// Register SIO events with event loop, main loop sleeps until some of them occur
+void systemBus::prepare_wait()
+{
+    // cassette handling needs to run continuously
+    if (_fujiDev->cassette()->is_active())
+    {
+        eventLoop.add_timeout(0);
+        return;
+    }
+
+    // CMD line, incoming data, NetSIO alive/resume timers
+    fnSioCom.prepare_wait();
+
+    // active modem and CP/M are polled at 1 ms rate
+    if ((_modemDev != nullptr && _modemDev->modemActive) ||
+        (_cpmDev != nullptr && _cpmDev->cpmActive && Config.get_cpm_enabled()))
+        eventLoop.add_timeout(1);
+
+    // network devices with interrupts enabled
+    for (int i = 0; i < 8; i++)
+    {
+        if (_netDev[i] != nullptr)
+            _netDev[i]->prepare_wait();
+    }
+
+    // async command deadlines, completion of work wakes up event loop by itself
+    // device timers are skipped by service() while async work runs, see there
+    bool timers = !async_exclusive_pending();
+    for (auto devicep : _daisyChain)
+    {
+        if (devicep->_async_job != nullptr && devicep->_async_deadline != 0)
+            eventLoop.add_deadline(devicep->_async_deadline);
+        if (!timers || devicep->_async_job != nullptr)
+            continue;
+        uint64_t deadline = devicep->sio_timer_deadline();
+        if (deadline != 0)
+            eventLoop.add_deadline(deadline);
+    }
 }
 
 // Setup SIO bus
@@ -458,6 +668,7 @@ void systemBus::setup()
     fnSioCom.set_netsio_host(Config.get_netsio_host().c_str(), Config.get_netsio_port()); // NetSIO
     fnSioCom.set_sio_mode(Config.get_netsio_enabled() ? SioCom::sio_mode::NETSIO : SioCom::sio_mode::SERIAL);
     fnSioCom.begin(_sioBaud);
+    busMetrics.baudrate_changed(_sioBaud);
 
     fnSioCom.set_interrupt(false);
     fnSioCom.set_proceed(false);
@@ -467,6 +678,7 @@ void systemBus::setup()
 
     // Set the initial HSIO index
     setHighSpeedIndex(Config.get_general_hsioindex());
+    setHighSpeedAuto(Config.get_general_hsio_auto());
 
     fnSioCom.flush_input();
 }
@@ -506,6 +718,7 @@ void systemBus::addDevice(virtualDevice *pDevice, int device_id)
     pDevice->_devnum = device_id;
 
     _daisyChain.push_front(pDevice);
+    _update_dispatch();
 }
 
 // Removes device from the SIO bus.
@@ -513,6 +726,25 @@ void systemBus::addDevice(virtualDevice *pDevice, int device_id)
 void systemBus::remDevice(virtualDevice *p)
 {
     _daisyChain.remove(p);
+    _update_dispatch();
+}
+
+// Rebuild device lookup table and Type3 poll listeners after devices or their ids changed
+void systemBus::_update_dispatch()
+{
+    for (auto &entry : _dispatchTable)
+        entry = nullptr;
+    _type3Listeners.clear();
+
+    for (auto devicep : _daisyChain)
+    {
+        uint8_t id = (uint8_t)devicep->_devnum;
+        // ids can be shared for a moment while disks are rotated, latest added device wins
+        if (_dispatchTable[id] == nullptr)
+            _dispatchTable[id] = devicep;
+        if (devicep->listen_to_type3_polls)
+            _type3Listeners.push_back(devicep);
+    }
 }
 
 // Should avoid using this as it requires counting through the list
@@ -533,16 +765,14 @@ void systemBus::changeDeviceId(virtualDevice *p, int device_id)
         if (devicep == p)
             devicep->_devnum = device_id;
     }
+    _update_dispatch();
 }
 
 virtualDevice *systemBus::deviceById(int device_id)
 {
-    for (auto devicep : _daisyChain)
-    {
-        if (devicep->_devnum == device_id)
-            return devicep;
-    }
-    return nullptr;
+    if (device_id < 0 || device_id > 255)
+        return nullptr;
+    return _dispatchTable[device_id];
 }
 
 // Give devices an opportunity to clean up before a reboot
@@ -552,11 +782,17 @@ void systemBus::shutdown()
 
     for (auto devicep : _daisyChain)
     {
+        if (devicep->_async_job != nullptr)
+        {
+            devicep->_async_job->wait();
+            devicep->_async_complete(false);
+        }
         Debug_printf("Shutting down device %02x\n",devicep->id());
         devicep->shutdown();
     }
     Debug_printf("All devices shut down.\n");
     fnSioCom.end();
+    fnSioCom.stop_recording();
 }
 
 void systemBus::toggleBaudrate()
@@ -567,8 +803,11 @@ void systemBus::toggleBaudrate()
         baudrate = _sioBaud == SIO_STANDARD_BAUDRATE ? _sioBaudUltraHigh : SIO_STANDARD_BAUDRATE;
 
     Debug_printf("Toggling baudrate from %d to %d\n", _sioBaud, baudrate);
+    // failed frames were sent at the other speed
+    _link_errors_pending = 0;
     _sioBaud = baudrate;
     fnSioCom.set_baudrate(_sioBaud);
+    busMetrics.baudrate_toggled(_sioBaud);
 }
 
 int systemBus::getBaudrate()
@@ -587,6 +826,7 @@ void systemBus::setBaudrate(int baud)
     Debug_printf("Changing baudrate from %d to %d\n", _sioBaud, baud);
     _sioBaud = baud;
     fnSioCom.set_baudrate(baud);
+    busMetrics.baudrate_changed(baud);
 }
 
 // Set HSIO index. Sets high speed SIO baud and also returns that value.
@@ -597,6 +837,7 @@ int systemBus::setHighSpeedIndex(int hsio_index)
     if (hsio_index == HSIO_DISABLED_INDEX)
     {
         _sioHighSpeedIndex = HSIO_DISABLED_INDEX;
+        _hsio_tuner.reset(HSIO_DISABLED_INDEX);
         _sioBaudHigh = SIO_STANDARD_BAUDRATE; // 19200
         Debug_print("HSIO disabled\n");
         return _sioBaudHigh;
@@ -626,6 +867,7 @@ int systemBus::setHighSpeedIndex(int hsio_index)
 	}
 
     _sioHighSpeedIndex = hsio_index;
+    _hsio_tuner.reset(hsio_index);
 
     // int alt = SIO_ATARI_PAL_FREQUENCY / (2 * hsio_index + 14);
 
@@ -643,6 +885,37 @@ int systemBus::getHighSpeedBaud()
     return _sioBaudHigh;
 }
 
+// HSIO index to advertise: configured one, or tuner's choice if automatic selection is enabled
+int systemBus::negotiateHighSpeedIndex()
+{
+    if (!_hsio_auto || useUltraHigh || _sioHighSpeedIndex == HSIO_DISABLED_INDEX)
+        return _sioHighSpeedIndex;
+    int index = _hsio_tuner.suggested();
+    if (index != _sioHighSpeedIndex)
+        Debug_printf("Advertising HSIO index %d (was %d)\n", index, _sioHighSpeedIndex);
+    return index;
+}
+
+// Link statistics slot of the current speed
+int systemBus::_link_slot()
+{
+    if (_sioBaud == SIO_STANDARD_BAUDRATE)
+        return HSIO_TUNER_STANDARD_SLOT;
+    if (useUltraHigh && _sioBaud == _sioBaudUltraHigh)
+        return -1;
+    return sioHsioTuner::slot(_sioHighSpeedIndex);
+}
+
+void systemBus::linkError()
+{
+    _hsio_tuner.error(_link_slot());
+}
+
+void systemBus::linkNak()
+{
+    _hsio_tuner.nak(_link_slot());
+}
+
 // indicate command was handled by some device
 void systemBus::set_command_processed(bool processed)
 {
@@ -2,12 +2,21 @@
 #define SIO_H
 
 #include <forward_list>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include "sio/siocom/fnSioCom.h"
+#include "sio/hsiotuner.h"
+#include "fnWorkerPool.h"
 
 #define DELAY_T4 850
 #define DELAY_T5 250
 
+#define SIO_TIMEOUT_DEFAULT 7       // timeout used by OS for most commands (DTIMLO)
+#define SIO_TIMEOUT_UNIT_MS 1067    // DTIMLO unit, 64 vertical blanks (NTSC)
+#define SIO_RETRY_HOLD_MS 3000      // how long to keep late result for computer's retry
+
 /*
 Examples of values that can be defined in PLATFORMIO.INI
 First number is calculated based on the index, second is what the ESP32 actually reports
@@ -176,6 +185,53 @@ protected:
      */
     unsigned short sio_get_aux();
 
+    /**
+     * @brief Run blocking part of the command on worker pool, bus continues serving other devices.
+     * Command should be ACKed (sio_late_ack) before. When work is done, finish is called from bus
+     * thread with work return value to send COMPLETE/ERROR. If the computer has sent another command
+     * frame meanwhile, finish still runs to update device state but nothing is sent to the computer.
+     * Next command for this device waits until pending work is finished.
+     * If work misses the deadline (computer's timeout minus margin), sio_timed_error() is sent
+     * according to device's deadline policy in config.
+     * @param work function executed on worker thread, must touch only this device's objects
+     * @param finish function executed on bus thread with work result
+     * @param exclusive work uses objects shared with other devices (disk images, host sessions),
+     * commands for any other device and web server commands wait until it's finished
+     */
+    void sio_async(std::function<int()> work, std::function<void(int)> finish, bool exclusive=false);
+
+    /**
+     * @brief Response sent to the computer when work submitted by sio_async() misses its deadline.
+     */
+    virtual void sio_timed_error() { sio_error(); }
+
+    /**
+     * @brief Is there work submitted by sio_async() waiting for completion?
+     */
+    bool sio_async_pending() { return _async_job != nullptr; }
+
+    /**
+     * @brief Timeout the computer uses for command in cmdFrame, in DTIMLO units (SIO_TIMEOUT_UNIT_MS).
+     * Deadline of work submitted by sio_async() is derived from it.
+     */
+    virtual int sio_command_timeout() { return SIO_TIMEOUT_DEFAULT; }
+
+    /**
+     * @brief Host type (fujiHostType) of the mounted media, used to split command latency metrics.
+     */
+    virtual int sio_host_type() { return 0; }
+
+    /**
+     * @brief When device wants sio_timer() to be called (fnSystem.millis() time), 0 = never.
+     * Event loop wakes up for it, bus calls the timer when device has no async work pending.
+     */
+    virtual uint64_t sio_timer_deadline() { return 0; }
+
+    /**
+     * @brief Background housekeeping on bus thread (e.g. flushing cached writes), see sio_timer_deadline().
+     */
+    virtual void sio_timer() {}
+
     /**
      * @brief All SIO commands by convention should return a status command, using bus_to_computer() to return
      * four bytes of status information to be put into DVSTAT ($02EA)
@@ -191,6 +247,22 @@ protected:
     // Optional shutdown/reboot cleanup routine
     virtual void shutdown(){};
 
+private:
+    std::shared_ptr<fnJob> _async_job;
+    std::function<void(int)> _async_finish;
+    cmdFrame_t _async_frame;            // command the work belongs to
+    unsigned int _async_cmd_seq = 0;    // bus command sequence when work was submitted
+    bool _async_respond = true;         // false if computer is no longer waiting for response
+    bool _async_exclusive = false;
+    int _async_policy = 0;              // fnConfig::deadline_policy
+    int _async_timeout = SIO_TIMEOUT_DEFAULT; // computer's timeout for the command, DTIMLO units
+    uint64_t _async_deadline = 0;       // send timed ERROR at, 0 = no deadline; result hold time after timed ERROR
+    bool _async_timed_out = false;      // timed ERROR was sent
+    uint64_t _async_start_us = 0;       // command frame time, for latency metrics
+
+    void _async_complete(bool respond);
+    void _async_set_deadline();
+
 public:
     /**
      * @brief get the SIO device Number (1-255)
@@ -243,8 +315,12 @@ class systemBus
 {
 private:
     std::forward_list<virtualDevice *> _daisyChain;
+    virtualDevice *_dispatchTable[256] = {nullptr};  // device by id, kept in sync with _daisyChain
+    std::vector<virtualDevice *> _type3Listeners;    // devices which want Type3 polls
 
     int _command_frame_counter = 0;
+    unsigned int _command_seq = 0;     // incremented on every command frame, used by async commands
+    uint64_t _command_start_us = 0;    // when the current command frame started, for latency metrics
 
     virtualDevice *_activeDev = nullptr;
     modem *_modemDev = nullptr;
@@ -260,16 +336,25 @@ private:
     int _sioBaudHigh = SIO_STANDARD_BAUDRATE;
     int _sioBaudUltraHigh = SIO_STANDARD_BAUDRATE;
 
+    bool _hsio_auto = false;            // pick HSIO index from link error rates
+    sioHsioTuner _hsio_tuner;
+    int _link_errors_pending = 0;       // bad command frames, link errors unless speed toggle follows
+
     bool useUltraHigh = false; // Use fujinet derived clock.
 
     bool _command_processed = false;
 
     void _sio_process_cmd();
     void _sio_process_queue();
+    void _sio_process_async();
+    void _sio_dispatch(virtualDevice *devicep, cmdFrame_t &frame);
+    void _update_dispatch();
+    int _link_slot();
 
 public:
     void setup();
     void service();
+    void prepare_wait();
     void shutdown();
 
     int numDevices();
@@ -285,6 +370,12 @@ public:
     int setHighSpeedIndex(int hsio_index);                      // Set HSIO index. Sets high speed SIO baud and also returns that value.
     int getHighSpeedIndex();                                    // Gets current HSIO index
     int getHighSpeedBaud();                                     // Gets current HSIO baud
+    int negotiateHighSpeedIndex();                              // HSIO index to advertise to the computer
+    void setHighSpeedAuto(bool enable) { _hsio_auto = enable; } // Enable automatic HSIO index selection
+    bool getHighSpeedAuto() { return _hsio_auto; }
+    void linkError();                                           // Data frame received with bad checksum
+    void linkNak();                                             // NAK sent to the computer
+    void getLinkStats(hsio_link_stats stats[HSIO_TUNER_SLOTS]) { _hsio_tuner.get_stats(stats); }
 
     void setUDPHost(const char *newhost, int port);             // Set new host/ip & port for UDP Stream
     void setUltraHigh(bool _enable, int _ultraHighBaud = 0);    // enable ultrahigh/set baud rate
@@ -295,6 +386,9 @@ public:
     bool getShuttingDown() { return shuttingDown; };
 
     void set_command_processed(bool processed);
+    unsigned int command_seq() { return _command_seq; }
+    uint64_t command_start_us() { return _command_start_us; }
+    bool async_exclusive_pending();                             // some device has exclusive async work running
     void sio_empty_ack();                                       // for NetSIO, notify hub we are not interested to handle the command
 
     sioCassette *getCassette() { return _cassetteDev; }
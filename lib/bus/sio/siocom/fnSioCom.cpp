@@ -2,6 +2,8 @@
 
 #include "fnSioCom.h"
 
+#include <algorithm>
+
 #include "debug.h"
 /*
  * SIO Communication class
@@ -9,6 +11,7 @@
  * It uses SioPort for data exchange and to control SIO lines
  * SioPort can be physical serial port (SerialSioPort) to communicate with real Atari computer
  * or network SIO (NetSio = SIO over UDP) for use with Altirra Atari Emulator
+ * or loopback (LoopbackSioPort) replaying recorded SIO trace for benchmarks
  */
 
 SioCom fnSioCom;
@@ -38,9 +41,19 @@ bool SioCom::poll(int ms)
     return _sioPort->poll(ms); 
 }
 
+/*
+ Register SIO port events (fds, deadlines) with event loop
+ */
+void SioCom::prepare_wait()
+{
+    _sioPort->prepare_wait();
+}
+
 void SioCom::set_baudrate(uint32_t baud) 
 { 
     _sioPort->set_baudrate(baud); 
+    if (_recorder.active())
+        _recorder.baud(baud);
 }
 
 uint32_t SioCom::get_baudrate()
@@ -50,7 +63,10 @@ uint32_t SioCom::get_baudrate()
 
 bool SioCom::command_asserted() 
 {
-    return _sioPort->command_asserted();
+    bool asserted = _sioPort->command_asserted();
+    if (_recorder.active())
+        _recorder.command(asserted);
+    return asserted;
 }
 
 bool SioCom::motor_asserted() 
@@ -86,33 +102,64 @@ void SioCom::flush_input()
 // read single byte
 int SioCom::read()
 {
-    return _sioPort->read();
+    int b = _sioPort->read();
+    if (_recorder.active() && b >= 0)
+    {
+        uint8_t c = b;
+        _recorder.rx(&c, 1);
+    }
+    return b;
 }
 
 // read bytes into buffer
 size_t SioCom::read(uint8_t *buffer, size_t length, bool command_mode)
 {
-    return _sioPort->read(buffer, length, command_mode);
+    size_t result = _sioPort->read(buffer, length, command_mode);
+    // serial port returns length + 1 if command line was released during command frame
+    if (_recorder.active())
+        _recorder.rx(buffer, std::min(result, length));
+    return result;
 }
 
 // alias to read
 size_t SioCom::readBytes(uint8_t *buffer, size_t length, bool command_mode)
 {
-    return  _sioPort->read(buffer, length, command_mode);
+    return read(buffer, length, command_mode);
 }
 
 // write single byte
 ssize_t SioCom::write(uint8_t b)
 {
+    if (_recorder.active())
+        _recorder.tx(&b, 1);
     return _sioPort->write(b);
 }
 
 // write buffer
 ssize_t SioCom::write(const uint8_t *buffer, size_t size) 
 {
+    if (_recorder.active())
+        _recorder.tx(buffer, size);
     return _sioPort->write(buffer, size);
 }
 
+// write status byte, data frame and checksum with single port write,
+// NetSIO sends it in single datagram (if it fits), charging flow control credit once
+ssize_t SioCom::write_response(uint8_t status, const uint8_t *buffer, size_t size, uint8_t checksum)
+{
+    _txframe.resize(size + 2);
+    _txframe[0] = status;
+    memcpy(_txframe.data() + 1, buffer, size);
+    _txframe[size + 1] = checksum;
+    return write(_txframe.data(), _txframe.size());
+}
+
+void SioCom::preallocate()
+{
+    // largest frame: status, 64k data, checksum
+    _txframe.reserve(65536 + 2);
+}
+
 // write C-string
 ssize_t SioCom::write(const char *str)
 {
@@ -213,6 +260,9 @@ const char* SioCom::get_netsio_host(int &port)
 
 void SioCom::netsio_late_sync(uint8_t c)
 {
+    // ACK byte is sent later with sync response
+    if (_recorder.active())
+        _recorder.tx(&c, 1);
     _netSio.set_sync_ack_byte(c);
 }
 
@@ -234,6 +284,9 @@ void SioCom::set_sio_mode(sio_mode mode)
     case sio_mode::NETSIO:
         _sioPort = &_netSio;
         break;
+    case sio_mode::LOOPBACK:
+        _sioPort = &_loopbackSio;
+        break;
     default:
         _sioPort = &_serialSio;
     }
@@ -248,4 +301,13 @@ void SioCom::reset_sio_port(sio_mode mode)
     begin(baud);
 }
 
+// Switch to loopback port replaying given trace
+bool SioCom::start_replay(const char *path)
+{
+    if (!_loopbackSio.load(path))
+        return false;
+    reset_sio_port(sio_mode::LOOPBACK);
+    return true;
+}
+
 #endif /* BUILD_ATARI */
@@ -2,10 +2,13 @@
 #define SIOCOM_H
 
 #include <string.h>
+#include <vector>
 
 #include "sioport.h"
 #include "netsio.h"
 #include "serialsio.h"
+#include "loopbacksio.h"
+#include "siotrace.h"
 
 /*
  * SIO Communication class
@@ -13,6 +16,8 @@
  * It uses SioPort for data exchange and to control SIO lines
  * SioPort can be physical serial port (SerialSioPort) to communicate with real Atari computer
  * or network SIO (NetSio = SIO over UDP) for use with Altirra Atari Emulator
+ * or loopback (LoopbackSioPort) replaying recorded SIO trace for benchmarks
+ * Traffic going through SioCom can be recorded to SIO trace file (SioTraceWriter)
  */
 
 class SioCom
@@ -22,7 +27,8 @@ public:
     enum sio_mode
     {
         SERIAL = 0,
-        NETSIO
+        NETSIO,
+        LOOPBACK
     };
 
 private:
@@ -30,6 +36,9 @@ private:
     SioPort *_sioPort;
     SerialSioPort _serialSio;
     NetSioPort _netSio;
+    LoopbackSioPort _loopbackSio;
+    SioTraceWriter _recorder;
+    std::vector<uint8_t> _txframe; // complete response being sent
 
     size_t _print_number(unsigned long n, uint8_t base);
 
@@ -38,6 +47,7 @@ public:
     void begin(int baud = 0);
     void end();
     bool poll(int ms);
+    void prepare_wait();
 
     void set_baudrate(uint32_t baud);
     uint32_t get_baudrate();
@@ -64,6 +74,10 @@ public:
     ssize_t write(const uint8_t *buffer, size_t size);
     // write C-string
     ssize_t write(const char *str);
+    // write complete response: status byte, data frame and checksum at once
+    ssize_t write_response(uint8_t status, const uint8_t *buffer, size_t size, uint8_t checksum);
+    // allocate command path buffers in advance (real-time profile)
+    void preallocate();
 
     // print utility functions
     size_t print(const char *str);
@@ -84,6 +98,15 @@ public:
     void netsio_empty_sync();
     void netsio_write_size(int write_size);
 
+    // SIO trace recording
+    bool start_recording(const char *path) { return _recorder.open(path); }
+    void stop_recording() { _recorder.close(); }
+
+    // replay SIO trace through loopback port
+    bool start_replay(const char *path);
+    bool replay_finished() { return _loopbackSio.finished(); }
+    bool replay_report() { return _loopbackSio.report(); }
+
     // get/set SIO mode
     sio_mode get_sio_mode() {return _sio_mode;}
     void set_sio_mode(sio_mode mode);
@@ -0,0 +1,250 @@
+#ifdef BUILD_ATARI
+
+#include "loopbacksio.h"
+
+#include <algorithm>
+
+#include "../../include/debug.h"
+
+#include "fnSystem.h"
+#include "fnEventLoop.h"
+
+
+bool LoopbackSioPort::load(const char *path)
+{
+    if (!siotrace_load(path, _events))
+        return false;
+
+    // count output recorded before every event, computer waits for it before it continues
+    _tx_before.clear();
+    _tx_expected.clear();
+    for (const siotrace_event &ev : _events)
+    {
+        _tx_before.push_back(_tx_expected.size());
+        if (ev.type == SIOTRACE_TX)
+            _tx_expected.insert(_tx_expected.end(), ev.data.begin(), ev.data.end());
+    }
+    _tx_before.push_back(_tx_expected.size());
+
+    _next = 0;
+    _rx.clear();
+    _cmd = false;
+    _tx_count = 0;
+    _stall_since = 0;
+    _cmd_active = false;
+    _latency.clear();
+    _commands = _ignored = _unanswered = _stalls = 0;
+    _tx_mismatch = 0;
+    _start_us = _end_us = 0;
+
+    Debug_printf("Loaded SIO trace \"%s\", %u events\n", path, (unsigned)_events.size());
+    return true;
+}
+
+// Is FujiNet's output recorded before next event sent? Gives up after LOOPBACK_STALL_MS or if forced.
+bool LoopbackSioPort::_wait_output(uint64_t now, bool force)
+{
+    if (_tx_count >= _tx_before[_next])
+    {
+        _stall_since = 0;
+        return true;
+    }
+    if (_stall_since == 0)
+        _stall_since = now;
+    if (!force && now - _stall_since < LOOPBACK_STALL_MS * 1000ULL)
+        return false;
+
+    Debug_printf("Replay: missing %u bytes of FujiNet output, continuing\n",
+                 (unsigned)(_tx_before[_next] - _tx_count));
+    _stalls++;
+    _tx_count = _tx_before[_next];
+    _stall_since = 0;
+    return true;
+}
+
+void LoopbackSioPort::_command_done(uint64_t now)
+{
+    uint16_t key = _cmd_frame_len == 2 ? (_cmd_frame[0] << 8) | _cmd_frame[1] : 0xffff;
+    std::unique_ptr<fnHistogram> &h = _latency[key];
+    if (h == nullptr)
+        h.reset(new fnHistogram);
+    h->record(now - _cmd_start);
+    _cmd_active = false;
+    _stall_since = 0;
+}
+
+// Play computer's events which are due
+void LoopbackSioPort::_advance(bool force)
+{
+    uint64_t now = fnSystem.micros();
+    if (_start_us == 0)
+        _start_us = now;
+
+    while (_next < _events.size())
+    {
+        siotrace_event &ev = _events[_next];
+        if (ev.type == SIOTRACE_TX || ev.type == SIOTRACE_BAUD)
+        {
+            // FujiNet's side, baud rate follows FujiNet's own HSIO handling
+            _next++;
+            continue;
+        }
+        if (!_wait_output(now, force))
+            return;
+        force = false;
+
+        // computer does not touch command line until FujiNet has read the bytes sent before
+        if ((ev.type == SIOTRACE_CMD_ON || ev.type == SIOTRACE_CMD_OFF) && !_rx.empty())
+            return;
+
+        switch (ev.type)
+        {
+        case SIOTRACE_CMD_ON:
+        {
+            if (_cmd_active)
+            {
+                _unanswered++;
+                _cmd_active = false;
+            }
+            _cmd = true;
+            _commands++;
+            _cmd_start = now;
+            _cmd_frame_len = 0;
+            // response is all output recorded up to next command
+            size_t i = _next + 1;
+            while (i < _events.size() && _events[i].type != SIOTRACE_CMD_ON)
+                i++;
+            _cmd_tx_target = _tx_before[i];
+            if (_cmd_tx_target == _tx_before[_next])
+                _ignored++; // not for FujiNet
+            else
+                _cmd_active = true;
+            break;
+        }
+        case SIOTRACE_CMD_OFF:
+            _cmd = false;
+            break;
+        case SIOTRACE_RX:
+            for (uint8_t b : ev.data)
+            {
+                if (_cmd && _cmd_frame_len < 2)
+                    _cmd_frame[_cmd_frame_len++] = b;
+                _rx.push_back(b);
+            }
+            break;
+        default:
+            break;
+        }
+        _end_us = now;
+        _next++;
+
+        // let FujiNet see the released command line before the next command comes
+        if (ev.type == SIOTRACE_CMD_OFF)
+            return;
+    }
+
+    // all played, wait for response to the last command
+    if (_cmd_active)
+    {
+        if (_stall_since == 0)
+            _stall_since = now;
+        else if (now - _stall_since >= LOOPBACK_STALL_MS * 1000ULL)
+        {
+            _unanswered++;
+            _cmd_active = false;
+            _stall_since = 0;
+        }
+    }
+}
+
+bool LoopbackSioPort::finished()
+{
+    return _next >= _events.size() && !_cmd_active;
+}
+
+bool LoopbackSioPort::poll(int ms)
+{
+    _advance(false);
+    return !finished();
+}
+
+void LoopbackSioPort::prepare_wait()
+{
+    if (finished())
+        return;
+    if (_stall_since != 0)
+        eventLoop.add_deadline(_stall_since / 1000 + LOOPBACK_STALL_MS); // FujiNet is busy, wake up to give up
+    else
+        eventLoop.add_timeout(0); // next event can be played
+}
+
+bool LoopbackSioPort::command_asserted()
+{
+    _advance(false);
+    return _cmd;
+}
+
+int LoopbackSioPort::available()
+{
+    _advance(false);
+    return _rx.size();
+}
+
+int LoopbackSioPort::read()
+{
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+size_t LoopbackSioPort::read(uint8_t *buffer, size_t length, bool command_mode)
+{
+    _advance(false);
+    // FujiNet reads without sending what the computer waits for, don't let it wait in vain
+    if (_rx.size() < length)
+        _advance(true);
+
+    size_t n = std::min(length, _rx.size());
+    for (size_t i = 0; i < n; i++)
+    {
+        buffer[i] = _rx.front();
+        _rx.pop_front();
+    }
+    return n;
+}
+
+ssize_t LoopbackSioPort::write(const uint8_t *buffer, size_t size)
+{
+    uint64_t now = fnSystem.micros();
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if (_tx_count >= _tx_expected.size() || _tx_expected[_tx_count] != buffer[i])
+            _tx_mismatch++;
+        _tx_count++;
+    }
+    _end_us = now;
+
+    if (_cmd_active && _tx_count >= _cmd_tx_target)
+        _command_done(now);
+    return size;
+}
+
+bool LoopbackSioPort::report()
+{
+    printf("SIO replay: %u commands (%u not for FujiNet, %u unanswered), %u stalls, %llu output bytes differ\n",
+           _commands, _ignored, _unanswered, _stalls, (unsigned long long)_tx_mismatch);
+    printf("Wall time: %.3f ms\n", (_end_us - _start_us) / 1000.0);
+    printf("dev cmd    count     avg ms     p50 ms     p99 ms     max ms\n");
+    for (auto &l : _latency)
+    {
+        fnHistogram *h = l.second.get();
+        printf(" %02x  %02x %8llu %10.3f %10.3f %10.3f %10.3f\n",
+               l.first >> 8, l.first & 0xff, (unsigned long long)h->count(),
+               h->sum() / 1000.0 / h->count(), h->quantile(0.5) / 1000.0,
+               h->quantile(0.99) / 1000.0, h->quantile(1.0) / 1000.0);
+    }
+    fflush(stdout);
+    return _unanswered == 0 && _stalls == 0 && _tx_mismatch == 0;
+}
+
+#endif /* BUILD_ATARI */
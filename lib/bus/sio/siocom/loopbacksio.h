@@ -0,0 +1,90 @@
+#ifndef LOOPBACKSIO_H
+#define LOOPBACKSIO_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "sioport.h"
+#include "siotrace.h"
+#include "fnMetrics.h"
+
+#define LOOPBACK_STALL_MS 2000  // give up waiting for response recorded in the trace after this time
+
+/*
+ * Implementation of SIO Port replaying recorded SIO trace
+ * Plays the computer's side of the trace (command line, command and data frames) back to
+ * FujiNet. Like the real computer, next command is sent once FujiNet has sent as many bytes
+ * as were recorded before it, so the replay runs as fast as FujiNet can respond.
+ * Output is compared with the recording and command latency is measured for the report.
+ */
+
+class LoopbackSioPort : public SioPort
+{
+private:
+    std::vector<siotrace_event> _events;
+    std::vector<uint64_t> _tx_before;   // recorded output bytes before each event
+    std::vector<uint8_t> _tx_expected;  // all recorded output
+    size_t _next = 0;                   // next event to play
+
+    std::deque<uint8_t> _rx;            // played bytes waiting for FujiNet to read them
+    bool _cmd = false;
+    uint32_t _baud = SIOPORT_DEFAULT_BAUD;
+    uint64_t _tx_count = 0;             // bytes sent by FujiNet
+    uint64_t _stall_since = 0;          // waiting for FujiNet output since, 0 = not waiting
+
+    // command in progress
+    bool _cmd_active = false;
+    uint64_t _cmd_start = 0;
+    uint64_t _cmd_tx_target = 0;        // output bytes count when command is answered
+    uint8_t _cmd_frame[2];              // device and command bytes
+    int _cmd_frame_len = 0;
+
+    // results
+    std::map<uint16_t, std::unique_ptr<fnHistogram>> _latency;
+    unsigned int _commands = 0;
+    unsigned int _ignored = 0;          // commands with no recorded response
+    unsigned int _unanswered = 0;
+    unsigned int _stalls = 0;
+    uint64_t _tx_mismatch = 0;
+    uint64_t _start_us = 0;
+    uint64_t _end_us = 0;
+
+    void _advance(bool force);
+    bool _wait_output(uint64_t now, bool force);
+    void _command_done(uint64_t now);
+
+public:
+    // load trace to replay, false on error
+    bool load(const char *path);
+    // all events were played and last command is answered (or given up)
+    bool finished();
+    // print replay statistics to stdout, true if FujiNet's output matched the recording
+    bool report();
+
+    virtual void begin(int baud) override { _baud = baud; }
+    virtual void end() override {}
+    virtual bool poll(int ms) override;
+    virtual void prepare_wait() override;
+
+    virtual void set_baudrate(uint32_t baud) override { _baud = baud; }
+    virtual uint32_t get_baudrate() override { return _baud; }
+
+    virtual bool command_asserted() override;
+    virtual bool motor_asserted() override { return false; }
+    virtual void set_proceed(bool level) override {}
+    virtual void set_interrupt(bool level) override {}
+
+    virtual int available() override;
+    virtual void flush() override {}
+    virtual void flush_input() override { _rx.clear(); }
+
+    virtual int read() override;
+    virtual size_t read(uint8_t *buffer, size_t length, bool command_mode=false) override;
+
+    virtual ssize_t write(uint8_t b) override { return write(&b, 1); }
+    virtual ssize_t write(const uint8_t *buffer, size_t size) override;
+};
+
+#endif // LOOPBACKSIO_H
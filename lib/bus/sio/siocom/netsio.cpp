@@ -11,10 +11,18 @@
 #include <unistd.h> // write(), read(), close()
 #include <errno.h> // Error integer and strerror() function
 #include <fcntl.h> // Contains file controls like O_RDWR
+#include <algorithm>
+#if !defined(_WIN32)
+#include <sys/un.h>
+#include <netinet/tcp.h>
+#endif
 
 #include "../../include/debug.h"
 
 #include "fnSystem.h"
+#include "fnEventLoop.h"
+#include "fnTrace.h"
+#include "fnMetrics.h"
 #include "fnWiFi.h"
 
 
@@ -27,9 +35,26 @@
 #define ALIVE_RATE_MS       1000
 #define ALIVE_TIMEOUT_MS    5000
 
+#define CONNECT_TIMEOUT_MS  1000
+
+/* credit flow control window
+ *  device asks hub for NETSIO_CREDIT_MIN .. NETSIO_CREDIT_MAX credit (messages it may send)
+ *  window grows by one with every credit update received in time and halves when hub does
+ *  not answer credit request within NETSIO_CREDIT_STALL_MS
+ *  credit is asked for when half of the window is used, before writes have to block
+ */
+#define NETSIO_CREDIT_MIN       3
+#define NETSIO_CREDIT_MAX       32
+#define NETSIO_CREDIT_STALL_MS  500
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
 // Constructor
 NetSioPort::NetSioPort() :
     _host{0},
+    _transport(NETSIO_UDP),
     _ip(IPADDR_NONE),
     _port(NETSIO_PORT),
     _baud(SIOPORT_DEFAULT_BAUD),
@@ -44,7 +69,12 @@ NetSioPort::NetSioPort() :
     _sync_request_num(-1),
     _sync_write_size(-1),
     _errcount(0),
-    _credit(3)
+    _credit(NETSIO_CREDIT_MIN),
+    _credit_window(NETSIO_CREDIT_MIN),
+    _credit_requested(false),
+    _credit_request_us(0),
+    _credit_stalled(false),
+    _stream_len(0)
 {}
 
 NetSioPort::~NetSioPort()
@@ -81,51 +111,15 @@ void NetSioPort::begin(int baud)
 
     suspend_ms = _errcount < 5 ? 1000 : 5000;
     Debug_printf("Setting up NetSIO (%s:%d)\n", _host, _port);
-    _fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
-
-    if (_fd < 0)
+    if (!open_socket())
     {
-        Debug_printf("Failed to create NetSIO socket: %d, \"%s\"\n", 
-            compat_getsockerr(), compat_sockstrerror(compat_getsockerr()));
         _errcount++;
         suspend(suspend_ms);
 		return;
 	}
-    
-    _ip = get_ip4_addr_by_name(_host);
-    if (_ip == IPADDR_NONE)
-    {
-        Debug_println("Failed to resolve NetSIO host name");
-        _errcount++;
-        suspend(suspend_ms);
-		return;
-    }
-
-    // Set remote IP address (no real connection is created for UDP socket)
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_addr.s_addr = _ip;
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(_port);
-    if (connect(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
-    {
-        // should not happen (UDP)
-        Debug_printf("Failed to connect NetSIO socket: %d, \"%s\"\n", 
-            compat_getsockerr(), compat_sockstrerror(compat_getsockerr()));
-        _errcount++;
-        suspend(suspend_ms);
-		return;
-    }
 
-#if defined(_WIN32)
-    unsigned long on = 1;
-    ioctlsocket(_fd, FIONBIO, &on);
-#else
-    fcntl(_fd, F_SETFL, O_NONBLOCK);
-#endif
-
-    // Fast ping hub
-    if (ping(2, 50, 50) < 0)
+    // Fast ping hub, stream connection itself tells the hub is there
+    if (!reliable() && ping(2, 50, 50) < 0)
     {
         _errcount++;
         suspend(suspend_ms);
@@ -134,9 +128,12 @@ void NetSioPort::begin(int baud)
 
     // Connect device
     uint8_t connect = NETSIO_DEVICE_CONNECT;
-    send(_fd, (char *)&connect, 1, 0);
+    send_msg(&connect, 1);
 
     _alive_request = _alive_time = fnSystem.millis();
+    _credit_requested = false;
+    _credit_stalled = false;
+    busMetrics.netsio_credit_window(reliable() ? 0 : _credit_window);
 
     Debug_printf("### NetSIO initialized ###\n");
     // Set initialized.
@@ -150,23 +147,258 @@ void NetSioPort::end()
     if (_fd >= 0)
     {
         uint8_t disconnect = NETSIO_DEVICE_DISCONNECT;
-        send(_fd, (char *)&disconnect, 1, 0);
-        closesocket(_fd);
-        _fd  = -1;
+        send_msg(&disconnect, 1);
+        close_socket();
         fnSystem.delay(50); // wait a while, otherwise wifi may turn off too quickly (during shutdown)
         Debug_printf("### NetSIO stopped ###\n");
     }
     _initialized = false;
 }
 
+/* Create socket for transport given by host name prefix and connect it to the hub */
+bool NetSioPort::open_socket()
+{
+    const char *host = _host;
+    _transport = NETSIO_UDP;
+    if (strncmp(_host, "unix:", 5) == 0)
+    {
+        _transport = NETSIO_UNIX;
+        host = _host + 5;
+    }
+    else if (strncmp(_host, "tcp:", 4) == 0)
+    {
+        _transport = NETSIO_TCP;
+        host = _host + 4;
+    }
+    _stream_len = 0;
+
+    if (_transport == NETSIO_UNIX)
+    {
+#if defined(_WIN32)
+        Debug_println("NetSIO over Unix domain socket is not supported on Windows");
+        return false;
+#else
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strlcpy(addr.sun_path, host, sizeof(addr.sun_path));
+        _fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        if (_fd < 0 || connect(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            Debug_printf("Failed to connect NetSIO socket \"%s\": %d, \"%s\"\n", host,
+                compat_getsockerr(), compat_sockstrerror(compat_getsockerr()));
+            close_socket();
+            return false;
+        }
+        fcntl(_fd, F_SETFL, O_NONBLOCK);
+        return true;
+#endif
+    }
+
+    _ip = get_ip4_addr_by_name(host);
+    if (_ip == IPADDR_NONE)
+    {
+        Debug_println("Failed to resolve NetSIO host name");
+        return false;
+    }
+
+    if (_transport == NETSIO_TCP)
+        _fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    else
+        _fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (_fd < 0)
+    {
+        Debug_printf("Failed to create NetSIO socket: %d, \"%s\"\n", 
+            compat_getsockerr(), compat_sockstrerror(compat_getsockerr()));
+        return false;
+    }
+
+#if defined(_WIN32)
+    unsigned long on = 1;
+    ioctlsocket(_fd, FIONBIO, &on);
+#else
+    fcntl(_fd, F_SETFL, O_NONBLOCK);
+#endif
+
+    if (_transport == NETSIO_TCP)
+    {
+        int flag = 1;
+        setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(flag));
+#if defined(__APPLE__)
+        setsockopt(_fd, SOL_SOCKET, SO_NOSIGPIPE, (char *)&flag, sizeof(flag));
+#endif
+    }
+
+    // Set remote IP address (no real connection is created for UDP socket)
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_addr.s_addr = _ip;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_port);
+    if (connect(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        int err = compat_getsockerr();
+#if defined(_WIN32)
+        bool in_progress = (err == WSAEWOULDBLOCK);
+#else
+        bool in_progress = (err == EINPROGRESS);
+#endif
+        // TCP connection is being established
+        if (in_progress && wait_sock_writable(CONNECT_TIMEOUT_MS))
+        {
+            socklen_t len = (socklen_t)sizeof(err);
+            if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, (char *)&err, &len) < 0)
+                err = compat_getsockerr();
+        }
+        else if (in_progress)
+        {
+#if defined(_WIN32)
+            err = WSAETIMEDOUT;
+#else
+            err = ETIMEDOUT;
+#endif
+        }
+        if (err != 0)
+        {
+            Debug_printf("Failed to connect NetSIO socket: %d, \"%s\"\n", err, compat_sockstrerror(err));
+            close_socket();
+            return false;
+        }
+    }
+    return true;
+}
+
+void NetSioPort::close_socket()
+{
+    if (_fd >= 0)
+        closesocket(_fd);
+    _fd = -1;
+    _stream_len = 0;
+}
+
+/* Send one NetSIO message, returns message length or -1 on error
+   Failed TCP send closes the socket, stream may have partial message already */
+ssize_t NetSioPort::send_msg(const uint8_t *msg, size_t len)
+{
+    if (_transport != NETSIO_TCP)
+        return send(_fd, (char *)msg, len, MSG_NOSIGNAL);
+    if (_fd < 0)
+        return -1;
+
+    // length prefix and message sent at once, to get single TCP segment
+    uint8_t txbuf[2 + 1024];
+    if (len > sizeof(txbuf) - 2)
+        return -1;
+    txbuf[0] = len & 0xff;
+    txbuf[1] = (len >> 8) & 0xff;
+    memcpy(txbuf + 2, msg, len);
+
+    size_t sent = 0;
+    while (sent < len + 2)
+    {
+        ssize_t result = send(_fd, (char *)txbuf + sent, len + 2 - sent, MSG_NOSIGNAL);
+        if (result > 0)
+        {
+            sent += result;
+            continue;
+        }
+
+        // only full send buffer is worth waiting for, select() reports dead
+        // connection (EPIPE, ECONNRESET) as writable and the loop would spin
+        int err = result < 0 ? compat_getsockerr() : 0;
+#if defined(_WIN32)
+        if (err == WSAEINTR)
+            continue;
+        bool would_block = (err == WSAEWOULDBLOCK);
+#else
+        if (err == EINTR)
+            continue;
+        bool would_block = (err == EAGAIN || err == EWOULDBLOCK);
+#endif
+        if (!would_block || !wait_sock_writable(500))
+        {
+            // hub would see garbage after partial message, connect again
+            Debug_printf("NetSIO send failed after %u of %u bytes (%d), closing connection\n",
+                         (unsigned)sent, (unsigned)len + 2, err);
+            close_socket();
+            return -1;
+        }
+    }
+    return len;
+}
+
+/* Is complete message waiting in TCP receive buffer? */
+bool NetSioPort::stream_msg_ready()
+{
+    return _stream_len >= 2 && _stream_len >= 2 + (_stream_rx[0] | (_stream_rx[1] << 8));
+}
+
+/* Receive one NetSIO message (truncated to size), returns length of received part,
+   -1 if nothing is available or 0 if stream connection was closed */
+ssize_t NetSioPort::recv_msg(uint8_t *buf, size_t size)
+{
+    if (_transport != NETSIO_TCP)
+        return recv(_fd, (char *)buf, size, 0);
+    // closed after send error
+    if (_fd < 0)
+        return 0;
+
+    if (!stream_msg_ready())
+    {
+        ssize_t received = recv(_fd, (char *)_stream_rx + _stream_len, sizeof(_stream_rx) - _stream_len, 0);
+        if (received <= 0)
+            return received;
+        _stream_len += received;
+        if (_stream_len >= 2 && 2 + (_stream_rx[0] | (_stream_rx[1] << 8)) > (int)sizeof(_stream_rx))
+        {
+            // message can't be received whole, framing would be lost
+            Debug_println("NetSIO message too long, closing connection");
+            close_socket();
+            return 0;
+        }
+        if (!stream_msg_ready())
+            return -1;
+    }
+
+    int len = _stream_rx[0] | (_stream_rx[1] << 8);
+    size_t copied = std::min((size_t)len, size);
+    memcpy(buf, _stream_rx + 2, copied);
+    _stream_len -= 2 + len;
+    memmove(_stream_rx, _stream_rx + 2 + len, _stream_len);
+    // empty message is not a closed connection
+    return copied > 0 ? (ssize_t)copied : -1;
+}
+
 bool NetSioPort::poll(int ms)
 {
+    // message waiting or socket closed after error, handle_netsio() takes it
+    if (_initialized && (stream_msg_ready() || _fd < 0))
+        return true;
     if (_initialized)
         return wait_sock_readable(ms);
     fnSystem.delay(ms);
     return false;
 }
 
+void NetSioPort::prepare_wait()
+{
+    if (_initialized)
+    {
+        // wake up on incoming message or when it is time to send alive request
+        eventLoop.add_fd(_fd);
+        // closed after send error, reconnect
+        if (stream_msg_ready() || _fd < 0)
+            eventLoop.add_timeout(0);
+        if (!reliable())
+            eventLoop.add_deadline(std::max(_alive_request, _alive_time) + ALIVE_RATE_MS);
+    }
+    else
+    {
+        // wake up to resume
+        eventLoop.add_deadline(_resume_time);
+    }
+}
+
 void NetSioPort::suspend(int ms)
 {
     Debug_printf("Suspending NetSIO for %d ms\n", ms);
@@ -191,15 +423,15 @@ int NetSioPort::ping(int count, int interval_ms, int timeout_ms, bool fast)
         if (wait_sock_writable(timeout_ms))
         {
             ping = NETSIO_PING_REQUEST;
-            result = send(_fd, (char *)&ping, 1, 0);
+            result = send_msg(&ping, 1);
             t1 = fnSystem.micros();
             do 
             {
                 wait_ms = timeout_ms - (fnSystem.micros() - t1) / 1000;
-                if (result == 1 && wait_sock_readable(wait_ms))
+                if (result == 1 && (stream_msg_ready() || wait_sock_readable(wait_ms)))
                 {
                     t2 = fnSystem.micros();
-                    result = recv(_fd, (char *)&ping, 1, 0);
+                    result = recv_msg(&ping, 1);
                     if (result == 1 && ping == NETSIO_PING_RESPONSE) 
                         rtt = (int)(t2 - t1);
                 }
@@ -246,6 +478,46 @@ bool NetSioPort::rxbuffer_put(uint8_t b)
     return false;
 }
 
+/* put block of bytes into buffer, returns true if some older bytes were overwritten */
+bool NetSioPort::rxbuffer_put(const uint8_t *buf, int len)
+{
+    bool overrun = (rxbuffer_available() + len > (int)sizeof(_rxbuf));
+    if (len > (int)sizeof(_rxbuf))
+    {
+        // only the newest bytes fit
+        buf += len - sizeof(_rxbuf);
+        len = sizeof(_rxbuf);
+    }
+
+    int first = std::min(len, (int)sizeof(_rxbuf) - _rxhead);
+    memcpy(_rxbuf + _rxhead, buf, first);
+    memcpy(_rxbuf, buf + first, len - first);
+    _rxhead = (_rxhead + len) % sizeof(_rxbuf);
+
+    if (overrun)
+    {
+        // oldest bytes were overwritten / lost
+        _rxtail = _rxhead;
+        _rxfull = true;
+    }
+    else
+        _rxfull = (len > 0 && _rxhead == _rxtail);
+    return overrun;
+}
+
+/* get up to len bytes from buffer, returns number of bytes */
+int NetSioPort::rxbuffer_get(uint8_t *buf, int len)
+{
+    len = std::min(len, rxbuffer_available());
+    int first = std::min(len, (int)sizeof(_rxbuf) - _rxtail);
+    memcpy(buf, _rxbuf + _rxtail, first);
+    memcpy(buf + first, _rxbuf, len - first);
+    _rxtail = (_rxtail + len) % sizeof(_rxbuf);
+    if (len > 0)
+        _rxfull = false;
+    return len;
+}
+
 int NetSioPort::rxbuffer_get() 
 {
     int b;
@@ -292,6 +564,10 @@ bool NetSioPort::keep_alive()
     ssize_t result;
     uint64_t ms = fnSystem.millis();
 
+    // connection loss is reported by stream socket itself
+    if (reliable())
+        return _initialized;
+
     // if ALIVE_RATE_MS time passed since last alive request was sent
     if (ms - _alive_request >= ALIVE_RATE_MS)
     {
@@ -316,7 +592,7 @@ bool NetSioPort::keep_alive()
         {
             _alive_request = ms;
             uint8_t alive = NETSIO_ALIVE_REQUEST;
-            result = send(_fd, (char *)&alive, 1, 0);
+            result = send_msg(&alive, 1);
             // Debug_printf("Alive %lu %ld\n", ms, result);
         }
     }
@@ -324,7 +600,7 @@ bool NetSioPort::keep_alive()
 }
 
 /* read NetSIO message from socket and update internal variables */
-int NetSioPort::handle_netsio()
+int NetSioPort::handle_netsio(bool *data_msg)
 {
     uint8_t rxbuf[514]; // must be able to hold whole netsio datagram, i.e. >= rxbuffer_len+2 defined in netsio.atdevice
     uint8_t b;
@@ -333,7 +609,15 @@ int NetSioPort::handle_netsio()
     if (!resume_test())
         return 0;
 
-    received = recv(_fd, (char *)rxbuf, sizeof(rxbuf), 0);
+    received = recv_msg(rxbuf, sizeof(rxbuf));
+    if (received == 0 && reliable())
+    {
+        Debug_println("NetSIO connection closed by hub");
+        suspend(1000);
+        return 0;
+    }
+    if (data_msg != nullptr)
+        *data_msg = received > 0 && (rxbuf[0] == NETSIO_DATA_BYTE || rxbuf[0] == NETSIO_DATA_BLOCK);
     if (received > 0)
     {
 #ifdef VERBOSE_SIO
@@ -361,15 +645,17 @@ int NetSioPort::handle_netsio()
             case NETSIO_DATA_BLOCK:
                 if (received >= 2)
                 {
-                    for (int i = 1; i < received-1; i++) // TODO received-1, to test packet SNs
-                    // for (int i = 1; i < received; i++)
+                    // TODO received-2, last byte is to test packet SNs
+                    int len = received - 2;
+                    if (_baud_peer < _baud * 95 / 100 || _baud_peer > _baud * 105 / 100)
                     {
-                        b = rxbuf[i];
-                        if (_baud_peer < _baud * 95 / 100 || _baud_peer > _baud * 105 / 100)
-                            b ^= (uint8_t)_baud_peer ^ (uint8_t)_baud; // corrupt byte
-                        if (rxbuffer_put(b))
-                            Debug_println("NetSIO rxbuffer overrun");
+                        // corrupt bytes
+                        uint8_t x = (uint8_t)_baud_peer ^ (uint8_t)_baud;
+                        for (int i = 1; i <= len; i++)
+                            rxbuf[i] ^= x;
                     }
+                    if (rxbuffer_put(rxbuf + 1, len))
+                        Debug_println("NetSIO rxbuffer overrun");
                 }
                 break;
 
@@ -408,6 +694,14 @@ int NetSioPort::handle_netsio()
 
             case NETSIO_CREDIT_UPDATE:
                 _credit = rxbuf[1];
+                if (_credit_requested && !_credit_stalled && _credit_window < NETSIO_CREDIT_MAX)
+                {
+                    // answered in time, try bigger window
+                    _credit_window++;
+                    busMetrics.netsio_credit_window(_credit_window);
+                }
+                _credit_requested = false;
+                _credit_stalled = false;
                 break;
 
             case NETSIO_COLD_RESET:
@@ -532,7 +826,7 @@ ssize_t NetSioPort::write_sock(const uint8_t *buffer, size_t size, uint32_t time
         return -1;
     }
 
-    ssize_t result = send(_fd, (char *)buffer, size, 0);
+    ssize_t result = send_msg(buffer, size);
     if (result < 0)
     {
         Debug_printf("NetSIO write_sock() send error %d: %s\n", 
@@ -543,36 +837,76 @@ ssize_t NetSioPort::write_sock(const uint8_t *buffer, size_t size, uint32_t time
 
 bool NetSioPort::wait_for_data(uint32_t timeout_ms)
 {
+    if (!rxbuffer_empty())
+        return true;
+
+    fnTraceSpan span("netsio", "wait_data");
     while (rxbuffer_empty())
     {
-        if (!wait_sock_readable(timeout_ms))
+        if (!stream_msg_ready() && !wait_sock_readable(timeout_ms))
             return false;  // timeout
-        handle_netsio();
+        // take all queued data messages which fit into buffer,
+        // stop at other message to keep its effect (e.g. input flush) in order
+        bool data_msg;
+        while (handle_netsio(&data_msg) > 0 && data_msg &&
+               sizeof(_rxbuf) - rxbuffer_available() >= NETSIO_MAX_DATA_BLOCK)
+            ;
         // TODO adjust timeout_ms
     }
     // data available for read
     return true;
 }
 
-bool NetSioPort::wait_for_credit(int needed)
+/* inform HUB about our credit and the window we would like to have */
+void NetSioPort::request_credit()
 {
-    uint8_t txbuf[2];
+    uint8_t txbuf[3];
     txbuf[0] = NETSIO_CREDIT_STATUS;
     txbuf[1] = (uint8_t)_credit;
+    txbuf[2] = (uint8_t)_credit_window;
+    send_msg(txbuf, sizeof(txbuf));
+    _credit_requested = true;
+    _credit_request_us = fnSystem.micros();
+}
+
+bool NetSioPort::wait_for_credit(int needed)
+{
+    // hub can't lose messages, no flow control
+    if (reliable())
+        return _initialized;
 
     // wait for credit
-    while (needed > _credit)
-    {
-        if (!_initialized) 
-            return false; // disconnected
-        // inform HUB we need more credit
-        send(_fd, (char *)txbuf, sizeof(txbuf), 0);
-        //Debug_printf("waiting for credit %d\n", _credit);
-        wait_sock_readable(500);
-        handle_netsio();
+    if (needed > _credit)
+    {
+        fnTraceSpan span("netsio", "wait_credit");
+        uint64_t wait_start = fnSystem.micros();
+        bool stalled = false;
+        while (needed > _credit)
+        {
+            if (!_initialized) 
+                return false; // disconnected
+            uint64_t now = fnSystem.micros();
+            if (_credit_requested && now - _credit_request_us >= NETSIO_CREDIT_STALL_MS * 1000)
+            {
+                // request or update was lost or hub is overloaded, back off
+                _credit_stalled = stalled = true;
+                _credit_window = std::max(NETSIO_CREDIT_MIN, _credit_window / 2);
+                busMetrics.netsio_credit_window(_credit_window);
+                _credit_requested = false;
+            }
+            if (!_credit_requested)
+                request_credit();
+            //Debug_printf("waiting for credit %d\n", _credit);
+            wait_sock_readable(NETSIO_CREDIT_STALL_MS);
+            handle_netsio();
+        }
+        busMetrics.netsio_credit_wait(fnSystem.micros() - wait_start, stalled);
     }
     // consume credit
     _credit -= needed;
+    // ask for more before we run out
+    if (!_credit_requested && _credit < _credit_window / 2)
+        request_credit();
     //Debug_printf("credit %d\n", _credit);
     return true;
 }
@@ -621,7 +955,7 @@ void NetSioPort::set_baudrate(uint32_t baud)
     txbuf[2] = (baud >> 8) & 0xff;
     txbuf[3] = (baud >> 16) & 0xff;
     txbuf[4] = (baud >> 24) & 0xff;
-    send(_fd, (char *)txbuf, sizeof(txbuf), 0);
+    send_msg(txbuf, sizeof(txbuf));
     _baud = baud;
 }
 
@@ -711,26 +1045,15 @@ size_t NetSioPort::read(uint8_t *buffer, size_t length, bool command_mode)
         // 850 us pre-ACK delay will be added by netsio.atdevice
     }
 
-    int result;
     int rxbytes;
     for (rxbytes=0; rxbytes<length;)
     {
-        result = read();
-        // Debug_printf("read: %d\n", result);
-        if (result < 0)
-        {
-            break;
-        }
-        else
+        if (!wait_for_data(500))
         {
-            buffer[rxbytes++] = (uint8_t)result;
-        }
-
-        if (rxbytes == length)
-        {
-            // done
+            Debug_println("NetSIO read() - TIMEOUT");
             break;
         }
+        rxbytes += rxbuffer_get(buffer + rxbytes, length - rxbytes);
 
         // // wait for more data
         // if (command_mode && !command_asserted())
@@ -792,6 +1115,14 @@ ssize_t NetSioPort::write(const uint8_t *buffer, size_t size)
     if (!_initialized)
         return 0;
 
+    if (_sync_request_num >= 0 && size > 0)
+    {
+        // pending sync request, first byte goes with sync response
+        if (write(buffer[0]) != 1)
+            return 0;
+        txbytes = 1;
+    }
+
     while (txbytes < size)
     {
         // send block
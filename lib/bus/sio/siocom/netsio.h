@@ -7,8 +7,18 @@
 
 class NetSioPort : public SioPort
 {
+public:
+    // how messages are carried to/from the hub, selected by host name prefix
+    enum netsio_transport
+    {
+        NETSIO_UDP = 0,     // "host", datagrams, with credit flow control and alive checks
+        NETSIO_UNIX,        // "unix:/path", AF_UNIX SOCK_SEQPACKET
+        NETSIO_TCP          // "tcp:host", messages prefixed with 16-bit length (LSB first)
+    };
+
 private:
     char _host[64];
+    netsio_transport _transport;
     in_addr_t _ip;
     uint16_t _port;
 
@@ -35,25 +45,43 @@ private:
     uint64_t _alive_request; // when last ALIVE request was sent
     // flow control
     int _credit;
+    int _credit_window;          // credit we ask hub for, adapts to link
+    bool _credit_requested;      // credit status sent, waiting for update
+    uint64_t _credit_request_us; // when credit status was sent
+    bool _credit_stalled;        // last request was not answered in time
+    // messages received over TCP, not read yet
+    uint8_t _stream_rx[2048];
+    int _stream_len;
 
 protected:
+    bool open_socket();
+    void close_socket();
+    // reliable ordered transport, no need for credit and alive messages
+    bool reliable() { return _transport != NETSIO_UDP; }
+    ssize_t send_msg(const uint8_t *msg, size_t len);
+    ssize_t recv_msg(uint8_t *buf, size_t size);
+    bool stream_msg_ready();
+
     void suspend(int ms=5000);
     bool resume_test();
     bool keep_alive();
 
-    int handle_netsio();
+    int handle_netsio(bool *data_msg=nullptr);
     static timeval timeval_from_ms(const uint32_t millis);
 
     bool wait_sock_readable(uint32_t timeout_ms);
     bool wait_for_data(uint32_t timeout_ms);
     bool wait_for_credit(int needed);
+    void request_credit();
 
     bool wait_sock_writable(uint32_t timeout_ms);
     ssize_t write_sock(const uint8_t *buffer, size_t size, uint32_t timeout_ms=500);
 
     bool rxbuffer_empty();
     bool rxbuffer_put(uint8_t b);
+    bool rxbuffer_put(const uint8_t *buf, int len);
     int rxbuffer_get();
+    int rxbuffer_get(uint8_t *buf, int len);
     int rxbuffer_available();
     void rxbuffer_flush();
 
@@ -63,6 +91,7 @@ public:
     virtual void begin(int baud) override;
     virtual void end() override;
     virtual bool poll(int ms) override;
+    virtual void prepare_wait() override;
 
     virtual void set_baudrate(uint32_t baud) override;
     virtual uint32_t get_baudrate() override;
@@ -28,8 +28,8 @@
 #define NETSIO_PING_RESPONSE    0xC3
 #define NETSIO_ALIVE_REQUEST    0xC4
 #define NETSIO_ALIVE_RESPONSE   0xC5
-#define NETSIO_CREDIT_STATUS    0xC6
-#define NETSIO_CREDIT_UPDATE    0xC7
+#define NETSIO_CREDIT_STATUS    0xC6 // current credit, desired credit window
+#define NETSIO_CREDIT_UPDATE    0xC7 // new credit
 
 #define NETSIO_WARM_RESET       0xFE
 #define NETSIO_COLD_RESET       0xFF
@@ -40,4 +40,6 @@
 
 #define NETSIO_PORT             9997
 
+#define NETSIO_MAX_DATA_BLOCK   512 // max data bytes in NETSIO_DATA_BLOCK message
+
 #endif // NETSIO_PROTO_H
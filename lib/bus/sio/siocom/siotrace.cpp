@@ -0,0 +1,175 @@
+#ifdef BUILD_ATARI
+
+#include "siotrace.h"
+
+#include <string.h>
+
+#include "../../include/debug.h"
+
+#include "fnSystem.h"
+
+
+bool SioTraceWriter::open(const char *path)
+{
+    close();
+    _f = fopen(path, "wb");
+    if (_f == nullptr)
+    {
+        Debug_printf("Failed to create SIO trace file \"%s\"\n", path);
+        return false;
+    }
+    fwrite(SIOTRACE_MAGIC, 1, SIOTRACE_MAGIC_LEN, _f);
+    _last_us = fnSystem.micros();
+    _cmd = false;
+    Debug_printf("Recording SIO trace to \"%s\"\n", path);
+    return true;
+}
+
+void SioTraceWriter::close()
+{
+    if (_f != nullptr)
+    {
+        fclose(_f);
+        _f = nullptr;
+        Debug_println("SIO trace recording stopped");
+    }
+}
+
+void SioTraceWriter::_put_varint(uint64_t v)
+{
+    uint8_t buf[10];
+    int n = 0;
+    do
+    {
+        buf[n] = v & 0x7f;
+        v >>= 7;
+        if (v)
+            buf[n] |= 0x80;
+        n++;
+    } while (v);
+    fwrite(buf, 1, n, _f);
+}
+
+void SioTraceWriter::_put_header(siotrace_event_type type)
+{
+    uint64_t now = fnSystem.micros();
+    fputc(type, _f);
+    _put_varint(now - _last_us);
+    _last_us = now;
+}
+
+// called on every command line poll, only changes are recorded
+void SioTraceWriter::command(bool asserted)
+{
+    if (asserted == _cmd)
+        return;
+    _cmd = asserted;
+    _put_header(asserted ? SIOTRACE_CMD_ON : SIOTRACE_CMD_OFF);
+}
+
+void SioTraceWriter::rx(const uint8_t *buf, size_t len)
+{
+    if (len == 0)
+        return;
+    _put_header(SIOTRACE_RX);
+    _put_varint(len);
+    fwrite(buf, 1, len, _f);
+}
+
+void SioTraceWriter::tx(const uint8_t *buf, size_t len)
+{
+    if (len == 0)
+        return;
+    _put_header(SIOTRACE_TX);
+    _put_varint(len);
+    fwrite(buf, 1, len, _f);
+}
+
+void SioTraceWriter::baud(uint32_t baud)
+{
+    _put_header(SIOTRACE_BAUD);
+    _put_varint(baud);
+}
+
+
+static bool _get_varint(FILE *f, uint64_t &v)
+{
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = fgetc(f);
+        if (c == EOF)
+            return false;
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool siotrace_load(const char *path, std::vector<siotrace_event> &events)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr)
+    {
+        Debug_printf("Failed to open SIO trace file \"%s\"\n", path);
+        return false;
+    }
+
+    char magic[SIOTRACE_MAGIC_LEN];
+    if (fread(magic, 1, SIOTRACE_MAGIC_LEN, f) != SIOTRACE_MAGIC_LEN ||
+        memcmp(magic, SIOTRACE_MAGIC, SIOTRACE_MAGIC_LEN) != 0)
+    {
+        Debug_printf("\"%s\" is not a SIO trace file\n", path);
+        fclose(f);
+        return false;
+    }
+
+    events.clear();
+    int type;
+    bool ok = true;
+    while ((type = fgetc(f)) != EOF)
+    {
+        siotrace_event ev;
+        ev.type = (siotrace_event_type)type;
+        ev.baud = 0;
+        uint64_t v;
+        if (!_get_varint(f, ev.dt_us))
+        {
+            ok = false;
+            break;
+        }
+        switch (ev.type)
+        {
+        case SIOTRACE_CMD_ON:
+        case SIOTRACE_CMD_OFF:
+            break;
+        case SIOTRACE_RX:
+        case SIOTRACE_TX:
+            if (!_get_varint(f, v) || v > 65536)
+            {
+                ok = false;
+                break;
+            }
+            ev.data.resize(v);
+            ok = fread(ev.data.data(), 1, v, f) == v;
+            break;
+        case SIOTRACE_BAUD:
+            ok = _get_varint(f, v);
+            ev.baud = (uint32_t)v;
+            break;
+        default:
+            ok = false;
+        }
+        if (!ok)
+            break;
+        events.push_back(std::move(ev));
+    }
+    fclose(f);
+
+    if (!ok)
+        Debug_printf("SIO trace \"%s\" is truncated or corrupted, using %u events\n", path, (unsigned)events.size());
+    return true;
+}
+
+#endif /* BUILD_ATARI */
@@ -0,0 +1,65 @@
+#ifndef SIOTRACE_H
+#define SIOTRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/*
+ * Binary trace of SIO traffic, as seen by SioCom
+ *
+ * File starts with SIOTRACE_MAGIC followed by records:
+ *   type (1 byte), time since previous record in us (varint), payload
+ * Payload of RX/TX records is length (varint) and data bytes, BAUD record
+ * has baud rate (varint), CMD_ON/CMD_OFF have no payload.
+ * Varints are 7 bits per byte, least significant first, high bit = more bytes follow.
+ */
+
+#define SIOTRACE_MAGIC "FNSIOTR1"
+#define SIOTRACE_MAGIC_LEN 8
+
+enum siotrace_event_type : uint8_t
+{
+    SIOTRACE_CMD_ON = 1,    // command line asserted
+    SIOTRACE_CMD_OFF,       // command line released
+    SIOTRACE_RX,            // bytes received from computer
+    SIOTRACE_TX,            // bytes sent to computer
+    SIOTRACE_BAUD           // baud rate changed
+};
+
+struct siotrace_event
+{
+    siotrace_event_type type;
+    uint64_t dt_us;             // time since previous event
+    uint32_t baud;              // SIOTRACE_BAUD
+    std::vector<uint8_t> data;  // SIOTRACE_RX, SIOTRACE_TX
+};
+
+// Records SIO traffic into trace file
+class SioTraceWriter
+{
+private:
+    FILE *_f = nullptr;
+    uint64_t _last_us = 0;
+    bool _cmd = false;          // last recorded command line state
+
+    void _put_varint(uint64_t v);
+    void _put_header(siotrace_event_type type);
+
+public:
+    ~SioTraceWriter() { close(); }
+
+    bool open(const char *path);
+    void close();
+    bool active() { return _f != nullptr; }
+
+    void command(bool asserted);
+    void rx(const uint8_t *buf, size_t len);
+    void tx(const uint8_t *buf, size_t len);
+    void baud(uint32_t baud);
+};
+
+// Loads trace file into memory, returns false if file can't be read or is not a SIO trace
+bool siotrace_load(const char *path, std::vector<siotrace_event> &events);
+
+#endif // SIOTRACE_H
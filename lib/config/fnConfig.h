@@ -32,6 +32,12 @@
 
 #define CONFIG_DEFAULT_SNTPSERVER "pool.ntp.org"
 
+#define CONFIG_DEFAULT_DEADLINE_MARGIN 500 // ms before computer's timeout to send timed ERROR
+
+#define CONFIG_DEFAULT_DISKCACHE_FLUSH_DELAY 1000 // ms written sectors may wait in memory
+#define CONFIG_DEFAULT_DISKCACHE_BLOCK_CACHE 2048 // KiB shared by images on network hosts
+#define CONFIG_DEFAULT_DISKCACHE_PREFETCH 1024 // KiB, images up to this size are copied whole in background
+
 #define PHONEBOOK_CHAR_WIDTH 12
 
 
@@ -84,10 +90,21 @@ public:
     // typedef serial_proceed_pin serial_proceed_pin_t;
     serial_proceed_pin serial_proceed_from_string(const char *str);
 
+    // what to do when backend does not finish SIO command in time
+    enum deadline_policy
+    {
+        DEADLINE_WAIT = 0,  // keep waiting, computer may time out (138)
+        DEADLINE_ERROR,     // send ERROR before computer times out
+        DEADLINE_RETRY,     // send ERROR, give late result to computer's retry of the same command
+        DEADLINE_INVALID
+    };
+    deadline_policy deadline_policy_from_string(const char *str);
+
     // GENERAL
     std::string get_general_devicename() { return _general.devicename; };
     std::string get_general_label();
     int get_general_hsioindex() { return _general.hsio_index; };
+    bool get_general_hsio_auto() { return _general.hsio_auto; };
     std::string get_general_timezone() { return _general.timezone; };
     bool get_general_rotation_sounds() { return _general.rotation_sounds; };
     std::string get_network_udpstream_host() { return _network.udpstream_host; };
@@ -95,6 +112,7 @@ public:
     bool get_general_config_enabled() { return _general.config_enabled; };
     void store_general_devicename(const char *devicename);
     void store_general_hsioindex(int hsio_index);
+    void store_general_hsio_auto(bool hsio_auto);
     void store_general_timezone(const char *timezone);
     void store_general_rotation_sounds(bool rotation_sounds);
     void store_general_config_enabled(bool config_enabled);
@@ -108,6 +126,16 @@ public:
     void store_general_status_wait_enabled(bool status_wait_enabled);
     void store_general_encrypt_passphrase(bool encrypt_passphrase);
     bool get_general_encrypt_passphrase();
+    std::string get_general_log_level() { return _general.log_level; }
+    std::string get_general_log_filter() { return _general.log_filter; }
+    void store_general_log_level(const char *log_level);
+    void store_general_log_filter(const char *log_filter);
+    bool get_general_trace_enabled() { return _general.trace_enabled; }
+    void store_general_trace_enabled(bool trace_enabled);
+    bool get_general_realtime_enabled() { return _general.realtime_enabled; }
+    void store_general_realtime_enabled(bool realtime_enabled);
+    int get_general_realtime_cpu() { return _general.realtime_cpu; }
+    void store_general_realtime_cpu(int realtime_cpu);
     std::string get_general_interface_url() { return _general.interface_url; };
     void store_general_interface_url(const char *url);
     std::string get_general_config_path() { return _general.config_file_path; };
@@ -240,6 +268,28 @@ public:
     void store_netsio_host(const char *host);
     void store_netsio_port(int port);
 
+    // SIO COMMAND DEADLINES
+    deadline_policy get_deadline_disk() { return _deadline.disk; }
+    deadline_policy get_deadline_network() { return _deadline.network; }
+    int get_deadline_margin() { return _deadline.margin; }
+    void store_deadline_disk(deadline_policy policy);
+    void store_deadline_network(deadline_policy policy);
+    void store_deadline_margin(int margin);
+
+    // DISK IMAGE WRITE CACHE
+    bool get_diskcache_write_through() { return _diskcache.write_through; }
+    int get_diskcache_flush_delay() { return _diskcache.flush_delay; }
+    bool get_diskcache_journal() { return _diskcache.journal; }
+    int get_diskcache_block_cache() { return _diskcache.block_cache; }
+    bool get_diskcache_overlay() { return _diskcache.overlay; }
+    int get_diskcache_prefetch() { return _diskcache.prefetch; }
+    void store_diskcache_write_through(bool write_through);
+    void store_diskcache_flush_delay(int delay_ms);
+    void store_diskcache_journal(bool journal);
+    void store_diskcache_block_cache(int size_kb);
+    void store_diskcache_overlay(bool overlay);
+    void store_diskcache_prefetch(int size_kb);
+
     // BUS over IP
     bool get_boip_enabled() { return _boip.boip_enabled; }
     std::string get_boip_host() { return _boip.host; }
@@ -277,6 +327,8 @@ private:
     void _read_section_device_enable(std::stringstream &ss);
     void _read_section_netsio(std::stringstream &ss);
     void _read_section_boip(std::stringstream &ss);
+    void _read_section_deadline(std::stringstream &ss);
+    void _read_section_diskcache(std::stringstream &ss);
 
     enum section_match
     {
@@ -297,6 +349,8 @@ private:
         SECTION_SERIAL,
         SECTION_NETSIO,
         SECTION_BOIP,
+        SECTION_DEADLINE,
+        SECTION_DISKCACHE,
         SECTION_UNKNOWN
     };
     section_match _find_section_in_line(std::string &line, int &index);
@@ -324,6 +378,12 @@ private:
         "RTS"
     };
 
+    const char * _deadline_policy_names[DEADLINE_INVALID] = {
+        "wait",
+        "error",
+        "retry"
+    };
+
     struct host_info
     {
         host_type_t type = HOSTTYPE_INVALID;
@@ -388,6 +448,7 @@ private:
     #else
         int hsio_index = HSIO_DISABLED_INDEX;
     #endif
+        bool hsio_auto = false;             // pick HSIO index from link error rates, see hsiotuner.h
         std::string timezone;
         bool rotation_sounds = true;
         bool config_enabled = true;
@@ -395,6 +456,11 @@ private:
         bool fnconfig_spifs = true;
         bool status_wait_enabled = true;
         bool encrypt_passphrase = false;
+        std::string log_level = "verbose";  // debug log level, see fnLog.h
+        std::string log_filter;             // debug log subsystem filter
+        bool trace_enabled = false;         // collect timeline trace from start, see fnTrace.h
+        bool realtime_enabled = false;      // real-time profile for bus thread, see fnRealtime.h
+        int realtime_cpu = -1;              // pin bus thread to this CPU, -1 = don't pin
     #ifdef BUILD_ADAM
         bool printer_enabled = false; // Not by default.
     #else
@@ -426,6 +492,23 @@ private:
         int port = CONFIG_DEFAULT_BOIP_PORT;
     };
 
+    struct deadline_info
+    {
+        deadline_policy disk = DEADLINE_RETRY;
+        deadline_policy network = DEADLINE_RETRY;
+        int margin = CONFIG_DEFAULT_DEADLINE_MARGIN;
+    };
+
+    struct diskcache_info
+    {
+        bool write_through = false;     // write every sector to images on network hosts immediately (local ones always are)
+        int flush_delay = CONFIG_DEFAULT_DISKCACHE_FLUSH_DELAY;
+        int block_cache = CONFIG_DEFAULT_DISKCACHE_BLOCK_CACHE; // KiB, 0 = disabled
+        bool journal = false;           // keep unflushed sectors in journal file on SD
+        bool overlay = false;           // keep writes to images on network hosts in overlay on SD
+        int prefetch = CONFIG_DEFAULT_DISKCACHE_PREFETCH; // KiB, 0 = disabled
+    };
+
     struct modem_info
     {
         bool modem_enabled = true;
@@ -480,6 +563,8 @@ private:
     serial_info _serial;
     netsio_info _netsio;
     boip_info _boip;
+    deadline_info _deadline;
+    diskcache_info _diskcache;
     cpm_info _cpm;
     device_enable_info _denable;
     phbook_info _phonebook_slots[MAX_PB_SLOTS];
@@ -0,0 +1,74 @@
+#include "fnConfig.h"
+#include <cstring>
+#include "utils.h"
+
+// Saves policy for disk commands which miss their deadline
+void fnConfig::store_deadline_disk(deadline_policy policy)
+{
+    if (policy < 0 || policy >= DEADLINE_INVALID || _deadline.disk == policy)
+        return;
+
+    _deadline.disk = policy;
+    _dirty = true;
+}
+
+// Saves policy for network commands which miss their deadline
+void fnConfig::store_deadline_network(deadline_policy policy)
+{
+    if (policy < 0 || policy >= DEADLINE_INVALID || _deadline.network == policy)
+        return;
+
+    _deadline.network = policy;
+    _dirty = true;
+}
+
+// Saves how many ms before computer's timeout the timed ERROR is sent
+void fnConfig::store_deadline_margin(int margin)
+{
+    if (margin < 0 || _deadline.margin == margin)
+        return;
+
+    _deadline.margin = margin;
+    _dirty = true;
+}
+
+fnConfig::deadline_policy fnConfig::deadline_policy_from_string(const char *str)
+{
+    int i = 0;
+    for (; i < deadline_policy::DEADLINE_INVALID; i++)
+        if (strcasecmp(_deadline_policy_names[i], str) == 0)
+            break;
+    return (deadline_policy)i;
+}
+
+void fnConfig::_read_section_deadline(std::stringstream &ss)
+{
+    std::string line;
+    // Read lines until one starts with '[' which indicates a new section
+    while (_read_line(ss, line, '[') >= 0)
+    {
+        std::string name;
+        std::string value;
+        if (_split_name_value(line, name, value))
+        {
+            if (strcasecmp(name.c_str(), "disk") == 0)
+            {
+                deadline_policy policy = deadline_policy_from_string(value.c_str());
+                if (policy != DEADLINE_INVALID)
+                    _deadline.disk = policy;
+            }
+            else if (strcasecmp(name.c_str(), "network") == 0)
+            {
+                deadline_policy policy = deadline_policy_from_string(value.c_str());
+                if (policy != DEADLINE_INVALID)
+                    _deadline.network = policy;
+            }
+            else if (strcasecmp(name.c_str(), "margin") == 0)
+            {
+                int margin = atoi(value.c_str());
+                if (margin >= 0)
+                    _deadline.margin = margin;
+            }
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#include "fnConfig.h"
+#include <cstring>
+#include "utils.h"
+
+// Saves whether disk image writes go straight to the image (no write-back cache)
+void fnConfig::store_diskcache_write_through(bool write_through)
+{
+    if (_diskcache.write_through == write_through)
+        return;
+
+    _diskcache.write_through = write_through;
+    _dirty = true;
+}
+
+// Saves how long written sectors may stay in memory before they are flushed
+void fnConfig::store_diskcache_flush_delay(int delay_ms)
+{
+    if (delay_ms < 0 || _diskcache.flush_delay == delay_ms)
+        return;
+
+    _diskcache.flush_delay = delay_ms;
+    _dirty = true;
+}
+
+// Saves whether not yet flushed sectors are kept in a local journal
+void fnConfig::store_diskcache_journal(bool journal)
+{
+    if (_diskcache.journal == journal)
+        return;
+
+    _diskcache.journal = journal;
+    _dirty = true;
+}
+
+// Saves memory budget of the block cache shared by mounted images, 0 disables it
+void fnConfig::store_diskcache_block_cache(int size_kb)
+{
+    if (size_kb < 0 || _diskcache.block_cache == size_kb)
+        return;
+
+    _diskcache.block_cache = size_kb;
+    _dirty = true;
+}
+
+// Saves whether writes to images on network hosts go to local copy-on-write overlay
+void fnConfig::store_diskcache_overlay(bool overlay)
+{
+    if (_diskcache.overlay == overlay)
+        return;
+
+    _diskcache.overlay = overlay;
+    _dirty = true;
+}
+
+// Saves size limit of images on network hosts which are prefetched whole at mount, 0 disables it
+void fnConfig::store_diskcache_prefetch(int size_kb)
+{
+    if (size_kb < 0 || _diskcache.prefetch == size_kb)
+        return;
+
+    _diskcache.prefetch = size_kb;
+    _dirty = true;
+}
+
+void fnConfig::_read_section_diskcache(std::stringstream &ss)
+{
+    std::string line;
+    // Read lines until one starts with '[' which indicates a new section
+    while (_read_line(ss, line, '[') >= 0)
+    {
+        std::string name;
+        std::string value;
+        if (_split_name_value(line, name, value))
+        {
+            if (strcasecmp(name.c_str(), "write_through") == 0)
+            {
+                _diskcache.write_through = util_string_value_is_true(value);
+            }
+            else if (strcasecmp(name.c_str(), "flush_delay") == 0)
+            {
+                int delay = atoi(value.c_str());
+                if (delay >= 0)
+                    _diskcache.flush_delay = delay;
+            }
+            else if (strcasecmp(name.c_str(), "journal") == 0)
+            {
+                _diskcache.journal = util_string_value_is_true(value);
+            }
+            else if (strcasecmp(name.c_str(), "block_cache") == 0)
+            {
+                int size = atoi(value.c_str());
+                if (size >= 0)
+                    _diskcache.block_cache = size;
+            }
+            else if (strcasecmp(name.c_str(), "overlay") == 0)
+            {
+                _diskcache.overlay = util_string_value_is_true(value);
+            }
+            else if (strcasecmp(name.c_str(), "prefetch") == 0)
+            {
+                int size = atoi(value.c_str());
+                if (size >= 0)
+                    _diskcache.prefetch = size;
+            }
+        }
+    }
+}
@@ -69,6 +69,51 @@ void fnConfig::store_general_encrypt_passphrase(bool encrypt_passphrase)
     
 }
 
+void fnConfig::store_general_log_level(const char *log_level)
+{
+    if (_general.log_level.compare(log_level) == 0)
+        return;
+
+    _general.log_level = log_level;
+    _dirty = true;
+}
+
+void fnConfig::store_general_log_filter(const char *log_filter)
+{
+    if (_general.log_filter.compare(log_filter) == 0)
+        return;
+
+    _general.log_filter = log_filter;
+    _dirty = true;
+}
+
+void fnConfig::store_general_trace_enabled(bool trace_enabled)
+{
+    if (_general.trace_enabled == trace_enabled)
+        return;
+
+    _general.trace_enabled = trace_enabled;
+    _dirty = true;
+}
+
+void fnConfig::store_general_realtime_enabled(bool realtime_enabled)
+{
+    if (_general.realtime_enabled == realtime_enabled)
+        return;
+
+    _general.realtime_enabled = realtime_enabled;
+    _dirty = true;
+}
+
+void fnConfig::store_general_realtime_cpu(int realtime_cpu)
+{
+    if (_general.realtime_cpu == realtime_cpu)
+        return;
+
+    _general.realtime_cpu = realtime_cpu;
+    _dirty = true;
+}
+
 bool fnConfig::get_general_encrypt_passphrase()
 {
     return _general.encrypt_passphrase;
@@ -93,6 +138,15 @@ void fnConfig::store_general_hsioindex(int hsio_index)
     _dirty = true;
 }
 
+void fnConfig::store_general_hsio_auto(bool hsio_auto)
+{
+    if (_general.hsio_auto == hsio_auto)
+        return;
+
+    _general.hsio_auto = hsio_auto;
+    _dirty = true;
+}
+
 void fnConfig::store_general_fnconfig_spifs(bool fnconfig_spifs)
 {
     if (_general.fnconfig_spifs == fnconfig_spifs)
@@ -171,6 +225,10 @@ void fnConfig::_read_section_general(std::stringstream &ss)
                 if (index >= -1 && index <= 10 || index == 16) // -1(HSIO disabled),0..10,16
                     _general.hsio_index = index;
             }
+            else if (strcasecmp(name.c_str(), "hsio_auto") == 0)
+            {
+                _general.hsio_auto = util_string_value_is_true(value);
+            }
             else if (strcasecmp(name.c_str(), "timezone") == 0)
             {
                 _general.timezone = value;
@@ -204,6 +262,26 @@ void fnConfig::_read_section_general(std::stringstream &ss)
             {
                 _general.encrypt_passphrase = util_string_value_is_true(value);
             }
+            else if (strcasecmp(name.c_str(), "log_level") == 0)
+            {
+                _general.log_level = value;
+            }
+            else if (strcasecmp(name.c_str(), "log_filter") == 0)
+            {
+                _general.log_filter = value;
+            }
+            else if (strcasecmp(name.c_str(), "trace_enabled") == 0)
+            {
+                _general.trace_enabled = util_string_value_is_true(value);
+            }
+            else if (strcasecmp(name.c_str(), "realtime_enabled") == 0)
+            {
+                _general.realtime_enabled = util_string_value_is_true(value);
+            }
+            else if (strcasecmp(name.c_str(), "realtime_cpu") == 0)
+            {
+                _general.realtime_cpu = atoi(value.c_str());
+            }
         }
     }
 }
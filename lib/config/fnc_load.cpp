@@ -115,6 +115,12 @@ void fnConfig::load()
         case SECTION_BOIP:
             _read_section_boip(ss);
             break;
+        case SECTION_DEADLINE:
+            _read_section_deadline(ss);
+            break;
+        case SECTION_DISKCACHE:
+            _read_section_diskcache(ss);
+            break;
         case SECTION_UNKNOWN:
             break;
         }
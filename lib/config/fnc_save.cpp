@@ -31,6 +31,7 @@ void fnConfig::save()
     ss << "[General]" LINETERM;
     ss << "devicename=" << _general.devicename << LINETERM;
     ss << "hsioindex=" << _general.hsio_index << LINETERM;
+    ss << "hsio_auto=" << _general.hsio_auto << LINETERM;
     ss << "rotationsounds=" << _general.rotation_sounds << LINETERM;
     ss << "configenabled=" << _general.config_enabled << LINETERM;
     ss << "boot_mode=" << _general.boot_mode << LINETERM;
@@ -40,6 +41,11 @@ void fnConfig::save()
     ss << "status_wait_enabled=" << _general.status_wait_enabled << LINETERM;
     ss << "printer_enabled=" << _general.printer_enabled << LINETERM;
     ss << "encrypt_passphrase=" << _general.encrypt_passphrase << LINETERM;
+    ss << "log_level=" << _general.log_level << LINETERM;
+    ss << "log_filter=" << _general.log_filter << LINETERM;
+    ss << "trace_enabled=" << _general.trace_enabled << LINETERM;
+    ss << "realtime_enabled=" << _general.realtime_enabled << LINETERM;
+    ss << "realtime_cpu=" << _general.realtime_cpu << LINETERM;
 
     // ss << LINETERM;
 
@@ -176,6 +182,21 @@ void fnConfig::save()
     ss << "host=" << _boip.host << LINETERM;
     ss << "port=" << _boip.port << LINETERM;
 
+    // SIO COMMAND DEADLINES
+    ss << LINETERM << "[Deadline]" << LINETERM;
+    ss << "disk=" << _deadline_policy_names[_deadline.disk] << LINETERM;
+    ss << "network=" << _deadline_policy_names[_deadline.network] << LINETERM;
+    ss << "margin=" << _deadline.margin << LINETERM;
+
+    // DISK IMAGE WRITE CACHE
+    ss << LINETERM << "[DiskCache]" << LINETERM;
+    ss << "write_through=" << _diskcache.write_through << LINETERM;
+    ss << "flush_delay=" << _diskcache.flush_delay << LINETERM;
+    ss << "journal=" << _diskcache.journal << LINETERM;
+    ss << "block_cache=" << _diskcache.block_cache << LINETERM;
+    ss << "overlay=" << _diskcache.overlay << LINETERM;
+    ss << "prefetch=" << _diskcache.prefetch << LINETERM;
+
     // Write the results out
     FILE *fout = fopen(_general.config_file_path.c_str(), FILE_WRITE);
     if (fout == nullptr)
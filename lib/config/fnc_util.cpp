@@ -133,6 +133,14 @@ fnConfig::section_match fnConfig::_find_section_in_line(std::string &line, int &
             {
                 return SECTION_BOIP;
             }
+            else if (strncasecmp("Deadline", s1.c_str(), 8) == 0)
+            {
+                return SECTION_DEADLINE;
+            }
+            else if (strncasecmp("DiskCache", s1.c_str(), 9) == 0)
+            {
+                return SECTION_DISKCACHE;
+            }
         }
     }
     return SECTION_UNKNOWN;
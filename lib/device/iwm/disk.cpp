@@ -2,6 +2,7 @@
 #include "disk.h"
 
 #include "fnSystem.h"
+#include "fnBlockCache.h"
 // #include "fnFsTNFS.h"
 // #include "fnFsSD.h"
 #include "led.h"
@@ -546,13 +547,20 @@ mediatype_t iwmDisk::mount(FileHandler *f, const char *filename, uint32_t disksi
         _disk->_media_host = host;
         _disk->_mediatype = mt;
         strcpy(_disk->_disk_filename, filename);
+        f = blockCache.wrap(f, host, filename, disksize);
+        // writes may stay in local overlay until committed
+        _overlay = FileHandlerOverlay::open(f, host, filename);
+        if (_overlay != nullptr)
+            f = _overlay;
+        _disk->_media_overlay = _overlay != nullptr;
         mt = _disk->mount(f, disksize);
     }
 
     if (mt != MEDIATYPE_UNKNOWN) {
         // firmware needs to believe a high score enabled disk is 
         // not write-protected. Otherwise it will skip write process
-        if (_disk->high_score_enabled)
+        // (same for overlay, the image itself is not written)
+        if (_disk->high_score_enabled || _overlay != nullptr)
           readonly = false;
 
         device_active = true; //change status only after we are mounted
@@ -593,12 +601,32 @@ void iwmDisk::unmount()
         _disk->unmount();
         delete _disk;
         _disk = nullptr;
+        _overlay = nullptr;
         device_active = false;
         readonly = true;
         Debug_printf("Disk UNMOUNTED!!!!\r\n");
     }
 }
 
+// Pending writes go to the overlay first, media must not hold anything read through it
+bool iwmDisk::overlay_commit()
+{
+  if (_overlay == nullptr)
+    return false;
+  bool ok = !_disk->flush();
+  _disk->invalidate();
+  return _overlay->commit() && ok;
+}
+
+void iwmDisk::overlay_discard()
+{
+  if (_overlay == nullptr)
+    return;
+  _disk->flush();
+  _disk->invalidate();
+  _overlay->discard();
+}
+
 bool iwmDisk::write_blank(FileHandler *f, uint16_t sectorSize, uint16_t numSectors)
 {
   
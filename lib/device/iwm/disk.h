@@ -4,6 +4,7 @@
 
 #include "bus.h"
 #include "../media/media.h"
+#include "fnFileOverlay.h"
 
 class iwmDisk : public iwmDevice
 {
@@ -17,6 +18,7 @@ protected:
     void send_extended_status_dib_reply_packet() override;
 
     MediaType *_disk = nullptr;
+    FileHandlerOverlay *_overlay = nullptr; // owned by media, nullptr if writes go to the image
 
     //void iwm_read();
     //void iwm_write(bool verify);
@@ -53,6 +55,12 @@ public:
     void set_disk_number(char c) { disk_num = c; }
     char get_disk_number() { return disk_num; };
     mediatype_t disktype() { return _disk == nullptr ? MEDIATYPE_UNKNOWN : _disk->_mediatype; };
+    // copy-on-write overlay: number of changed blocks, -1 if the image has no overlay
+    int overlay_blocks() { return _overlay == nullptr ? -1 : (int)_overlay->changed_blocks(); }
+    // write changed blocks into the image, false on error
+    bool overlay_commit();
+    // forget changed blocks
+    void overlay_discard();
     // void init();
     ~iwmDisk();
     // virtual void startup_hack();
@@ -8,6 +8,8 @@
 #include "../../include/debug.h"
 
 #include "fuji.h"
+#include "fnConfig.h"
+#include "fnBlockCache.h"
 #include "utils.h"
 
 #define SIO_DISKCMD_FORMAT 0x21
@@ -28,6 +30,9 @@
 #define SIO_DISKCMD_PERCOM_READ 0x4E
 #define SIO_DISKCMD_PERCOM_WRITE 0x4F
 
+#define DRIVE_DEFAULT_TIMEOUT_810 0xE0
+#define DRIVE_DEFAULT_TIMEOUT_XF551 0xFE
+
 // External ref to fuji object.
 extern sioFuji theFuji;
 
@@ -50,12 +55,55 @@ void sioDisk::sio_read()
         return;
     }
 
-    uint16_t readcount;
+    uint16_t sectorNum = UINT16_FROM_HILOBYTES(cmdFrame.aux2, cmdFrame.aux1);
+
+    // Images on network hosts can take long to read, don't let the Atari time out
+    // (unless the sector was already fetched ahead)
+    // Media emulating drive timing sleeps in read(), keep it off the bus thread
+    if (_disk->emulates_timing() ||
+        (host != nullptr && host->get_type() != HOSTTYPE_LOCAL &&
+         Config.get_deadline_disk() != fnConfig::DEADLINE_WAIT && !_disk->cached(sectorNum)))
+    {
+        sio_async(
+            [this, sectorNum]() { return _disk->read(sectorNum, &_read_count) ? 1 : 0; },
+            [this](int err) { bus_to_computer(_disk->_disk_sectorbuff, _read_count, err != 0); },
+            true);
+        return;
+    }
 
-    bool err = _disk->read(UINT16_FROM_HILOBYTES(cmdFrame.aux2, cmdFrame.aux1), &readcount);
+    bool err = _disk->read(sectorNum, &_read_count);
 
     // Send result to Atari
-    bus_to_computer(_disk->_disk_sectorbuff, readcount, err);
+    bus_to_computer(_disk->_disk_sectorbuff, _read_count, err);
+}
+
+// Timed out read, send error with dummy sector
+void sioDisk::sio_timed_error()
+{
+    uint8_t dummySector[DISK_SECTORBUF_SIZE];
+    memset(dummySector, 0, sizeof(dummySector));
+    uint16_t sectorSize = _disk->sector_size(UINT16_FROM_HILOBYTES(cmdFrame.aux2, cmdFrame.aux1));
+    bus_to_computer(dummySector, sectorSize, true);
+}
+
+// Format commands use timeout reported by the drive in status byte #2, others OS default
+int sioDisk::sio_command_timeout()
+{
+    switch (cmdFrame.comnd)
+    {
+    case SIO_DISKCMD_FORMAT:
+    case SIO_DISKCMD_FORMAT_MEDIUM:
+    case SIO_DISKCMD_HSIO_FORMAT:
+    case SIO_DISKCMD_HSIO_FORMAT_MEDIUM:
+        {
+            uint8_t status[4] = {0x00, (uint8_t)~DISK_CTRL_STATUS_CLEAR, DRIVE_DEFAULT_TIMEOUT_810, 0x00};
+            if (_disk != nullptr)
+                _disk->status(status);
+            return status[2];
+        }
+    default:
+        return SIO_TIMEOUT_DEFAULT;
+    }
 }
 
 // Write disk data from computer
@@ -121,9 +169,6 @@ void sioDisk::sio_status()
     */
     // TODO: Why $DF for second byte?
     // TODO: Set bit 4 of drive status and bit 6 of FDC status on read-only disk
-#define DRIVE_DEFAULT_TIMEOUT_810 0xE0
-#define DRIVE_DEFAULT_TIMEOUT_XF551 0xFE
-
     uint8_t _status[4];
     _status[0] = 0x00;
     _status[1] = ~DISK_CTRL_STATUS_CLEAR; // Negation of default clear status
@@ -149,6 +194,18 @@ void sioDisk::sio_format()
         return;
     }
 
+    // Formatting image on network host writes all of it, keep it off the bus thread,
+    // the deadline follows the drive's format timeout (sio_command_timeout)
+    if (host != nullptr && host->get_type() != HOSTTYPE_LOCAL &&
+        Config.get_deadline_disk() != fnConfig::DEADLINE_WAIT)
+    {
+        sio_async(
+            [this]() { return _disk->format(&_read_count) ? 1 : 0; },
+            [this](int err) { bus_to_computer(_disk->_disk_sectorbuff, _read_count, err != 0); },
+            true);
+        return;
+    }
+
     uint16_t responsesize;
     bool err = _disk->format(&responsesize);
 
@@ -210,11 +267,24 @@ mediatype_t sioDisk::mount(FileHandler *f, const char *filename, uint32_t disksi
         delete _disk;
         _disk = nullptr;
     }
+    _overlay = nullptr;
 
     // Determine MediaType based on filename extension
     if (disk_type == MEDIATYPE_UNKNOWN && filename != nullptr)
         disk_type = MediaType::discover_disktype(filename);
 
+    // Images on network hosts are read through shared block cache, cassette reads the file itself
+    // Writes to them may stay in local overlay until committed
+    // Small images are prefetched whole, except XEX and ATX which are read whole at mount anyway
+    if (disk_type != MEDIATYPE_CAS && disk_type != MEDIATYPE_WAV)
+    {
+        bool prefetch = disk_type != MEDIATYPE_XEX && disk_type != MEDIATYPE_ATX;
+        f = blockCache.wrap(f, host, filename, prefetch ? disksize : 0);
+        _overlay = FileHandlerOverlay::open(f, host, filename);
+        if (_overlay != nullptr)
+            f = _overlay;
+    }
+
     // Now mount based on MediaType
     switch (disk_type)
     {
@@ -234,10 +304,15 @@ mediatype_t sioDisk::mount(FileHandler *f, const char *filename, uint32_t disksi
             strcpy(_disk->_disk_filename, filename);
         }
         return _disk->mount(f, disksize);
-    // case MEDIATYPE_ATX:
-    //     device_active = true;
-    //     _disk = new MediaTypeATX();
-    //     return _disk->mount(f, disksize);
+    case MEDIATYPE_ATX:
+        device_active = true;
+        _disk = new MediaTypeATX();
+        if (host != nullptr)
+        {
+            _disk->_disk_host = host;
+            strcpy(_disk->_disk_filename, filename);
+        }
+        return _disk->mount(f, disksize);
     case MEDIATYPE_ATR:
     case MEDIATYPE_UNKNOWN:
     default:
@@ -248,6 +323,7 @@ mediatype_t sioDisk::mount(FileHandler *f, const char *filename, uint32_t disksi
             _disk->_disk_host = host;
             strcpy(_disk->_disk_filename, filename);
         }
+        _disk->_disk_overlay = _overlay != nullptr;
         return _disk->mount(f, disksize);
     }
 }
@@ -274,6 +350,40 @@ void sioDisk::unmount()
         delete _disk;
         _disk = nullptr;
     }
+    _overlay = nullptr;
+}
+
+// Media asks for flush of cached writes
+void sioDisk::sio_timer()
+{
+    if (_disk != nullptr)
+        _disk->flush(false);
+}
+
+bool sioDisk::flush()
+{
+    if (_disk == nullptr)
+        return true;
+    return !_disk->flush(true);
+}
+
+// Pending writes go to the overlay first, media must not hold anything read through it
+bool sioDisk::overlay_commit()
+{
+    if (_overlay == nullptr)
+        return false;
+    bool ok = flush();
+    _disk->invalidate();
+    return _overlay->commit() && ok;
+}
+
+void sioDisk::overlay_discard()
+{
+    if (_overlay == nullptr)
+        return;
+    flush();
+    _disk->invalidate();
+    _overlay->discard();
 }
 
 // Create blank disk
@@ -3,18 +3,27 @@
 
 #include <fujiHost.h>
 #include "bus.h"
+#include "fnFileOverlay.h"
 #include "media.h"
 
 class sioDisk : public virtualDevice
 {
 private:
     MediaType *_disk = nullptr;
+    FileHandlerOverlay *_overlay = nullptr; // owned by media, nullptr if writes go to the image
+    uint16_t _read_count = 0;
 
     void sio_read();
+    void sio_timed_error() override;
+    int sio_command_timeout() override;
+    int sio_host_type() override { return host == nullptr ? 0 : host->get_type(); }
     void sio_write(bool verify);
     void sio_format();
     void sio_status() override;
     void sio_process(uint32_t commanddata, uint8_t checksum) override;
+    uint64_t sio_timer_deadline() override { return _disk == nullptr ? 0 : _disk->flush_deadline(); }
+    void sio_timer() override;
+    void shutdown() override { flush(); }
 
     void derive_percom_block(uint16_t numSectors);
     void sio_read_percom_block();
@@ -23,9 +32,17 @@ private:
 
 public:
     sioDisk();
-    fujiHost *host;
+    fujiHost *host = nullptr;
     mediatype_t mount(FileHandler *f, const char *filename, uint32_t disksize, mediatype_t disk_type = MEDIATYPE_UNKNOWN);
     void unmount();
+    // write sectors cached by media into the image, false on error
+    bool flush();
+    // copy-on-write overlay: number of changed blocks, -1 if the image has no overlay
+    int overlay_blocks() { return _overlay == nullptr ? -1 : (int)_overlay->changed_blocks(); }
+    // write changed blocks into the image, false on error
+    bool overlay_commit();
+    // forget changed blocks
+    void overlay_discard();
     bool write_blank(FileHandler *f, uint16_t sectorSize, uint16_t numSectors);
 
     mediatype_t disktype() { return _disk == nullptr ? MEDIATYPE_UNKNOWN : _disk->_disktype; };
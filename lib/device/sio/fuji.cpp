@@ -905,6 +905,10 @@ void sioFuji::image_rotate()
     {
         count--;
 
+        // images move to other drives, write their cached sectors first
+        for (int n = 0; n <= count; n++)
+            _fnDisks[n].disk_dev.flush();
+
         // Save the device ID of the disk in the last slot
         int last_id = _fnDisks[count].disk_dev.id();
 
@@ -16,6 +16,7 @@
 #include "../../include/pinmap.h"
 
 #include "fnSystem.h"
+#include "fnEventLoop.h"
 #include "utils.h"
 
 #include "status_error_codes.h"
@@ -154,8 +155,18 @@ void sioNetwork::sio_open()
         return;
     }
 
-    // Attempt protocol open
-    if (protocol->open(urlParser, &cmdFrame) == true)
+    // Attempt protocol open, connecting can take a while so let the bus serve other devices meanwhile
+    sio_async(
+        [this]() { return protocol->open(urlParser, &cmdFrame) ? 1 : 0; },
+        [this](int failed) { sio_open_finish(failed != 0); });
+}
+
+/**
+ * Second part of SIO Open command, called on bus thread after protocol open finished.
+ */
+void sioNetwork::sio_open_finish(bool failed)
+{
+    if (failed)
     {
         status.error = protocol->error;
         Debug_printf("Protocol unable to make connection. Error: %d\n", status.error);
@@ -914,6 +925,10 @@ void sioNetwork::sio_process(uint32_t commanddata, uint8_t checksum)
  */
 void sioNetwork::sio_poll_interrupt()
 {
+    // protocol is being opened on worker thread
+    if (sio_async_pending())
+        return;
+
     if (protocol != nullptr)
     {
         if (protocol->interruptEnable == false)
@@ -940,6 +955,27 @@ void sioNetwork::sio_poll_interrupt()
     }
 }
 
+/**
+ * Tell event loop when sio_poll_interrupt() needs to run again.
+ */
+void sioNetwork::prepare_wait()
+{
+    if (sio_async_pending() || protocol == nullptr || protocol->interruptEnable == false)
+        return;
+
+    if (protocol->forceStatus || status.rxBytesWaiting > 0 || status.connected == 0)
+    {
+        // interrupt is asserted, keep toggling PROCEED at timerRate
+        eventLoop.add_deadline(lastInterruptMs + timerRate);
+    }
+    else
+    {
+        // wake up early on incoming data, protocols without socket are polled at timerRate
+        eventLoop.add_fd(protocol->get_fd());
+        eventLoop.add_timeout(timerRate);
+    }
+}
+
 /** PRIVATE METHODS ************************************************************/
 
 /**
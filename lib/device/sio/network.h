@@ -60,6 +60,12 @@ public:
      */
     virtual void sio_open();
 
+    /**
+     * Finish 'O' command when protocol open is done, send COMPLETE or ERROR.
+     * @param failed true if protocol open failed
+     */
+    void sio_open_finish(bool failed);
+
     /**
      * Called for SIO Command 'C' to close a connection to a network protocol, de-allocate all buffers,
      * and stop the receive PROCEED interrupt.
@@ -127,6 +133,11 @@ public:
      */
     void sio_poll_interrupt();
 
+    /**
+     * Register protocol socket and interrupt timer with event loop.
+     */
+    void prepare_wait();
+
     /**
      * Process incoming SIO command for device 0x7X
      * @param comanddata incoming 4 bytes containing command and aux bytes
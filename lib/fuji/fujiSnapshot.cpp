@@ -0,0 +1,87 @@
+
+#include "fujiSnapshot.h"
+
+#include <string.h>
+#include "compat_string.h"
+
+#include "fnSystem.h"
+#include "fnEventLoop.h"
+#include "fnConfig.h"
+#include "bus.h"
+#include "fuji.h"
+
+// global snapshot of fuji/bus state
+fujiSnapshot fujiState;
+
+
+void fujiSnapshot::_collect(fujiSnapshotData &data)
+{
+    memset(&data, 0, sizeof(data));
+
+    for (int i = 0; i < SNAPSHOT_HOSTS; i++)
+    {
+        fujiHost *host = theFuji.get_hosts(i);
+        data.hosts[i].valid = (Config.get_host_type(i) != fnConfig::host_types::HOSTTYPE_INVALID);
+        host->get_hostname(data.hosts[i].hostname, sizeof(data.hosts[i].hostname));
+        host->get_prefix(data.hosts[i].prefix, sizeof(data.hosts[i].prefix));
+    }
+
+    for (int i = 0; i < SNAPSHOT_DISKS; i++)
+    {
+        data.disks[i].host_slot = Config.get_mount_host_slot(i);
+        data.disks[i].read_only = (Config.get_mount_mode(i) == fnConfig::mount_modes::MOUNTMODE_READ);
+        data.disks[i].mounted = (theFuji.get_disks(i)->fileh != nullptr);
+        data.disks[i].disk_id = (char) theFuji.get_disk_id(i);
+        data.disks[i].overlay_blocks = theFuji.get_disks(i)->disk_dev.overlay_blocks();
+        strlcpy(data.disks[i].path, Config.get_mount_path(i).c_str(), sizeof(data.disks[i].path));
+    }
+
+#ifdef BUILD_ATARI
+    data.hsio_index = SIO.getHighSpeedIndex();
+    data.hsio_baud = SIO.getHighSpeedBaud();
+    SIO.getLinkStats(data.hsio_stats);
+    data.cassette_play = theFuji.cassette()->get_buttons();
+    data.cassette_pulldown = theFuji.cassette()->has_pulldown();
+#endif
+}
+
+void fujiSnapshot::update(bool force)
+{
+    uint64_t ms = fnSystem.millis();
+    if (!force && ms - _last_update < SNAPSHOT_UPDATE_MS)
+    {
+        _update_due = true;
+        return;
+    }
+    _last_update = ms;
+    _update_due = false;
+
+    fujiSnapshotData data;
+    _collect(data);
+    if (memcmp(&data, &_data, sizeof(data)) == 0)
+        return; // nothing changed
+
+    // odd sequence number = update in progress
+    _seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&_data, &data, sizeof(data));
+    _seq.fetch_add(1, std::memory_order_release);
+}
+
+void fujiSnapshot::prepare_wait()
+{
+    if (_update_due)
+        eventLoop.add_deadline(_last_update + SNAPSHOT_UPDATE_MS);
+}
+
+void fujiSnapshot::read(fujiSnapshotData &data)
+{
+    uint32_t seq1, seq2;
+    do
+    {
+        seq1 = _seq.load(std::memory_order_acquire);
+        memcpy(&data, &_data, sizeof(data));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq2 = _seq.load(std::memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+}
@@ -0,0 +1,71 @@
+#ifndef _FUJI_SNAPSHOT_
+#define _FUJI_SNAPSHOT_
+
+#include <stdint.h>
+#include <atomic>
+
+#include "fujiHost.h"
+#include "fujiDisk.h"
+#include "sio/hsiotuner.h"
+
+#define SNAPSHOT_HOSTS 8
+#define SNAPSHOT_DISKS 8
+#define SNAPSHOT_UPDATE_MS 100 // how often the bus publishes new state
+
+/*
+ * Copy of host/drive slot and bus status published by the bus thread
+ *
+ * Web server runs on its own thread and must not read fuji/bus objects
+ * while the bus is changing them. The bus thread periodically publishes
+ * the state here and web server reads a consistent copy without locking
+ * (sequence lock: reader retries if the copy was updated meanwhile).
+ */
+
+struct fujiSnapshotData
+{
+    struct
+    {
+        bool valid;                             // host slot in use
+        char hostname[MAX_HOSTNAME_LEN];
+        char prefix[MAX_HOST_PREFIX_LEN];
+    } hosts[SNAPSHOT_HOSTS];
+
+    struct
+    {
+        int host_slot;                          // HOST_SLOT_INVALID if slot is empty
+        bool read_only;
+        bool mounted;                           // image file is open
+        char disk_id;                           // device ID the slot is mapped to ('1'..'8')
+        int overlay_blocks;                     // changed blocks in copy-on-write overlay, -1 = no overlay
+        char path[MAX_FILENAME_LEN];
+    } disks[SNAPSHOT_DISKS];
+
+    int hsio_index;
+    int hsio_baud;
+    hsio_link_stats hsio_stats[HSIO_TUNER_SLOTS]; // link errors per HSIO index
+    bool cassette_play;
+    bool cassette_pulldown;
+};
+
+class fujiSnapshot
+{
+public:
+    // bus thread: publish current state, at most every SNAPSHOT_UPDATE_MS unless forced
+    void update(bool force=false);
+    // bus thread: wake up event loop when postponed update is due
+    void prepare_wait();
+    // any thread: get consistent copy of last published state
+    void read(fujiSnapshotData &data);
+
+private:
+    void _collect(fujiSnapshotData &data);
+
+    fujiSnapshotData _data = {};
+    std::atomic<uint32_t> _seq{0};
+    uint64_t _last_update = 0;
+    bool _update_due = false;
+};
+
+extern fujiSnapshot fujiState;
+
+#endif // _FUJI_SNAPSHOT_
@@ -0,0 +1,124 @@
+
+#include "fnRealtime.h"
+
+#include <cstring>
+#include <thread>
+
+#if defined(__linux__)
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+#include "fnSystem.h"
+
+#include "../../include/debug.h"
+
+fnRealtime realtimeProfile;
+
+
+#if defined(__linux__)
+// touch stack pages now, so the bus thread does not fault on them later
+static void __attribute__((noinline)) _prefault_stack()
+{
+    volatile char stack[REALTIME_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+#endif
+
+bool fnRealtime::enable(int cpu)
+{
+#if defined(__linux__)
+    bool ok = true;
+    std::string status;
+    char buf[80];
+
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = REALTIME_PRIORITY;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    if (err == 0)
+        snprintf(buf, sizeof(buf), "SCHED_FIFO %d", REALTIME_PRIORITY);
+    else
+    {
+        snprintf(buf, sizeof(buf), "SCHED_FIFO failed (%s)", strerror(err));
+        ok = false;
+    }
+    status += buf;
+
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err == 0)
+            snprintf(buf, sizeof(buf), ", CPU %d", cpu);
+        else
+        {
+            snprintf(buf, sizeof(buf), ", CPU %d failed (%s)", cpu, strerror(err));
+            ok = false;
+        }
+        status += buf;
+    }
+
+#ifdef __GLIBC__
+    // keep freed memory in the process, allocations on command path reuse prefaulted pages
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
+    _prefault_stack();
+    char *heap = (char *)malloc(REALTIME_HEAP_PREFAULT);
+    if (heap != nullptr)
+    {
+        for (size_t i = 0; i < REALTIME_HEAP_PREFAULT; i += 4096)
+            heap[i] = 0;
+        free(heap);
+    }
+
+    // lock what is mapped now only: with MCL_FUTURE every thread started later would have
+    // its whole stack locked, thread creation fails once RLIMIT_MEMLOCK is reached
+    if (mlockall(MCL_CURRENT) == 0)
+        status += ", memory locked";
+    else
+    {
+        snprintf(buf, sizeof(buf), ", mlockall failed (%s)", strerror(errno));
+        status += buf;
+        ok = false;
+    }
+
+    _enabled = true;
+    _status = status;
+    Debug_printf("Real-time profile: %s\n", _status.c_str());
+    return ok;
+#else
+    _status = "not supported on this platform";
+    Debug_printf("Real-time profile: %s\n", _status.c_str());
+    return false;
+#endif
+}
+
+void fnRealtime::normal_priority()
+{
+#if defined(__linux__)
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+#endif
+}
+
+void fnRealtime::probe_latency(int samples, int interval_us)
+{
+    for (int i = 0; i < samples; i++)
+    {
+        uint64_t start = fnSystem.micros();
+        std::this_thread::sleep_for(std::chrono::microseconds(interval_us));
+        uint64_t slept = fnSystem.micros() - start;
+        _probe.record(slept > (uint64_t)interval_us ? slept - interval_us : 0);
+    }
+    Debug_printf("Scheduling latency (%d sleeps of %d us): p50 %llu us, p99 %llu us, max %llu us\n",
+                 samples, interval_us, (unsigned long long)_probe.quantile(0.5),
+                 (unsigned long long)_probe.quantile(0.99), (unsigned long long)_probe.quantile(1.0));
+}
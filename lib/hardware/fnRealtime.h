@@ -0,0 +1,50 @@
+#ifndef _FN_REALTIME_H
+#define _FN_REALTIME_H
+
+#include <string>
+
+#include "fnMetrics.h"
+
+#define REALTIME_PRIORITY 50                    // SCHED_FIFO priority of the bus thread
+#define REALTIME_STACK_PREFAULT (256 * 1024)    // stack touched in advance, no page faults later
+#define REALTIME_HEAP_PREFAULT (8 * 1024 * 1024) // heap touched in advance and kept by allocator
+#define REALTIME_PROBE_SAMPLES 2000
+#define REALTIME_PROBE_INTERVAL_US 250
+
+/*
+ * Real-time profile for the bus thread (opt-in, Linux only)
+ * Keeps the SIO service loop from being descheduled long enough to miss protocol
+ * timing: SCHED_FIFO priority, optional CPU pinning, locked and prefaulted memory.
+ * Memory mapped at enable() is locked: program, bus thread stack and heap grown by
+ * REALTIME_HEAP_PREFAULT, which allocator keeps for later allocations. Buffers the
+ * bus allocates on command path come from it without page faults, but they are
+ * still allocated, only the SIO response frame is reserved in advance.
+ * Threads started later by the bus thread inherit the profile, background threads
+ * which should not (workers, web server) call normal_priority().
+ */
+class fnRealtime
+{
+public:
+    // switch calling thread to real-time profile, cpu < 0 to not pin,
+    // returns false if any step failed, see status()
+    bool enable(int cpu);
+    bool enabled() { return _enabled; }
+    // put calling thread back to normal scheduling
+    static void normal_priority();
+
+    // measure how late calling thread wakes up from short sleeps
+    void probe_latency(int samples = REALTIME_PROBE_SAMPLES, int interval_us = REALTIME_PROBE_INTERVAL_US);
+    fnHistogram &probe() { return _probe; }
+
+    // what was set up (or failed)
+    std::string status() { return _status; }
+
+private:
+    bool _enabled = false;
+    std::string _status = "off";
+    fnHistogram _probe;
+};
+
+extern fnRealtime realtimeProfile;
+
+#endif // _FN_REALTIME_H
@@ -25,8 +25,8 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <sched.h>
+#include <errno.h>
 #include "compat_uname.h"
-#include "compat_gettimeofday.h"
 
 #include "../../include/debug.h"
 #include "../../include/version.h"
@@ -99,15 +99,53 @@ static void setup_card_detect(gpio_num_t pin)
 // Global object to manage System
 SystemManager fnSystem;
 
-// keep reference timestamp
-uint64_t _get_start_millis()
+// monotonic clock in ns, does not jump when system time is adjusted
+static uint64_t _monotonic_ns()
 {
-    struct timeval tv;
-    compat_gettimeofday(&tv, NULL);
-    return (uint64_t)(tv.tv_sec*1000ULL+tv.tv_usec/1000ULL);
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    uint64_t f = (uint64_t)freq.QuadPart;
+    uint64_t c = (uint64_t)counter.QuadPart;
+    return (c / f) * 1000000000ULL + (c % f) * 1000000000ULL / f;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
 }
-uint64_t _start_millis = _get_start_millis();
-uint64_t _start_micros = _start_millis*1000;
+
+// sleep until given monotonic time
+static void _sleep_until_ns(uint64_t until)
+{
+#if defined(_WIN32)
+    uint64_t now = _monotonic_ns();
+    if (until > now)
+        Sleep((DWORD)((until - now) / 1000000ULL));
+#elif defined(__linux__)
+    struct timespec ts;
+    ts.tv_sec = until / 1000000000ULL;
+    ts.tv_nsec = until % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+#else
+    // no clock_nanosleep on macOS
+    uint64_t now = _monotonic_ns();
+    if (until > now)
+    {
+        struct timespec ts;
+        ts.tv_sec = (until - now) / 1000000000ULL;
+        ts.tv_nsec = (until - now) % 1000000000ULL;
+        nanosleep(&ts, NULL);
+    }
+#endif
+}
+
+// keep reference timestamp
+uint64_t _start_ns = _monotonic_ns();
 
 
 SystemManager::SystemManager()
@@ -216,9 +254,7 @@ int SystemManager::digital_read(uint8_t pin)
 uint64_t SystemManager::micros()
 {
     // return (unsigned long)(esp_timer_get_time());
-    struct timeval tv;
-    compat_gettimeofday(&tv, NULL);
-    return (uint64_t)(tv.tv_sec*1000000ULL+tv.tv_usec) - _start_micros;
+    return (_monotonic_ns() - _start_ns) / 1000ULL;
 }
 
 // from esp32-hal-misc.c
@@ -226,9 +262,7 @@ uint64_t SystemManager::micros()
 uint64_t SystemManager::millis()
 {
     // return (unsigned long)(esp_timer_get_time() / 1000ULL);
-    struct timeval tv;
-    compat_gettimeofday(&tv, NULL);
-    return (uint64_t)(tv.tv_sec*1000UL+tv.tv_usec/1000UL) - _start_millis;
+    return (_monotonic_ns() - _start_ns) / 1000000ULL;
 }
 
 /*
@@ -261,88 +295,53 @@ void IRAM_ATTR SystemManager::delay_microseconds(uint32_t us)
 
 void SystemManager::delay(uint32_t ms)
 {
-    // struct timespec ts;
-    // ts.tv_sec = ms / 1000;
-    // ts.tv_nsec = (ms % 1000) * (1000 * 1000);
-    // nanosleep(&ts, NULL);
-    usleep(ms*1000);
+    _sleep_until_ns(_monotonic_ns() + ms * 1000000ULL);
 }
 
-#if defined(_WIN32)
+/* Precise delay for SIO protocol timing
+   Sleep for the largest part and busy-wait for the rest, scheduler wake-up latency
+   is measured on every sleep and used to decide how long the busy-wait part is.
+*/
 void SystemManager::delay_microseconds(uint32_t us)
 {
-    // a)
-    // HANDLE timer; 
-    // LARGE_INTEGER ft; 
-
-    // ft.QuadPart = -(10*us); // Convert to 100 nanosecond interval, negative value indicates relative time
-
-    // timer = CreateWaitableTimer(NULL, TRUE, NULL); 
-    // SetWaitableTimer(timer, &ft, 0, NULL, NULL, 0); 
-    // WaitForSingleObject(timer, INFINITE); 
-
-    // CloseHandle(timer);
+    uint64_t target = _monotonic_ns() + us * 1000ULL;
+    uint64_t slack = _delay_slack.load(std::memory_order_relaxed);
 
-    // b)
-    // usleep(us);
-
-    // c)
-    // std::this_thread::sleep_for(std::chrono::microseconds(us));
-
-    // d) combination of Sleep and busy-looping
-    if (us > 1000000)
-    {
-        // At least one second. Millisecond resolution is sufficient.
-        Sleep(us / 1000);
-    }
-    else
+    if (us * 1000ULL > slack)
     {
-        // Use Sleep for the largest part, and busy-loop for the rest
-        static double frequency;
-        if (frequency == 0)
-        {
-            LARGE_INTEGER freq;
-            if (!QueryPerformanceFrequency (&freq))
-            {
-                Debug_println("QueryPerformanceCounter failed");
-                // Cannot use QueryPerformanceCounter.
-                Sleep (us / 1000);
-                return;
-            }
-            frequency = (double) freq.QuadPart / 1000000000.0;
-        }
-        long long expected_counter_difference = 1000 * us * frequency;
-        int sleep_part = (int) us / 1000 - 10;
-        LARGE_INTEGER before;
-        QueryPerformanceCounter (&before);
-        long long expected_counter = before.QuadPart + expected_counter_difference;
-        if (sleep_part > 0)
-            Sleep(sleep_part);
-        for (;;)
-        {
-            LARGE_INTEGER after;
-            QueryPerformanceCounter (&after);
-            if (after.QuadPart >= expected_counter)
-                break;
-        }
+        uint64_t wake = target - slack;
+        _sleep_until_ns(wake);
+
+        // adjust slack to twice the average wake-up latency
+        uint64_t now = _monotonic_ns();
+        uint64_t late = now > wake ? now - wake : 0;
+        slack = (slack * 7 + late * 2) / 8;
+        if (slack < DELAY_SLEEP_SLACK_MIN_NS)
+            slack = DELAY_SLEEP_SLACK_MIN_NS;
+        _delay_slack.store(slack, std::memory_order_relaxed);
     }
-}
-#else
-void SystemManager::delay_microseconds(uint32_t us)
-{
-    // a)
-    // struct timespec ts;
-    // ts.tv_sec = us / (1000 * 1000);
-    // ts.tv_nsec = (us % (1000 * 1000)) * 1000;
-    // nanosleep(&ts, NULL);
 
-    // b)
-    usleep(us);
+    uint64_t now;
+    while ((now = _monotonic_ns()) < target)
+        ;
 
-    // c)
-    // std::this_thread::sleep_for(std::chrono::microseconds(us));
+    // how late we are
+    uint32_t overshoot = (uint32_t)(now - target);
+    _delay_count.fetch_add(1, std::memory_order_relaxed);
+    _delay_overshoot_total.fetch_add(overshoot, std::memory_order_relaxed);
+    uint32_t max = _delay_overshoot_max.load(std::memory_order_relaxed);
+    while (overshoot > max && !_delay_overshoot_max.compare_exchange_weak(max, overshoot, std::memory_order_relaxed))
+        ;
+}
+
+void SystemManager::get_delay_stats(delay_stats_t &stats)
+{
+    stats.count = _delay_count.load(std::memory_order_relaxed);
+    uint64_t total = _delay_overshoot_total.load(std::memory_order_relaxed);
+    stats.avg_ns = stats.count ? (uint32_t)(total / stats.count) : 0;
+    stats.max_ns = _delay_overshoot_max.load(std::memory_order_relaxed);
+    stats.slack_ns = (uint32_t)_delay_slack.load(std::memory_order_relaxed);
 }
-#endif
 
 // from esp32-hal-misc.
 void SystemManager::yield()
@@ -7,6 +7,7 @@
 
 #include <string>
 #include <cstdint>
+#include <atomic>
 
 // #include <driver/gpio.h>
 
@@ -23,6 +24,24 @@
 
 #define ESP_INTR_FLAG_DEFAULT 0
 
+// delay_microseconds() sleeps until this much before the target time and busy-waits the rest,
+// the value is adjusted by measured sleep wake-up latency
+#if defined(_WIN32)
+#define DELAY_SLEEP_SLACK_NS 2000000ULL
+#else
+#define DELAY_SLEEP_SLACK_NS 100000ULL
+#endif
+#define DELAY_SLEEP_SLACK_MIN_NS 20000ULL
+
+// delay_microseconds() accuracy, to verify SIO timing margins
+struct delay_stats_t
+{
+    uint64_t count;         // number of delays
+    uint32_t avg_ns;        // average overshoot
+    uint32_t max_ns;        // worst overshoot
+    uint32_t slack_ns;      // current sleep slack (busy-wait part)
+};
+
 class SystemManager
 {
 private:
@@ -37,6 +56,11 @@ private:
     uint64_t _reboot_at = 0;
     int _reboot_code = EXIT_AND_RESTART;
 
+    std::atomic<uint64_t> _delay_count{0};
+    std::atomic<uint64_t> _delay_overshoot_total{0};
+    std::atomic<uint32_t> _delay_overshoot_max{0};
+    std::atomic<uint64_t> _delay_slack{DELAY_SLEEP_SLACK_NS};
+
 public:
     SystemManager();
     class _net
@@ -101,6 +125,7 @@ public:
 
     void reboot(uint32_t delay_ms = 0, bool reboot=true);
     bool check_deferred_reboot();
+    uint64_t get_deferred_reboot_time() { return _reboot_at; } // 0 if no reboot is scheduled
     uint32_t get_cpu_frequency();
     uint32_t get_free_heap_size();
     uint32_t get_psram_size();
@@ -112,6 +137,7 @@ public:
     uint64_t micros();
     void delay_microseconds(uint32_t us);
     void delay(uint32_t ms);
+    void get_delay_stats(delay_stats_t &stats);
 
     const char *get_uptime_str();
     const char *get_current_time_str();
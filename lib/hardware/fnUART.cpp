@@ -21,11 +21,15 @@
 #if defined(__linux__)
 #include <linux/serial.h>
 #include "linux_termios2.h"
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #elif defined(__APPLE__)
 #include <IOKit/serial/ioss.h>
 #endif
 
 #include "fnSystem.h"
+#include "fnEventLoop.h"
 #include "fnUART.h"
 #include "../../include/debug.h"
 
@@ -63,6 +67,11 @@ UARTManager::UARTManager() :
     _baud(UART_DEFAULT_BAUD)
 {};
 
+UARTManager::~UARTManager()
+{
+    end();
+}
+
 void UARTManager::end()
 {
 #if defined (_WIN32)
@@ -75,6 +84,9 @@ void UARTManager::end()
 #else
     if (_fd >= 0)
     {
+#ifdef UART_READER_THREAD
+        _stop_reader();
+#endif
         close(_fd);
         _fd  = -1;
         Debug_printf("### UART stopped ###\n");
@@ -91,6 +103,33 @@ bool UARTManager::poll(int ms)
     return false;
 }
 
+void UARTManager::prepare_wait()
+{
+    if (!_initialized)
+    {
+        // suspended, command_asserted() will try to re-open the port
+        eventLoop.add_timeout(100);
+        return;
+    }
+#ifdef UART_READER_THREAD
+    if (_reader_active)
+    {
+        // reader threads wake us up on incoming data and command line change
+        if (!_rx_ring.empty() || !_line_ring.empty() || _reader_error != 0)
+            eventLoop.add_timeout(0);
+        return;
+    }
+#endif
+#if !defined(_WIN32)
+    // wake up on incoming data
+    eventLoop.add_fd(_fd);
+#endif
+    // without reader threads (non-Linux builds) nothing wakes us up on command line
+    // change: modem status lines cannot be waited for with poll() or together with
+    // other events and TIOCMIWAIT is Linux only, check the command line at 1 ms rate
+    eventLoop.add_timeout(1);
+}
+
 #if defined(_WIN32)
 // Windows UART code
 
@@ -646,6 +685,9 @@ void UARTManager::begin(int baud)
     // Set initialized.
     _initialized = true;
     set_baudrate(baud);
+#ifdef UART_READER_THREAD
+    _start_reader();
+#endif
 }
 
 
@@ -662,6 +704,17 @@ void UARTManager::suspend(int sec)
  */
 void UARTManager::flush_input()
 {
+#ifdef UART_READER_THREAD
+    if (_reader_active)
+    {
+        // drop what came before the command line was last checked, newer bytes
+        // can belong to command frame whose command line change was not seen yet
+        rx_byte rb;
+        while (_rx_ring.peek(rb) && rb.us < _cmd_checked_us)
+            _rx_ring.pop(rb);
+        return;
+    }
+#endif
     if (_initialized)
         tcflush(_fd, TCIFLUSH);
 }
@@ -682,6 +735,10 @@ int UARTManager::available()
     int result;
     if (!_initialized)
         return 0;
+#ifdef UART_READER_THREAD
+    if (_reader_active)
+        return _rx_ring.size();
+#endif
 	if (ioctl(_fd, FIONREAD, &result) < 0)
         return 0;
     return result;
@@ -803,6 +860,40 @@ bool UARTManager::command_asserted(void)
             return false;
     }
 
+#ifdef UART_READER_THREAD
+    if (_reader_active)
+    {
+        if (_reader_error != 0)
+        {
+            Debug_printf("UART reader error %d: %s\n", (int)_reader_error, strerror(_reader_error));
+            suspend();
+            return false;
+        }
+        _cmd_checked_us = fnSystem.micros();
+        // every assert is reported, even if the line is up again already
+        line_event ev;
+        while (_line_ring.pop(ev))
+        {
+            _cmd_level = ev.asserted;
+            if (!ev.asserted)
+                _cmd_deassert_us = ev.us;
+            else
+            {
+                // bytes received before the command line went down are not part of command frame,
+                // those close to the change may be (see UART_CMD_EDGE_GUARD_US)
+                uint64_t stale_us = ev.us > UART_CMD_EDGE_GUARD_US ? ev.us - UART_CMD_EDGE_GUARD_US : 0;
+                if (stale_us < _cmd_deassert_us)
+                    stale_us = _cmd_deassert_us;
+                rx_byte rb;
+                while (_rx_ring.peek(rb) && rb.us < stale_us)
+                    _rx_ring.pop(rb);
+                return true;
+            }
+        }
+        return _cmd_level;
+    }
+#endif
+
     if (ioctl(_fd, TIOCMGET, &status) < 0)
     {
         // handle serial port errors
@@ -846,8 +937,223 @@ timeval timeval_from_ms(const uint32_t millis)
   return tv;
 }
 
+#ifdef UART_READER_THREAD
+static void _reader_sighandler(int signum)
+{
+    // only to interrupt TIOCMIWAIT
+}
+
+// Signal to interrupt TIOCMIWAIT of line thread, 0 if there is none
+// First real-time signal nobody else handles is taken, it's sent to the line thread only.
+static int _reader_signal()
+{
+    static int signum = -1;
+    if (signum >= 0)
+        return signum;
+
+    signum = 0;
+    for (int s = SIGRTMIN; s <= SIGRTMAX; s++)
+    {
+        struct sigaction old;
+        if (sigaction(s, nullptr, &old) != 0 || old.sa_handler != SIG_DFL)
+            continue;
+        // no SA_RESTART, blocked ioctl must return with EINTR
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = _reader_sighandler;
+        if (sigaction(s, &sa, nullptr) == 0)
+        {
+            signum = s;
+            break;
+        }
+    }
+    if (signum == 0)
+        Debug_println("UART no free signal, polling command line");
+    return signum;
+}
+
+void UARTManager::_start_reader()
+{
+    if (_reader_active)
+        return;
+
+    // pick signal stopping the line thread before it starts
+    _reader_signal();
+
+    _rx_ring.clear();
+    _line_ring.clear();
+    _cmd_deassert_us = 0;
+    _reader_stop = false;
+    _reader_error = 0;
+
+    int status = 0;
+    ioctl(_fd, TIOCMGET, &status);
+    _cmd_level = (status & _command_tiocm) != 0;
+
+    _rx_thread = std::thread(&UARTManager::_rx_loop, this);
+    if (_command_tiocm != 0)
+    {
+        _line_running = true;
+        _line_thread = std::thread(&UARTManager::_line_loop, this);
+    }
+    _reader_active = true;
+}
+
+void UARTManager::_stop_reader()
+{
+    if (!_reader_active)
+        return;
+
+    _reader_stop = true;
+    // interrupt TIOCMIWAIT, repeated in case the signal came before the thread got into ioctl
+    int signum = _reader_signal();
+    while (_line_running)
+    {
+        if (signum != 0)
+            pthread_kill(_line_thread.native_handle(), signum);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (_line_thread.joinable())
+        _line_thread.join();
+    _rx_cv.notify_all();
+    _rx_thread.join();
+    _reader_active = false;
+}
+
+// wake up bus thread, either waiting in readBytes() or in event loop
+void UARTManager::_reader_notify()
+{
+    {
+        std::lock_guard<std::mutex> lock(_rx_mutex);
+    }
+    _rx_cv.notify_all();
+    eventLoop.wakeup();
+}
+
+bool UARTManager::_wait_rx(uint32_t timeout_ms)
+{
+    std::unique_lock<std::mutex> lock(_rx_mutex);
+    _rx_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                    [this] { return !_rx_ring.empty() || _reader_error != 0 || _reader_stop; });
+    return !_rx_ring.empty();
+}
+
+// data reader thread
+void UARTManager::_rx_loop()
+{
+    uint8_t buf[256];
+    struct pollfd pfd;
+    pfd.fd = _fd;
+    pfd.events = POLLIN;
+    bool overrun_reported = false;
+
+    while (!_reader_stop)
+    {
+        // timeout to check for stop request
+        if (::poll(&pfd, 1, 100) <= 0)
+            continue;
+        ssize_t n = ::read(_fd, buf, sizeof(buf));
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (n < 0 || (n == 0 && (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))))
+        {
+            _reader_error = n < 0 ? errno : EIO;
+            _reader_notify();
+            break;
+        }
+
+        uint64_t now = fnSystem.micros();
+        for (ssize_t i = 0; i < n; i++)
+        {
+            if (!_rx_ring.push({now, buf[i]}) && !overrun_reported)
+            {
+                Debug_println("UART rx ring overrun");
+                overrun_reported = true;
+            }
+        }
+        _reader_notify();
+    }
+}
+
+// transitions of command line counted by driver
+static int _command_icount(const struct serial_icounter_struct &ic, int command_tiocm)
+{
+    switch (command_tiocm)
+    {
+    case TIOCM_DSR:
+        return ic.dsr;
+    case TIOCM_CTS:
+        return ic.cts;
+    default:
+        return ic.rng;
+    }
+}
+
+// command line watcher thread
+void UARTManager::_line_loop()
+{
+    bool level = _cmd_level;
+    // without signal to interrupt it, TIOCMIWAIT would block stop of the thread
+    bool use_wait = _reader_signal() != 0;
+    struct serial_icounter_struct ic;
+    int last_count = -1;
+    if (ioctl(_fd, TIOCGICOUNT, &ic) == 0)
+        last_count = _command_icount(ic, _command_tiocm);
+
+    while (!_reader_stop)
+    {
+        if (use_wait && ioctl(_fd, TIOCMIWAIT, _command_tiocm) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // e.g. USB adapter driver without modem status interrupts
+            Debug_printf("UART TIOCMIWAIT error %d: %s, polling command line\n", errno, strerror(errno));
+            use_wait = false;
+        }
+        if (!use_wait)
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+
+        int status;
+        if (ioctl(_fd, TIOCMGET, &status) < 0)
+        {
+            _reader_error = errno;
+            _reader_notify();
+            break;
+        }
+        uint64_t now = fnSystem.micros();
+        bool new_level = (status & _command_tiocm) != 0;
+
+        // line went back before we looked at it, driver still counted both transitions
+        bool pulse = false;
+        if (last_count >= 0 && ioctl(_fd, TIOCGICOUNT, &ic) == 0)
+        {
+            int count = _command_icount(ic, _command_tiocm);
+            pulse = (new_level == level && count - last_count >= 2);
+            last_count = count;
+        }
+
+        if (pulse)
+        {
+            _line_ring.push({now, !level});
+            _line_ring.push({now, level});
+        }
+        else if (new_level != level)
+            _line_ring.push({now, new_level});
+        else
+            continue;
+        level = new_level;
+        _reader_notify();
+    }
+    _line_running = false;
+}
+#endif
+
 bool UARTManager::waitReadable(uint32_t timeout_ms)
 {
+#ifdef UART_READER_THREAD
+    if (_reader_active)
+        return _wait_rx(timeout_ms);
+#endif
     // Setup a select call to block for serial data or a timeout
     fd_set readfds;
     FD_ZERO(&readfds);
@@ -894,6 +1200,25 @@ size_t UARTManager::readBytes(uint8_t *buffer, size_t length, bool command_mode)
     if (!_initialized)
         return 0;
 
+#ifdef UART_READER_THREAD
+    if (_reader_active)
+    {
+        size_t count = 0;
+        rx_byte rb;
+        while (count < length)
+        {
+            if (_rx_ring.pop(rb))
+                buffer[count++] = rb.b;
+            else if (!_wait_rx(500)) // 500 ms timeout
+            {
+                Debug_println("UART readBytes() TIMEOUT");
+                break;
+            }
+        }
+        return count;
+    }
+#endif
+
     int result;
     int rxbytes;
     for (rxbytes=0; rxbytes<length;)
@@ -10,6 +10,26 @@
 #include <string>
 #include <cstdint>
 
+#if defined(__linux__)
+/*
+ * Serial port is read by background threads: one blocks in read() for data, other
+ * waits in TIOCMIWAIT for command line changes. Both timestamp what they get and
+ * pass it to the bus thread through lock-free rings, the bus does not poll the port.
+ */
+#define UART_READER_THREAD
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "fnSpscRing.h"
+
+#define UART_RX_RING_SIZE 4096      // bytes received, not read by bus yet
+#define UART_LINE_RING_SIZE 64      // command line changes, not seen by bus yet
+// USB adapters deliver modem status and data in the same packet, bytes of command frame
+// may get timestamp earlier than the command line change by scheduling of reader threads
+#define UART_CMD_EDGE_GUARD_US 2000
+#endif
+
 
 class UARTManager
 {
@@ -38,15 +58,51 @@ private:
     int _errcount;
     unsigned long _suspend_time;
 
+#ifdef UART_READER_THREAD
+    struct rx_byte
+    {
+        uint64_t us;        // when it was read
+        uint8_t b;
+    };
+    struct line_event
+    {
+        uint64_t us;        // when the change was noticed
+        bool asserted;
+    };
+
+    fnSpscRing<rx_byte, UART_RX_RING_SIZE> _rx_ring;
+    fnSpscRing<line_event, UART_LINE_RING_SIZE> _line_ring;
+    std::thread _rx_thread;
+    std::thread _line_thread;
+    std::atomic<bool> _reader_stop{false};
+    std::atomic<bool> _line_running{false};
+    std::atomic<int> _reader_error{0};      // errno of failed read, port is suspended by bus thread
+    std::mutex _rx_mutex;
+    std::condition_variable _rx_cv;
+    bool _reader_active = false;
+    bool _cmd_level = false;                // command line as last seen by bus thread
+    uint64_t _cmd_deassert_us = 0;          // when command line last went up
+    uint64_t _cmd_checked_us = 0;           // when bus thread last looked at command line
+
+    void _start_reader();
+    void _stop_reader();
+    void _rx_loop();
+    void _line_loop();
+    void _reader_notify();
+    bool _wait_rx(uint32_t timeout_ms);
+#endif
+
     size_t _print_number(unsigned long n, uint8_t base);
 
 public:
     // UARTManager(int uart_num);
     UARTManager();
+    ~UARTManager();
 
     void begin(int baud);
     void end();
     bool poll(int ms);
+    void prepare_wait(); // register with event loop
 
     void suspend(int sec=5);
     bool initialized() { return _initialized; }
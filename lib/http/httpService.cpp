@@ -7,7 +7,12 @@
 #include "../../include/debug.h"
 
 #include "fnSystem.h"
+#include "fnCommandQueue.h"
+#include "fujiSnapshot.h"
 #include "fnConfig.h"
+#include "fnMetrics.h"
+#include "fnTrace.h"
+#include "fnRealtime.h"
 #include "fnWiFi.h"
 #include "fsFlash.h"
 #include "modem.h"
@@ -229,6 +234,16 @@ int fnHttpService::redirect_or_result(mg_connection *c, mg_http_message *hm, int
     return result;
 }
 
+int fnHttpService::run_on_bus(std::function<int()> handler)
+{
+    return busQueue.run([&]() {
+        int result = handler();
+        // make the changes visible to the pages rendered next
+        fujiState.update(true);
+        return result;
+    });
+}
+
 // void fnHttpService::parse_query(httpd_req_t *req, queryparts *results)
 // {
 //     results->full_uri += req->uri;
@@ -407,6 +422,56 @@ int fnHttpService::get_handler_print(struct mg_connection *c)
     return 0; //ESP_OK;
 }
 
+// Bus metrics in Prometheus text format, counters are read directly without waiting for the bus
+int fnHttpService::get_handler_metrics(struct mg_connection *c)
+{
+    std::string metrics;
+    busMetrics.format_prometheus(metrics);
+
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4\r\n"
+                 "Content-Length: %u\r\n\r\n", (unsigned)metrics.size());
+    mg_send(c, metrics.data(), metrics.size());
+    return 0;
+}
+
+/* Timeline trace
+ "/trace?start=1" or "/trace?stop=1" switches tracing on/off (remembered in config to trace next boot),
+ "/trace" sends collected events as Chrome trace-event JSON file
+*/
+int fnHttpService::get_handler_trace(struct mg_connection *c, struct mg_http_message *hm)
+{
+    char start[10] = "";
+    char stop[10] = "";
+    mg_http_get_var(&hm->query, "start", start, sizeof(start));
+    mg_http_get_var(&hm->query, "stop", stop, sizeof(stop));
+
+    if (atoi(start) || atoi(stop))
+    {
+        bool enable = atoi(start) != 0;
+        if (enable)
+            fnTracer.start();
+        else
+            fnTracer.stop();
+        int result = run_on_bus([enable]() {
+            Config.store_general_trace_enabled(enable);
+            Config.save();
+            return 1;
+        });
+        return redirect_or_result(c, hm, result);
+    }
+
+    std::string trace;
+    fnTracer.format_json(trace);
+
+    mg_printf(c, "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/json\r\n"
+                 "Content-Disposition: attachment; filename=\"fujinet-trace.json\"\r\n"
+                 "Content-Length: %u\r\n\r\n", (unsigned)trace.size());
+    mg_send(c, trace.data(), trace.size());
+    return 0;
+}
+
 // esp_err_t fnHttpService::get_handler_modem_sniffer(httpd_req_t *req)
 // {
 //     Debug_printf("Modem Sniffer output request handler\n");
@@ -592,6 +657,35 @@ int fnHttpService::get_handler_eject(mg_connection *c, mg_http_message *hm)
     return 0;
 }
 
+/*
+ "/overlay?deviceslot=N&action=commit" writes local changes kept in copy-on-write
+ overlay of the mounted image into the image, "action=discard" drops them
+*/
+int fnHttpService::get_handler_overlay(mg_connection *c, mg_http_message *hm)
+{
+    char slot_str[3] = "", action[10] = "";
+    mg_http_get_var(&hm->query, "deviceslot", slot_str, sizeof(slot_str));
+    mg_http_get_var(&hm->query, "action", action, sizeof(action));
+    int ds = atoi(slot_str);
+
+    int result = 0;
+    if (ds >= 0 && ds < MAX_DISK_DEVICES)
+    {
+        if (strcmp(action, "commit") == 0)
+        {
+            Debug_printf("Overlay commit from webui, slot %d\n", ds);
+            result = theFuji.get_disks(ds)->disk_dev.overlay_commit() ? 1 : 0;
+        }
+        else if (strcmp(action, "discard") == 0)
+        {
+            Debug_printf("Overlay discard from webui, slot %d\n", ds);
+            theFuji.get_disks(ds)->disk_dev.overlay_discard();
+            result = 1;
+        }
+    }
+    return redirect_or_result(c, hm, result);
+}
+
 void fnHttpService::cb(struct mg_connection *c, int ev, void *ev_data, void *fn_data)
 {
     static const char *s_root_dir = "data/www";
@@ -629,17 +723,27 @@ void fnHttpService::cb(struct mg_connection *c, int ev, void *ev_data, void *fn_
             // config POST handler
             if (mg_vcasecmp(&hm->method, "POST") == 0)
             {
-                post_handler_config(c, hm);
+                run_on_bus([&]() { return post_handler_config(c, hm); });
             }
             else
             {
                 mg_http_reply(c, 400, "", "Bad config request\n");
             }
         }
+        else if (mg_http_match_uri(hm, "/metrics"))
+        {
+            // Prometheus metrics handler
+            get_handler_metrics(c);
+        }
+        else if (mg_http_match_uri(hm, "/trace"))
+        {
+            // trace start/stop/download handler
+            get_handler_trace(c, hm);
+        }
         else if (mg_http_match_uri(hm, "/print"))
         {
             // print handler
-            get_handler_print(c);
+            run_on_bus([&]() { return get_handler_print(c); });
         }
         else if (mg_http_match_uri(hm, "/browse/#"))
         {
@@ -648,18 +752,23 @@ void fnHttpService::cb(struct mg_connection *c, int ev, void *ev_data, void *fn_
         }
         else if (mg_http_match_uri(hm, "/swap"))
         {
-            // browse handler
-            get_handler_swap(c, hm);
+            // swap handler
+            run_on_bus([&]() { return get_handler_swap(c, hm); });
         }
         else if (mg_http_match_uri(hm, "/mount"))
         {
-            // browse handler
-            get_handler_mount(c, hm);
+            // mount handler
+            run_on_bus([&]() { return get_handler_mount(c, hm); });
         }
         else if (mg_http_match_uri(hm, "/unmount"))
         {
             // eject handler
-            get_handler_eject(c, hm);
+            run_on_bus([&]() { return get_handler_eject(c, hm); });
+        }
+        else if (mg_http_match_uri(hm, "/overlay"))
+        {
+            // commit or discard local changes of mounted image
+            run_on_bus([&]() { return get_handler_overlay(c, hm); });
         }
         else if (mg_http_match_uri(hm, "/restart"))
         {
@@ -669,14 +778,14 @@ void fnHttpService::cb(struct mg_connection *c, int ev, void *ev_data, void *fn_
             if (atoi(exit)) 
             {
                 mg_http_reply(c, 200, "", "{\"result\": %d}\n", 1); // send reply
-                fnSystem.reboot(500, false); // deferred exit with code 0
+                busQueue.run([]() { fnSystem.reboot(500, false); return 0; }); // deferred exit with code 0
             }
             else
             {
                 // load restart page into browser
                 send_file(c, "restart.html");
                 // keep running for a while to transfer restart.html page
-                fnSystem.reboot(500, true); // deferred exit with code 75 -> should be started again
+                busQueue.run([]() { fnSystem.reboot(500, true); return 0; }); // deferred exit with code 75 -> should be started again
             }
         }
         else
@@ -740,7 +849,28 @@ void fnHttpService::start()
     // esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disconnect_handler, &(state.hServer));
 
     // Go ahead and attempt starting the server for the first time
-    start_server(state);
+    if (start_server(state) != nullptr)
+    {
+        _running = true;
+        _stopped = false;
+        _thread = std::thread(&fnHttpService::_service_loop, this);
+    }
+}
+
+// Web server thread
+void fnHttpService::_service_loop()
+{
+    Debug_println("Web server thread started");
+    fnTracer.set_thread_name("web");
+    fnRealtime::normal_priority();
+    while (_running)
+    {
+        // do not sleep while file downloads are in progress
+        bool idle = _tasks.service();
+        mg_mgr_poll(state.hServer, idle ? FNWS_POLL_MS : 0);
+    }
+    Debug_println("Web server thread stopped");
+    _stopped = true;
 }
 
 void fnHttpService::stop()
@@ -748,15 +878,18 @@ void fnHttpService::stop()
     if (state.hServer != nullptr)
     {
         Debug_println("Stopping web service");
+        _running = false;
+        // web server thread may be waiting for the bus, keep serving commands until it exits
+        while (!_stopped)
+        {
+            busQueue.service();
+            fnSystem.delay(1);
+        }
+        if (_thread.joinable())
+            _thread.join();
         // httpd_stop(state.hServer);
         mg_mgr_free(state.hServer);
         state._FS = nullptr;
         state.hServer = nullptr;
     }
 }
-
-void fnHttpService::service()
-{
-    if (state.hServer != nullptr)
-        mg_mgr_poll(state.hServer, 0);
-}
@@ -9,6 +9,8 @@ URI: "/" - Forces loading/parsing (see below) of /<FNWS_FILE_ROOT>/index.html
 URI: "/file?<filename>" - Sends static file /<FNWS_FILE_ROOT>/<filename>
 URI: "/favico.ico" - Sends /<FNWS_FILE_ROOT>/favico.ico
 URI: "/print" - Sends current printer output to user
+URI: "/metrics" - Sends bus metrics (command latency histograms, error counters) in Prometheus text format
+URI: "/trace" - Starts/stops timeline tracing, sends the trace as Chrome trace-event JSON
 
 MIME types are assigned based on file extention.  See/update
     static std::map<string, string> mime_map
@@ -34,8 +36,12 @@ If a file has an extention pre-determined to support parsing (see/update
 
 // #include <map>
 #include "string"
+#include <thread>
+#include <atomic>
+#include <functional>
 
 #include "fnFS.h"
+#include "fnTaskManager.h"
 
 // FNWS_FILE_ROOT should end in a slash '/'
 #define FNWS_FILE_ROOT "/www/"
@@ -48,6 +54,7 @@ If a file has an extention pre-determined to support parsing (see/update
 #define MSG_ERR_RECEIVE_FAILURE  "Failed to receive posted data"
 
 #define PRINTER_BUSY_TIME 2000 // milliseconds to wait until printer is done
+#define FNWS_POLL_MS 50 // web server thread poll interval
 
 class fnHttpService 
 {
@@ -89,9 +96,18 @@ class fnHttpService
     static void send_file(struct mg_connection *c, const char *filename);
     // static void parse_query(httpd_req_t *req, queryparts *results);
     static int redirect_or_result(mg_connection *c, mg_http_message *hm, int result);
+    // execute handler on the bus thread and publish updated state
+    static int run_on_bus(std::function<int()> handler);
 
     friend class fnHttpServiceBrowser; // allow browser to call above functions
 
+    // web server runs on its own thread, anything touching the bus goes through busQueue
+    std::thread _thread;
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _stopped{true};
+    fnTaskManager _tasks; // tasks serviced by web server thread (file downloads)
+    void _service_loop();
+
 public:    
 
     std::string errMsg; 
@@ -111,6 +127,9 @@ public:
     static int get_handler_swap(struct mg_connection *c, struct mg_http_message *hm);
     static int get_handler_mount(struct mg_connection *c, struct mg_http_message *hm);
     static int get_handler_eject(mg_connection *c, mg_http_message *hm);
+    static int get_handler_overlay(mg_connection *c, mg_http_message *hm);
+    static int get_handler_metrics(struct mg_connection *c);
+    static int get_handler_trace(struct mg_connection *c, struct mg_http_message *hm);
 
     // static esp_err_t post_handler_config(httpd_req_t *req);
     static int post_handler_config(struct mg_connection *c, struct mg_http_message *hm);
@@ -120,7 +139,7 @@ public:
     
     void start();
     void stop();
-    void service();
+    int submit_task(fnTask *t) { return _tasks.submit_task(t); }
     bool running(void) {
         return state.hServer != nullptr;
     }
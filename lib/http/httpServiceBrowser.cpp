@@ -7,8 +7,8 @@
 #include "fnFsTNFS.h"
 #include "fnFsSMB.h"
 #include "fnFsFTP.h"
-#include "fnTaskManager.h"
 #include "fnConfig.h"
+#include "fujiSnapshot.h"
 
 #include "debug.h"
 
@@ -134,6 +134,86 @@ int fnHttpServiceBrowser::browse_html_escape(const char *src, size_t src_len, ch
 }
 
 
+int fnHttpServiceBrowser::browse_mount_action(const char *action, int slot, int drive_slot, const char *path, fnConfig::mount_mode_t mount_mode)
+{
+    if (strcmp(action, "newmount") == 0)
+    {
+        // mount image to drive slot
+        if (drive_slot >=0 && drive_slot < MAX_DISK_DEVICES)
+        {
+            // update config
+            Config.store_mount(drive_slot, slot, path, mount_mode);
+            Config.save();
+
+#ifdef BUILD_ATARI // OS
+            // umount current image, if any - close image file, reset drive slot
+            theFuji.sio_disk_image_umount(false, drive_slot);
+#endif
+
+            // update drive slot
+            fujiDisk &fnDisk = *theFuji.get_disks(drive_slot);
+            fnDisk.host_slot = slot;
+            fnDisk.access_mode = (mount_mode == fnConfig::MOUNTMODE_WRITE) ? DISK_ACCESS_MODE_WRITE : DISK_ACCESS_MODE_READ;
+            strlcpy(fnDisk.filename, path, sizeof(fnDisk.filename));
+
+#ifdef BUILD_ATARI // OS
+            // mount host (file system)
+            if (theFuji.sio_mount_host(false, slot) == 0)
+            {
+                // mount disk image
+                theFuji.sio_disk_image_mount(false, drive_slot);
+            }
+#endif
+        }
+    }
+    else if (strcmp(action, "mount") == 0)
+    {
+        if (drive_slot >=0 && drive_slot < MAX_DISK_DEVICES)
+        {
+#ifdef BUILD_ATARI // OS
+            // mount host (file system)
+            if (theFuji.sio_mount_host(false, theFuji.get_disks(drive_slot)->host_slot) == 0)
+            {
+                // mount disk image
+                theFuji.sio_disk_image_mount(false, drive_slot);
+            }
+#endif
+        }
+    }
+    else if (strcmp(action, "eject") == 0)
+    {
+        // umount image from drive slot
+        if (drive_slot >=0 && drive_slot < MAX_DISK_DEVICES)
+        {
+            Config.clear_mount(drive_slot);
+            Config.save();
+#ifdef BUILD_ATARI // OS
+            theFuji.sio_disk_image_umount(false, drive_slot);
+#endif
+            // Finally, scan all device slots, if all empty, and config enabled, enable the config device.
+            if (Config.get_general_config_enabled())
+            {
+                if ((theFuji.get_disks(0)->host_slot == 0xFF) &&
+                    (theFuji.get_disks(1)->host_slot == 0xFF) &&
+                    (theFuji.get_disks(2)->host_slot == 0xFF) &&
+                    (theFuji.get_disks(3)->host_slot == 0xFF) &&
+                    (theFuji.get_disks(4)->host_slot == 0xFF) &&
+                    (theFuji.get_disks(5)->host_slot == 0xFF) &&
+                    (theFuji.get_disks(6)->host_slot == 0xFF) &&
+                    (theFuji.get_disks(7)->host_slot == 0xFF))
+                {
+                    theFuji.boot_config = true;
+        #ifdef BUILD_ATARI
+                    theFuji.status_wait_count = 5;
+        #endif
+                    theFuji.device_active = true;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
 int fnHttpServiceBrowser::browse_listdir(mg_connection *c, mg_http_message *hm, FileSystem *fs, int slot, const char *host_path, unsigned pathlen)
 {
     char path[256];
@@ -187,80 +267,12 @@ int fnHttpServiceBrowser::browse_listdir(mg_connection *c, mg_http_message *hm,
         fnConfig::mount_mode_t mount_mode = (mode_str[0] == 'w' && mode_str[1] == '\0') \
             ? fnConfig::MOUNTMODE_WRITE : fnConfig::MOUNTMODE_READ;
 
-        if (strcmp(action, "newmount") == 0)
-        {
-            // mount image to drive slot
-            if (drive_slot >=0 && drive_slot < MAX_DISK_DEVICES)
-            {
-                // update config
-                Config.store_mount(drive_slot, slot, path, mount_mode);
-                Config.save();
-
-#ifdef BUILD_ATARI // OS
-                // umount current image, if any - close image file, reset drive slot
-                theFuji.sio_disk_image_umount(false, drive_slot);
-#endif
-
-                // update drive slot
-                fujiDisk &fnDisk = *theFuji.get_disks(drive_slot);
-                fnDisk.host_slot = slot;
-                fnDisk.access_mode = (mount_mode == fnConfig::MOUNTMODE_WRITE) ? DISK_ACCESS_MODE_WRITE : DISK_ACCESS_MODE_READ;
-                strlcpy(fnDisk.filename, path, sizeof(fnDisk.filename));
-
-#ifdef BUILD_ATARI // OS
-                // mount host (file system)
-                if (theFuji.sio_mount_host(false, slot) == 0)
-                {
-                    // mount disk image
-                    theFuji.sio_disk_image_mount(false, drive_slot);
-                }
-#endif
-            }
-        }
-        else if (strcmp(action, "mount") == 0)
+        if (strcmp(action, "newmount") == 0 || strcmp(action, "mount") == 0 || strcmp(action, "eject") == 0)
         {
-            if (drive_slot >=0 && drive_slot < MAX_DISK_DEVICES)
-            {
-#ifdef BUILD_ATARI // OS
-                // mount host (file system)
-                if (theFuji.sio_mount_host(false, theFuji.get_disks(drive_slot)->host_slot) == 0)
-                {
-                    // mount disk image
-                    theFuji.sio_disk_image_mount(false, drive_slot);
-                }
-#endif
-            }
-        }
-        else if (strcmp(action, "eject") == 0)
-        {
-            // umount image from drive slot
-            if (drive_slot >=0 && drive_slot < MAX_DISK_DEVICES)
-            {
-                Config.clear_mount(drive_slot);
-                Config.save();
-#ifdef BUILD_ATARI // OS
-                theFuji.sio_disk_image_umount(false, drive_slot);
-#endif
-                // Finally, scan all device slots, if all empty, and config enabled, enable the config device.
-                if (Config.get_general_config_enabled())
-                {
-                    if ((theFuji.get_disks(0)->host_slot == 0xFF) &&
-                        (theFuji.get_disks(1)->host_slot == 0xFF) &&
-                        (theFuji.get_disks(2)->host_slot == 0xFF) &&
-                        (theFuji.get_disks(3)->host_slot == 0xFF) &&
-                        (theFuji.get_disks(4)->host_slot == 0xFF) &&
-                        (theFuji.get_disks(5)->host_slot == 0xFF) &&
-                        (theFuji.get_disks(6)->host_slot == 0xFF) &&
-                        (theFuji.get_disks(7)->host_slot == 0xFF))
-                    {
-                        theFuji.boot_config = true;
-            #ifdef BUILD_ATARI
-                        theFuji.status_wait_count = 5;
-            #endif
-                        theFuji.device_active = true;
-                    }
-                }
-            }
+            // drive slots are owned by the bus, change them on the bus thread
+            fnHttpService::run_on_bus([&]() {
+                return browse_mount_action(action, slot, drive_slot, path, mount_mode);
+            });
         }
         else if (strcmp(action, "download") == 0)
         {
@@ -330,21 +342,23 @@ int fnHttpServiceBrowser::browse_listdrives(mg_connection *c, int slot, const ch
         "<tr><th>Slot</th><th>Action</th><th>Current disk image (Mode)</th></tr>"
         "<tr><td colspan=\"3\"><hr></td></tr></thead><tbody>");
 
-    // list drive slots
+    // list drive slots, as published by the bus thread
+    fujiSnapshotData snap;
+    fujiState.read(snap);
     char disk_id;
     char slot_disk[10]; // "(Dn:)"
     int host_slot;
     bool is_mounted;
     for(int drive_slot = 0; drive_slot < MAX_DISK_DEVICES; drive_slot++)
     {
-        disk_id = (char) theFuji.get_disk_id(drive_slot);
+        disk_id = snap.disks[drive_slot].disk_id;
         // "(Dn:)" if any rotation has occurred
         if (disk_id != (char) (0x31 + drive_slot))
             snprintf(slot_disk, sizeof slot_disk, " (D%c:)", disk_id);
         else
             *slot_disk = '\0';
-        host_slot = Config.get_mount_host_slot(drive_slot);
-        is_mounted = (theFuji.get_disks(drive_slot)->fileh != nullptr);
+        host_slot = snap.disks[drive_slot].host_slot;
+        is_mounted = snap.disks[drive_slot].mounted;
         mg_http_printf_chunk(c, "<tr>"
                 "<td>Drive Slot %d%s</td>"
                 "<td><a title=\"Mount Read-Only\" href=\"?action=newmount&slot=%d&mode=r\">[ R ]</a>"
@@ -362,10 +376,10 @@ int fnHttpServiceBrowser::browse_listdrives(mg_connection *c, int slot, const ch
             (host_slot == HOST_SLOT_INVALID) ? "-" : is_mounted ? "E" : "M",
             // From what host is each disk mounted on and what disk is mounted - TODO escape host and path
             (host_slot == HOST_SLOT_INVALID) ? "" :
-                (Config.get_host_name(host_slot) + " :: "+ Config.get_mount_path(drive_slot)).c_str(),
+                (std::string(snap.hosts[host_slot].hostname) + " :: " + snap.disks[drive_slot].path).c_str(),
             // Mount mode: R / W or "Empty" for empty slot
             (host_slot == HOST_SLOT_INVALID) ? "Empty" :
-                Config.get_mount_mode(drive_slot) == fnConfig::mount_modes::MOUNTMODE_READ ? 
+                snap.disks[drive_slot].read_only ? 
                     (is_mounted ? "R" : "R-") : (is_mounted ? "W" : "W-")
         );
     }
@@ -400,8 +414,10 @@ void fnHttpServiceBrowser::print_navi(mg_connection *c, int slot, const char *es
     const char *p2_esc;
     const char *p_enc = enc_path;
 
+    fujiSnapshotData snap;
+    fujiState.read(snap);
     mg_http_printf_chunk(c,
-        "<h2><a href=\"/browse/host/%d\">%s</a>:", slot+1, theFuji.get_hosts(slot)->get_hostname()); // TODO escape hostname
+        "<h2><a href=\"/browse/host/%d\">%s</a>:", slot+1, snap.hosts[slot].hostname); // TODO escape hostname
 
     for(;;)
     {
@@ -503,21 +519,26 @@ int fnHttpServiceBrowser::browse_sendfile(mg_connection *c, FileSystem *fs, File
         fh->close();
         return -1;
     }
-    return (taskMgr.submit_task(task) > 0) ? 1 : 0; // 1 -> do not delete the file system, if task was submitted
+    return (fnHTTPD.submit_task(task) > 0) ? 1 : 0; // 1 -> do not delete the file system, if task was submitted
 }
 
 
 int fnHttpServiceBrowser::process_browse_get(mg_connection *c, mg_http_message *hm, int host_slot, const char *host_path, unsigned pathlen)
 {
-    fujiHost &fnHost = *theFuji.get_hosts(host_slot);
     FileSystem *fs;
     int host_type;
     bool started = false;
 
-    Debug_printf("Browse host %d (%s)\n", host_slot, fnHost.get_hostname());
-
+    // Runs on web server thread: only the host name is taken from the snapshot
+    // published by the bus thread, listing and download go through temporary
+    // File System below with its own host connection, fujiHost objects and
+    // their sessions are never touched from here
+    fujiSnapshotData snap;
+    fujiState.read(snap);
     char hostname[MAX_HOSTNAME_LEN];
-    fnHost.get_hostname(hostname, MAX_HOSTNAME_LEN);
+    strlcpy(hostname, snap.hosts[host_slot].hostname, sizeof(hostname));
+
+    Debug_printf("Browse host %d (%s)\n", host_slot, hostname);
 
     if (hostname[0] == '\0')
     {
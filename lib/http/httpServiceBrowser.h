@@ -3,12 +3,14 @@
 
 #include "fnFS.h"
 #include "mongoose.h"
+#include "fnConfig.h"
 
 class fnHttpServiceBrowser
 {
     static int browse_url_encode(const char *src, size_t src_len, char *dst, size_t dst_len);
     static int browse_html_escape(const char *src, size_t src_len, char *dst, size_t dst_len);
 
+    static int browse_mount_action(const char *action, int slot, int drive_slot, const char *path, fnConfig::mount_mode_t mount_mode);
     static int browse_listdir(mg_connection *c, mg_http_message *hm, FileSystem *pFS, int slot, const char *host_path, unsigned pathlen);
     static int browse_listdrives(mg_connection *c, int slot, const char *esc_path, const char *enc_path);
     static void print_head(mg_connection *c, int slot);
@@ -7,6 +7,7 @@
 
 #include "fnSystem.h"
 #include "fnConfig.h"
+#include "fnLog.h"
 #include "bus.h"
 
 #include "utils.h"
@@ -141,6 +142,19 @@ void fnHttpServiceConfigurator::config_hsio(std::string hsioindex)
 #endif /* BUILD_ATARI */
 }
 
+void fnHttpServiceConfigurator::config_hsio_auto(std::string hsio_auto)
+{
+#ifdef BUILD_ATARI
+    Debug_printf("New HSIO auto value: %s\n", hsio_auto.c_str());
+
+    bool enable = util_string_value_is_true(hsio_auto);
+    SIO.setHighSpeedAuto(enable);
+    // Store our change in Config
+    Config.store_general_hsio_auto(enable);
+    Config.save();
+#endif /* BUILD_ATARI */
+}
+
 
 void fnHttpServiceConfigurator::config_timezone(std::string timezone)
 {
@@ -446,6 +460,33 @@ void fnHttpServiceConfigurator::config_cpm_ccp(std::string cpm_ccp)
     Config.save();
 }
 
+// Change debug log level and/or subsystem filter, takes effect immediately
+void fnHttpServiceConfigurator::config_log(std::string log_level, std::string log_filter)
+{
+    Debug_printf("Set Log: %s,%s\n", log_level.c_str(), log_filter.c_str());
+
+    if (!log_level.empty())
+    {
+        fnLogLevel level = fnLog::level_from_string(log_level.c_str());
+        if (level == LOG_LEVEL_INVALID)
+        {
+            Debug_printf("Invalid log level: %s\n", log_level.c_str());
+            return;
+        }
+        fnLogger.set_level(level);
+        Config.store_general_log_level(fnLog::level_name(level));
+    }
+    else
+    {
+        // "-" clears the filter, empty field never gets here
+        if (log_filter == "-")
+            log_filter.clear();
+        fnLogger.set_filter(log_filter);
+        Config.store_general_log_filter(log_filter.c_str());
+    }
+    Config.save();
+}
+
 void fnHttpServiceConfigurator::config_serial(std::string port, std::string command, std::string proceed)
 {
     Debug_printf("Set Serial: %s,%s,%s\n", port.c_str(), command.c_str(), proceed.c_str());
@@ -564,6 +605,10 @@ int fnHttpServiceConfigurator::process_config_post(const char *postdata, size_t
         {
             config_hsio(i->second);
         }
+        else if (i->first.compare("hsio_auto") == 0)
+        {
+            config_hsio_auto(i->second);
+        }
         else if (i->first.compare("timezone") == 0)
         {
             config_timezone(i->second);
@@ -648,6 +693,14 @@ int fnHttpServiceConfigurator::process_config_post(const char *postdata, size_t
         {
             config_serial(std::string(), std::string(), i->second);
         }
+        else if (i->first.compare("log_level") == 0)
+        {
+            config_log(i->second, std::string());
+        }
+        else if (i->first.compare("log_filter") == 0)
+        {
+            config_log(std::string(), i->second);
+        }
         else if (i->first.compare("netsio_enable") == 0)
         {
             str_netsio_enable = i->second;
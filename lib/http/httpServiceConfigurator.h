@@ -14,6 +14,7 @@ class fnHttpServiceConfigurator
     static void config_printer_model(std::string printernumber, std::string printerport);
     static void config_printer_port(std::string printernumber, std::string printerport);
     static void config_hsio(std::string hsio_index);
+    static void config_hsio_auto(std::string hsio_auto);
     static void config_timezone(std::string timezone);
     static void config_hostname(std::string hostname);
     static void config_udpstream(std::string host_ip);
@@ -34,6 +35,7 @@ class fnHttpServiceConfigurator
     static void config_cpm_ccp(std::string cpm_ccp);
 
     static void config_serial(std::string port, std::string command, std::string proceed);
+    static void config_log(std::string log_level, std::string log_filter);
     static void config_netsio(std::string enable_netsio, std::string netsio_host_port);
 
 public:
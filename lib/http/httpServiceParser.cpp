@@ -12,11 +12,15 @@
 
 #include "fnSystem.h"
 #include "fnConfig.h"
+#include "fnTrace.h"
+#include "fnRealtime.h"
+#include "fnEventLoop.h"
 #include "fnWiFi.h"
 #include "fsFlash.h"
 #include "fnFsSD.h"
 #include "httpService.h"
 #include "fuji.h"
+#include "fujiSnapshot.h"
 
 using namespace std;
 
@@ -53,6 +57,10 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
         FN_SYSSDK,
         FN_SYSCPUREV,
         FN_BUSVOLTS,
+        FN_DELAY_STATS,
+        FN_TRACE,
+        FN_REALTIME,
+        FN_SCHED_LATENCY,
         FN_SIO_HSINDEX,
         FN_SIO_HSBAUD,
         FN_PRINTER1_MODEL,
@@ -62,6 +70,8 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
         FN_CASSETTE_ENABLED,
         FN_CONFIG_ENABLED,
         FN_STATUS_WAIT_ENABLED,
+        FN_HSIO_AUTO,
+        FN_HSIO_LINK_STATS,
         FN_BOOT_MODE,
         FN_PRINTER_ENABLED,
         FN_MODEM_ENABLED,
@@ -112,6 +122,14 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
         FN_DRIVE6DEVICE,
         FN_DRIVE7DEVICE,
         FN_DRIVE8DEVICE,
+        FN_DRIVE1OVERLAY,
+        FN_DRIVE2OVERLAY,
+        FN_DRIVE3OVERLAY,
+        FN_DRIVE4OVERLAY,
+        FN_DRIVE5OVERLAY,
+        FN_DRIVE6OVERLAY,
+        FN_DRIVE7OVERLAY,
+        FN_DRIVE8OVERLAY,
         FN_HOST1PREFIX,
         FN_HOST2PREFIX,
         FN_HOST3PREFIX,
@@ -159,6 +177,10 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
         "FN_SYSSDK",
         "FN_SYSCPUREV",
         "FN_BUSVOLTS",
+        "FN_DELAY_STATS",
+        "FN_TRACE",
+        "FN_REALTIME",
+        "FN_SCHED_LATENCY",
         "FN_SIO_HSINDEX",
         "FN_SIO_HSBAUD",
         "FN_PRINTER1_MODEL",
@@ -168,6 +190,8 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
         "FN_CASSETTE_ENABLED",
         "FN_CONFIG_ENABLED",
         "FN_STATUS_WAIT_ENABLED",
+        "FN_HSIO_AUTO",
+        "FN_HSIO_LINK_STATS",
         "FN_BOOT_MODE",
         "FN_PRINTER_ENABLED",
         "FN_MODEM_ENABLED",
@@ -218,6 +242,14 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
         "FN_DRIVE6DEVICE",
         "FN_DRIVE7DEVICE",
         "FN_DRIVE8DEVICE",
+        "FN_DRIVE1OVERLAY",
+        "FN_DRIVE2OVERLAY",
+        "FN_DRIVE3OVERLAY",
+        "FN_DRIVE4OVERLAY",
+        "FN_DRIVE5OVERLAY",
+        "FN_DRIVE6OVERLAY",
+        "FN_DRIVE7OVERLAY",
+        "FN_DRIVE8OVERLAY",
         "FN_HOST1PREFIX",
         "FN_HOST2PREFIX",
         "FN_HOST3PREFIX",
@@ -254,6 +286,10 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
     char disk_id;
     int hsioindex;
 
+    // slot and bus state published by the bus thread
+    fujiSnapshotData snap;
+    fujiState.read(snap);
+
     // Provide a replacement value
     switch (tagid)
     {
@@ -348,19 +384,73 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
     case FN_BUSVOLTS:
         resultstream << ((float)fnSystem.get_sio_voltage()) / 1000.00 << "V";
         break;
+    case FN_DELAY_STATS:
+        {
+            delay_stats_t stats;
+            fnSystem.get_delay_stats(stats);
+            resultstream << "avg " << stats.avg_ns / 1000 << " &micro;s, max " << stats.max_ns / 1000
+                         << " &micro;s (" << stats.count << " delays)";
+        }
+        break;
+    case FN_TRACE:
+        if (fnTracer.enabled())
+            resultstream << "on, " << fnTracer.event_count() << " events";
+        else
+            resultstream << "off";
+        break;
+    case FN_REALTIME:
+        resultstream << realtimeProfile.status();
+        break;
+    case FN_SCHED_LATENCY:
+        {
+            fnHistogram &probe = realtimeProfile.probe();
+            if (probe.count() > 0)
+                resultstream << "startup p50 " << probe.quantile(0.5) << " / p99 " << probe.quantile(0.99)
+                             << " / max " << probe.quantile(1.0) << " &micro;s, ";
+            fnHistogram &wake = eventLoop.wake_latency();
+            resultstream << "main loop p50 " << wake.quantile(0.5) << " / p99 " << wake.quantile(0.99)
+                         << " / max " << wake.quantile(1.0) << " &micro;s (" << wake.count() << " wakeups)";
+        }
+        break;
 #ifdef BUILD_ATARI
     case FN_SIO_HSINDEX:
-        resultstream << SIO.getHighSpeedIndex();
+        resultstream << snap.hsio_index;
         break;
     case FN_SIO_HSTEXT:
-        hsioindex = SIO.getHighSpeedIndex();
+        hsioindex = snap.hsio_index;
         if (hsioindex == HSIO_DISABLED_INDEX)
             resultstream << "HSIO Disabled";
         else
             resultstream << hsioindex;
         break;
     case FN_SIO_HSBAUD:
-        resultstream << SIO.getHighSpeedBaud();
+        resultstream << snap.hsio_baud;
+        break;
+    case FN_HSIO_AUTO:
+        resultstream << Config.get_general_hsio_auto();
+        break;
+    case FN_HSIO_LINK_STATS:
+        {
+            // frames, error rate and NAKs of every speed used so far
+            bool any = false;
+            for (int i = 0; i < HSIO_TUNER_SLOTS; i++)
+            {
+                hsio_link_stats &s = snap.hsio_stats[i];
+                if (s.frames == 0 && s.errors == 0)
+                    continue;
+                if (any)
+                    resultstream << "<br>";
+                any = true;
+                char buf[100];
+                snprintf(buf, sizeof(buf), "%s%d: %u frames, %.2f%% errors, %u NAKs",
+                         i == HSIO_TUNER_STANDARD_SLOT ? "" : "index ",
+                         i == HSIO_TUNER_STANDARD_SLOT ? SIO_STANDARD_BAUDRATE : i, s.frames,
+                         100.0 * s.errors / (s.frames + s.errors), s.naks);
+                resultstream << buf;
+            }
+            if (!any)
+                resultstream << "no data";
+        }
         break;
 #endif /* BUILD_ATARI */
     case FN_SERIAL_PORT:
@@ -410,13 +500,13 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
         break;
 #ifdef BUILD_ATARI
     case FN_PLAY_RECORD:
-        if (theFuji.cassette()->get_buttons())
+        if (snap.cassette_play)
             resultstream << "0 PLAY";
         else
             resultstream << "1 RECORD";
         break;
     case FN_PULLDOWN:
-        if (theFuji.cassette()->has_pulldown())
+        if (snap.cassette_pulldown)
             resultstream << "1 Pulldown Resistor";
         else
             resultstream << "0 B Button Press";
@@ -461,9 +551,9 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
     case FN_DRIVE8HOST:
         /* From what host is each disk is mounted on each Drive Slot? */
         drive_slot = tagid - FN_DRIVE1HOST;
-        host_slot = Config.get_mount_host_slot(drive_slot);
+        host_slot = snap.disks[drive_slot].host_slot;
         if (host_slot != HOST_SLOT_INVALID) {
-            resultstream << Config.get_host_name(host_slot);
+            resultstream << snap.hosts[host_slot].hostname;
         } else {
             resultstream << "";
         }
@@ -478,9 +568,9 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
     case FN_DRIVE8BROWSER:
     	/* Link to browse the files */
 	    drive_slot = tagid - FN_DRIVE1BROWSER;
-	    host_slot = Config.get_mount_host_slot(drive_slot);
+	    host_slot = snap.disks[drive_slot].host_slot;
         if (host_slot != HOST_SLOT_INVALID) {
-	        resultstream << "/browse/host/" << host_slot+1 << Config.get_mount_path(drive_slot) << "?action=slotlist";
+	        resultstream << "/browse/host/" << host_slot+1 << snap.disks[drive_slot].path << "?action=slotlist";
         } else {
             resultstream << "#";
         }
@@ -495,10 +585,10 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
     case FN_DRIVE8MOUNT:
 	/* What disk is mounted on each Drive Slot (and is it read-only or read-write)? */
 	drive_slot = tagid - FN_DRIVE1MOUNT;
-	host_slot = Config.get_mount_host_slot(drive_slot);
+	host_slot = snap.disks[drive_slot].host_slot;
         if (host_slot != HOST_SLOT_INVALID) {
-	        resultstream << Config.get_mount_path(drive_slot);
-	        resultstream << " (" << (Config.get_mount_mode(drive_slot) == fnConfig::mount_modes::MOUNTMODE_READ ? "R" : "W") << ")";
+	        resultstream << snap.disks[drive_slot].path;
+	        resultstream << " (" << (snap.disks[drive_slot].read_only ? "R" : "W") << ")";
         } else {
             resultstream << "(Empty)";
         }
@@ -513,8 +603,8 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
     case FN_HOST8:
 	    /* What TNFS host is mounted on each Host Slot? */
 	    host_slot = tagid - FN_HOST1;
-        if (Config.get_host_type(host_slot) != fnConfig::host_types::HOSTTYPE_INVALID) {
-	        resultstream << Config.get_host_name(host_slot);
+        if (snap.hosts[host_slot].valid) {
+	        resultstream << snap.hosts[host_slot].hostname;
         } else {
             resultstream << "(Empty)";
         }
@@ -529,11 +619,27 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
     case FN_DRIVE8DEVICE:
         /* What Dx: drive (if any rotation has occurred) does each Drive Slot currently map to? */
         drive_slot = tagid - FN_DRIVE1DEVICE;
-        disk_id = (char) theFuji.get_disk_id(drive_slot);
+        disk_id = snap.disks[drive_slot].disk_id;
         if (disk_id > 0 && disk_id != (char) (0x31 + drive_slot)) {
             resultstream << " (D" << disk_id << ":)";
         }
         break;
+    case FN_DRIVE1OVERLAY:
+    case FN_DRIVE2OVERLAY:
+    case FN_DRIVE3OVERLAY:
+    case FN_DRIVE4OVERLAY:
+    case FN_DRIVE5OVERLAY:
+    case FN_DRIVE6OVERLAY:
+    case FN_DRIVE7OVERLAY:
+    case FN_DRIVE8OVERLAY:
+        /* Local changes of the image kept in copy-on-write overlay, with links to commit or discard them */
+        drive_slot = tagid - FN_DRIVE1OVERLAY;
+        if (snap.disks[drive_slot].overlay_blocks > 0) {
+            resultstream << " " << snap.disks[drive_slot].overlay_blocks << " changed blocks"
+                         << " <a href=\"/overlay?deviceslot=" << drive_slot << "&action=commit&redirect=1\">[COMMIT]</a>"
+                         << " <a href=\"/overlay?deviceslot=" << drive_slot << "&action=discard&redirect=1\">[DISCARD]</a>";
+        }
+        break;
     case FN_HOST1PREFIX:
     case FN_HOST2PREFIX:
     case FN_HOST3PREFIX:
@@ -545,8 +651,8 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
 	/* What directory prefix is set right now
            for the TNFS host mounted on each Host Slot? */
 	host_slot = tagid - FN_HOST1PREFIX;
-        if (Config.get_host_type(host_slot) != fnConfig::host_types::HOSTTYPE_INVALID) {
-	        resultstream << theFuji.get_host_prefix(host_slot);
+        if (snap.hosts[host_slot].valid) {
+	        resultstream << snap.hosts[host_slot].prefix;
         } else {
             resultstream << "";
         }
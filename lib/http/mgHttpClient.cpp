@@ -10,6 +10,7 @@
 #include "../../include/debug.h"
 #include "mgHttpClient.h"
 #include "fnSystem.h"
+#include "fnTrace.h"
 #include "utils.h"
 
 
@@ -644,6 +645,7 @@ void mgHttpClient::_httpevent_handler(struct mg_connection *c, int ev, void *ev_
 */
 int mgHttpClient::_perform()
 {
+    fnTraceSpan span("http", "perform");
     Debug_printf("%08lx _perform\n", (unsigned long)fnSystem.millis());
 
     // We want to process the response body (if any)
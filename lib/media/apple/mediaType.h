@@ -66,6 +66,7 @@ public:
     fujiHost *_media_host = nullptr;
     FileHandler *_media_hsfileh = nullptr;
     bool high_score_enabled = false;
+    bool _media_overlay = false;    // image is written through copy-on-write overlay
 
     // uint8_t _media_sectorbuff[DISK_SECTORBUF_SIZE];
 
@@ -84,6 +85,11 @@ public:
     // Returns TRUE if an error condition occurred
     virtual bool write(uint32_t blockNum, uint16_t *count, uint8_t* buffer) = 0;
 
+    // Write what the image file handler buffers, Returns TRUE if an error condition occurred
+    virtual bool flush() { return _media_fileh != nullptr && _media_fileh->flush() != 0; }
+    // Image content changed underneath, forget what was read from it
+    virtual void invalidate() { _media_last_sector = INVALID_SECTOR_VALUE; }
+
     // virtual uint16_t sector_size(uint16_t sectornum);
     
     virtual bool status() = 0;
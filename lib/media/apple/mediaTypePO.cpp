@@ -4,6 +4,7 @@
 
 #include <cstring>
 #include "utils.h"
+#include "fnBlockCache.h"
 #include "../../include/debug.h"
 
 bool MediaTypePO::read(uint32_t blockNum, uint16_t *count, uint8_t* buffer)
@@ -30,12 +31,16 @@ if (blockNum == 0 || blockNum != last_block_num + 1) // example optimization, on
 bool MediaTypePO::write(uint32_t blockNum, uint16_t *count, uint8_t* buffer)
 {
     size_t writesize = *count;
+    // overlay keeps writes off the image, no need to reopen it writable
+    bool hs_reopen = high_score_enabled && !_media_overlay &&
+                     blockNum >= _high_score_block_lb && blockNum <= _high_score_block_ub;
 
-    if (high_score_enabled && blockNum >= _high_score_block_lb && blockNum <= _high_score_block_ub)
+    if (hs_reopen)
     {
         Debug_printf("high score: Swapping file handles\r\n");
         oldFileh = _media_fileh;
         hsFileh = _media_host->filehandler_open(_disk_filename, _disk_filename, strlen(_disk_filename) +1, "rb+");
+        hsFileh = blockCache.wrap(hsFileh, _media_host, _disk_filename);
         _media_fileh = hsFileh;
     }
 
@@ -55,7 +60,7 @@ bool MediaTypePO::write(uint32_t blockNum, uint16_t *count, uint8_t* buffer)
        return true;
     }
 
-    if (high_score_enabled && blockNum >= _high_score_block_lb && blockNum <= _high_score_block_ub)
+    if (hs_reopen)
     {
         Debug_printf("high score: Reverting file handles.\r\n");
         if (hsFileh != nullptr)
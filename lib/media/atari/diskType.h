@@ -82,6 +82,7 @@ public:
 
     fujiHost *_disk_host = nullptr;
     // FILE *_disk_hsfileh = nullptr;
+    bool _disk_overlay = false;     // image is written through copy-on-write overlay
 
     mediatype_t _disktype = MEDIATYPE_UNKNOWN;
     bool _allow_hsio = true;
@@ -97,6 +98,20 @@ public:
     // Returns TRUE if an error condition occurred
     virtual bool write(uint16_t sectornum, bool verify);
 
+    // Returns TRUE if read() of the sector will not touch the backend
+    virtual bool cached(uint16_t sectornum) { return false; }
+
+    // Returns TRUE if read() sleeps to emulate drive mechanics, it must not run on bus thread
+    virtual bool emulates_timing() { return false; }
+
+    // Write sectors held in write-back cache to the image, wait = block until done
+    // Returns TRUE if an error condition occurred
+    virtual bool flush(bool wait) { return false; }
+    // When flush(false) is due (fnSystem.millis() based), 0 = nothing to flush
+    virtual uint64_t flush_deadline() { return 0; }
+    // Image content changed underneath, forget what was read from it
+    virtual void invalidate() { _disk_last_sector = INVALID_SECTOR_VALUE; }
+
     // Always returns 128 for the first 3 sectors, otherwise _sectorSize
     virtual uint16_t sector_size(uint16_t sectornum);
     
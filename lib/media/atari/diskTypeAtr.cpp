@@ -6,11 +6,19 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#if defined(_WIN32)
+#include <io.h>     // for _commit
+#endif
 
 #include "../../include/debug.h"
 
 #include "disk.h"
 #include "fnSystem.h"
+#include "fnTrace.h"
+#include "fnMetrics.h"
+#include "fnConfig.h"
+#include "fnFsSD.h"
+#include "fnBlockCache.h"
 
 #include "utils.h"
 
@@ -54,6 +62,8 @@ uint32_t MediaTypeATR::_sector_to_offset(uint16_t sectorNum)
 // Returns TRUE if an error condition occurred
 bool MediaTypeATR::read(uint16_t sectornum, uint16_t *readcount)
 {
+    fnTraceSpan span("media", "read");
+    span.arg("sector", sectornum);
     Debug_printf("ATR READ %d / %d\r\n", sectornum, _disk_num_sectors);
 
     *readcount = 0;
@@ -69,6 +79,29 @@ bool MediaTypeATR::read(uint16_t sectornum, uint16_t *readcount)
 
     memset(_disk_sectorbuff, 0, sizeof(_disk_sectorbuff));
 
+    // written sectors not in the image yet
+    if (_wb_lookup(sectornum, sectorSize))
+    {
+        *readcount = sectorSize;
+        if (_ra_enabled)
+            _ra_schedule(sectornum);
+        return false;
+    }
+
+    if (_ra_enabled)
+    {
+        bool hit = _ra_lookup(sectornum, sectorSize);
+        busMetrics.disk_readahead(hit);
+        if (hit)
+        {
+            *readcount = sectorSize;
+            _ra_schedule(sectornum);
+            return false;
+        }
+    }
+    // file handle must not be shared with job in flight
+    _io_sync();
+
     bool err = false;
     // Perform a seek if we're not reading the sector after the last one we read
     if (sectornum != _disk_last_sector + 1)
@@ -87,9 +120,376 @@ bool MediaTypeATR::read(uint16_t sectornum, uint16_t *readcount)
 
     *readcount = sectorSize;
 
+    if (_ra_enabled && !err)
+        _ra_schedule(sectornum);
+
     return err;
 }
 
+// Wait for job in flight and take over its result
+void MediaTypeATR::_io_sync()
+{
+    if (_io_job == nullptr)
+        return;
+
+    _io_job->wait();
+    bool ok = _io_job->result() != 0;
+    _io_job = nullptr;
+    _disk_last_sector = INVALID_SECTOR_VALUE; // job moved file position
+
+    if (_io_kind == IO_FLUSH)
+        _wb_collect(ok);
+    else
+        _ra_collect(ok);
+}
+
+// Add fetched sectors to the cache
+void MediaTypeATR::_ra_collect(bool ok)
+{
+    if (!ok)
+        return;
+
+    busMetrics.disk_readahead_fetch(_ra_fetch_count);
+
+    // keep unread rest of current block if the fetched one follows it
+    uint16_t keep = _ra_last_read + 1;
+    if (_ra_count > 0 && _ra_fetch_first == _ra_first + _ra_count && keep >= _ra_first && keep < _ra_fetch_first)
+    {
+        uint32_t off = _sector_to_offset(keep) - _sector_to_offset(_ra_first);
+        _ra_buf.erase(_ra_buf.begin(), _ra_buf.begin() + off);
+        _ra_buf.insert(_ra_buf.end(), _ra_fetch_buf.begin(), _ra_fetch_buf.end());
+        _ra_count = _ra_fetch_first + _ra_fetch_count - keep;
+        _ra_first = keep;
+    }
+    else
+    {
+        _ra_buf.swap(_ra_fetch_buf);
+        _ra_first = _ra_fetch_first;
+        _ra_count = _ra_fetch_count;
+    }
+    _ra_used = 0;
+}
+
+// Drop cached sectors, after job in flight is done
+void MediaTypeATR::_ra_invalidate()
+{
+    _io_sync();
+    _ra_count = 0;
+    _ra_used = 0;
+}
+
+// Copy sector from cache into sector buffer, false if not cached
+bool MediaTypeATR::_ra_lookup(uint16_t sectornum, uint16_t sectorSize)
+{
+    // collect finished job, wait for fetch only if it brings the sector we need
+    if (_io_job != nullptr &&
+        (_io_job->done() ||
+         (_io_kind == IO_READAHEAD && sectornum >= _ra_fetch_first && sectornum < _ra_fetch_first + _ra_fetch_count)))
+        _io_sync();
+
+    if (_ra_count == 0 || sectornum < _ra_first || sectornum >= _ra_first + _ra_count)
+        return false;
+
+    uint32_t off = _sector_to_offset(sectornum) - _sector_to_offset(_ra_first);
+    memcpy(_disk_sectorbuff, _ra_buf.data() + off, sectorSize);
+    _ra_used++;
+    return true;
+}
+
+// Track sequential reads, adapt window and start fetching next block when needed
+void MediaTypeATR::_ra_schedule(uint16_t sectornum)
+{
+    bool in_cache = _ra_count > 0 && sectornum >= _ra_first && sectornum < _ra_first + _ra_count;
+
+    if (sectornum == _ra_last_read + 1)
+        _ra_run++;
+    else
+    {
+        // sequence broke, most of the block was fetched in vain
+        uint16_t unused = _ra_count > _ra_used ? _ra_count - _ra_used : 0;
+        if (_ra_run >= ATR_READAHEAD_TRIGGER && unused > _ra_count / 2 && _ra_window > ATR_READAHEAD_MIN)
+            _ra_window /= 2;
+        _ra_run = 0;
+    }
+    _ra_last_read = sectornum;
+
+    if (_ra_run < ATR_READAHEAD_TRIGGER || _io_job != nullptr)
+        return;
+
+    // continue after cached block, refill when half of the window is left
+    uint32_t next = in_cache ? _ra_first + _ra_count : sectornum + 1;
+    if (next - sectornum - 1 >= _ra_window / 2u || next > _disk_num_sectors)
+        return;
+
+    // sequence goes on past previous block, fetch more at once
+    if (_ra_run > ATR_READAHEAD_TRIGGER && _ra_window < ATR_READAHEAD_MAX)
+        _ra_window *= 2;
+
+    uint32_t count = _disk_num_sectors - next + 1;
+    if (count > _ra_window)
+        count = _ra_window;
+    uint16_t last = next + count - 1;
+
+    _ra_fetch_first = next;
+    _ra_fetch_count = count;
+    _ra_fetch_buf.resize(_sector_to_offset(last) + sector_size(last) - _sector_to_offset(next));
+    _io_kind = IO_READAHEAD;
+    _io_job = workerPool.submit([this]() { return _ra_fetch(); });
+}
+
+// Worker: read the whole block with single backend request, returns 1 on success
+int MediaTypeATR::_ra_fetch()
+{
+    fnTraceSpan span("media", "readahead");
+    span.arg("sector", _ra_fetch_first);
+    span.arg("count", _ra_fetch_count);
+
+    if (_disk_fileh->seek(_sector_to_offset(_ra_fetch_first), SEEK_SET) != 0)
+        return 0;
+    size_t len = _ra_fetch_buf.size();
+    return _disk_fileh->read(_ra_fetch_buf.data(), 1, len) == len ? 1 : 0;
+}
+
+bool MediaTypeATR::cached(uint16_t sectornum)
+{
+    if (_io_job != nullptr && _io_job->done())
+        _io_sync();
+    if (_wb_dirty.count(sectornum) || _wb_flushing.count(sectornum))
+        return true;
+    if (!_ra_enabled)
+        return false;
+    return _ra_count > 0 && sectornum >= _ra_first && sectornum < _ra_first + _ra_count;
+}
+
+// Copy written sector not flushed yet into sector buffer, false if there is none
+bool MediaTypeATR::_wb_lookup(uint16_t sectornum, uint16_t sectorSize)
+{
+    auto it = _wb_dirty.find(sectornum);
+    if (it == _wb_dirty.end())
+    {
+        it = _wb_flushing.find(sectornum);
+        if (it == _wb_flushing.end())
+            return false;
+    }
+    memcpy(_disk_sectorbuff, it->second.data(), sectorSize);
+    return true;
+}
+
+// Start writing cached sectors in background, with wait it returns after they are written
+// Returns TRUE if (last) flush failed
+bool MediaTypeATR::flush(bool wait)
+{
+    if (_io_job != nullptr)
+    {
+        if (!wait && !_io_job->done())
+        {
+            // busy, come back later
+            if (_wb_deadline != 0 || _io_kind == IO_FLUSH)
+                _wb_deadline = fnSystem.millis() + ATR_WRITEBACK_RETRY_MS;
+            return _wb_failed;
+        }
+        _io_sync();
+    }
+
+    if (_wb_dirty.empty())
+    {
+        _wb_deadline = 0;
+        return _wb_failed;
+    }
+
+    _wb_flushing.swap(_wb_dirty);
+    _wb_dirty.clear();
+    _io_kind = IO_FLUSH;
+    _io_job = workerPool.submit([this]() { return _wb_write_runs(); });
+
+    if (wait)
+        _io_sync();
+    else
+        _wb_deadline = fnSystem.millis() + ATR_WRITEBACK_RETRY_MS; // collect the result
+    return _wb_failed;
+}
+
+// Worker: write flushed sectors, contiguous ones with single request, returns 1 on success
+int MediaTypeATR::_wb_write_runs()
+{
+    fnTraceSpan span("media", "flush");
+    span.arg("sectors", _wb_flushing.size());
+
+    std::vector<uint8_t> run;
+    int runs = 0;
+    auto it = _wb_flushing.begin();
+    while (it != _wb_flushing.end())
+    {
+        uint16_t last = it->first;
+        uint32_t offset = _sector_to_offset(last);
+        run.assign(it->second.begin(), it->second.end());
+        for (++it; it != _wb_flushing.end() && it->first == last + 1 &&
+                   _sector_to_offset(it->first) == offset + run.size(); ++it)
+        {
+            run.insert(run.end(), it->second.begin(), it->second.end());
+            last = it->first;
+        }
+
+        if (_disk_fileh->seek(offset, SEEK_SET) != 0 ||
+            _disk_fileh->write(run.data(), 1, run.size()) != run.size())
+            return 0;
+        runs++;
+    }
+    _wb_flush_runs = runs;
+    span.arg("runs", runs);
+
+    return _disk_fileh->flush() == 0 ? 1 : 0;
+}
+
+// Finish flush, failed sectors go back to the cache unless written again meanwhile
+void MediaTypeATR::_wb_collect(bool ok)
+{
+    if (ok)
+    {
+        busMetrics.disk_writeback_flush(true, _wb_flushing.size(), _wb_flush_runs);
+        _wb_flushing.clear();
+        _wb_failed = false;
+        // read-ahead block may be older than written sectors
+        _ra_count = 0;
+        _ra_used = 0;
+        _wb_journal_rewrite();
+        if (_wb_dirty.empty())
+            _wb_deadline = 0;
+        return;
+    }
+
+    Debug_printf("ATR write-back flush failed, %u sectors kept in cache\r\n", (unsigned)_wb_flushing.size());
+    busMetrics.disk_writeback_flush(false, 0, 0);
+    _wb_failed = true;
+    for (auto &s : _wb_flushing)
+        _wb_dirty.insert(std::move(s));
+    _wb_flushing.clear();
+    _wb_deadline = fnSystem.millis() + Config.get_diskcache_flush_delay();
+}
+
+/*
+ * Journal file: ATR_JOURNAL_MAGIC followed by records of
+ *   sector number (2 bytes LE), length (2 bytes LE), sector data
+ * Later record of the same sector wins. One journal per image, named after
+ * hash of host name and image path.
+ */
+void MediaTypeATR::_wb_journal_open()
+{
+    _wb_journal_path.clear();
+    if (!Config.get_diskcache_journal() || !fnSDFAT.running() || _disk_host == nullptr)
+        return;
+
+    uint32_t hash = util_fnv1a(std::string(_disk_host->get_hostname()) + ":" + _disk_filename);
+    char path[32];
+    snprintf(path, sizeof(path), ATR_JOURNAL_DIR "/%08x.jnl", (unsigned)hash);
+    _wb_journal_path = path;
+
+    fnSDFAT.create_path(ATR_JOURNAL_DIR);
+    _wb_journal_replay();
+}
+
+// Write acknowledged to the computer must survive power loss, not only crash of the program
+void MediaTypeATR::_wb_journal_sync()
+{
+    if (_wb_journal == nullptr)
+        return;
+    fflush(_wb_journal);
+#if defined(_WIN32)
+    _commit(_fileno(_wb_journal));
+#else
+    fsync(fileno(_wb_journal));
+#endif
+}
+
+void MediaTypeATR::_wb_journal_append(uint16_t sectornum, const uint8_t *data, uint16_t len, bool sync)
+{
+    if (_wb_journal_path.empty())
+        return;
+
+    if (_wb_journal == nullptr)
+    {
+        _wb_journal = fnSDFAT.file_open(_wb_journal_path.c_str(), "wb");
+        if (_wb_journal == nullptr)
+        {
+            Debug_printf("Failed to create write-back journal \"%s\"\r\n", _wb_journal_path.c_str());
+            return;
+        }
+        fwrite(ATR_JOURNAL_MAGIC, 1, ATR_JOURNAL_MAGIC_LEN, _wb_journal);
+    }
+
+    uint8_t hdr[4] = {LOBYTE_FROM_UINT16(sectornum), HIBYTE_FROM_UINT16(sectornum),
+                      LOBYTE_FROM_UINT16(len), HIBYTE_FROM_UINT16(len)};
+    fwrite(hdr, 1, sizeof(hdr), _wb_journal);
+    fwrite(data, 1, len, _wb_journal);
+    if (sync)
+        _wb_journal_sync();
+}
+
+// Journal keeps only sectors still in the cache, removed when there are none
+void MediaTypeATR::_wb_journal_rewrite()
+{
+    if (_wb_journal != nullptr)
+    {
+        fclose(_wb_journal);
+        _wb_journal = nullptr;
+    }
+    if (_wb_journal_path.empty())
+        return;
+
+    if (_wb_dirty.empty())
+    {
+        fnSDFAT.remove(_wb_journal_path.c_str());
+        return;
+    }
+    for (auto &s : _wb_dirty)
+        _wb_journal_append(s.first, s.second.data(), s.second.size(), false);
+    _wb_journal_sync();
+}
+
+// Write sectors left in journal by previous run into the image
+void MediaTypeATR::_wb_journal_replay()
+{
+    FILE *f = fnSDFAT.file_open(_wb_journal_path.c_str(), "rb");
+    if (f == nullptr)
+        return;
+
+    char magic[ATR_JOURNAL_MAGIC_LEN];
+    int count = 0;
+    bool ok = fread(magic, 1, ATR_JOURNAL_MAGIC_LEN, f) == ATR_JOURNAL_MAGIC_LEN &&
+              memcmp(magic, ATR_JOURNAL_MAGIC, ATR_JOURNAL_MAGIC_LEN) == 0;
+    uint8_t hdr[4];
+    uint8_t data[512];
+    while (ok && fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr))
+    {
+        uint16_t sectornum = UINT16_FROM_HILOBYTES(hdr[1], hdr[0]);
+        uint16_t len = UINT16_FROM_HILOBYTES(hdr[3], hdr[2]);
+        // record cut by crash is dropped, its write was never acknowledged as flushed
+        if (sectornum == 0 || sectornum > _disk_num_sectors || len != sector_size(sectornum) ||
+            fread(data, 1, len, f) != len)
+            break;
+        if (_disk_fileh->seek(_sector_to_offset(sectornum), SEEK_SET) != 0 ||
+            _disk_fileh->write(data, 1, len) != len)
+        {
+            ok = false;
+            break;
+        }
+        count++;
+    }
+    fclose(f);
+
+    if (count > 0)
+        _disk_fileh->flush();
+    _disk_last_sector = INVALID_SECTOR_VALUE;
+
+    if (ok)
+    {
+        Debug_printf("Replayed %d sectors from write-back journal \"%s\"\r\n", count, _wb_journal_path.c_str());
+        fnSDFAT.remove(_wb_journal_path.c_str());
+    }
+    else
+        Debug_printf("Failed to replay write-back journal \"%s\", kept\r\n", _wb_journal_path.c_str());
+}
+
 bool inHighScoreRange(int minimum, int maximum, int val)
 {
     return ((minimum <= val) && (val <= maximum));
@@ -98,6 +498,8 @@ bool inHighScoreRange(int minimum, int maximum, int val)
 // Returns TRUE if an error condition occurred
 bool MediaTypeATR::write(uint16_t sectornum, bool verify)
 {
+    fnTraceSpan span("media", "write");
+    span.arg("sector", sectornum);
     FileHandler *oldFileh, *hsFileh;
 
     oldFileh = nullptr;
@@ -112,7 +514,25 @@ bool MediaTypeATR::write(uint16_t sectornum, bool verify)
         return true;
     }
 
-    if (_high_score_sector != 0)
+    uint16_t sectorSize = sector_size(sectornum);
+
+    // keep the sector in memory once the image took a write, read-only image fails the first one
+    if (_wb_enabled && _wb_writable)
+    {
+        _wb_dirty[sectornum].assign(_disk_sectorbuff, _disk_sectorbuff + sectorSize);
+        _wb_journal_append(sectornum, _disk_sectorbuff, sectorSize);
+        if (_wb_deadline == 0)
+            _wb_deadline = fnSystem.millis() + Config.get_diskcache_flush_delay();
+        if (_wb_dirty.size() >= ATR_WRITEBACK_MAX_DIRTY)
+            flush(false);
+        return false;
+    }
+
+    _ra_invalidate();
+
+    // overlay keeps writes off the image, no need to reopen it writable
+    bool hs_reopen = _high_score_sector != 0 && !_disk_overlay;
+    if (hs_reopen)
     {
         Debug_printf("High score mode activated, attempting write open\r\n");
         if (_disk_host == nullptr)
@@ -123,10 +543,10 @@ bool MediaTypeATR::write(uint16_t sectornum, bool verify)
         {
             oldFileh = _disk_fileh;
             hsFileh = _disk_host->filehandler_open(_disk_filename, _disk_filename, strlen(_disk_filename) + 1, "rb+");
+            hsFileh = blockCache.wrap(hsFileh, _disk_host, _disk_filename);
             _disk_fileh = hsFileh;
         }
     }
-    uint16_t sectorSize = sector_size(sectornum);
     uint32_t offset = _sector_to_offset(sectornum);
 
     _disk_last_sector = INVALID_SECTOR_VALUE;
@@ -153,7 +573,7 @@ bool MediaTypeATR::write(uint16_t sectornum, bool verify)
     int ret = _disk_fileh->flush();
     Debug_printf("ATR::write fsync:%d\n", ret);
 
-    if (_high_score_sector != 0)
+    if (hs_reopen)
     {
         Debug_printf("Closing high score sector.\r\n");
 
@@ -164,7 +584,10 @@ bool MediaTypeATR::write(uint16_t sectornum, bool verify)
         _disk_last_sector = INVALID_SECTOR_VALUE; // force a cache invalidate.
     }
     else
+    {
         _disk_last_sector = sectornum;
+        _wb_writable = ret == 0;
+    }
 
     return false;
 }
@@ -277,9 +700,57 @@ mediatype_t MediaTypeATR::mount(FileHandler *f, uint32_t disksize)
 
     _disktype = MEDIATYPE_ATR;
 
+    // network hosts pay round trip per read, fetch sequential sectors ahead
+    _ra_enabled = _disk_host != nullptr && _disk_host->get_type() != HOSTTYPE_LOCAL;
+    _ra_count = 0;
+    _ra_used = 0;
+    _ra_window = ATR_READAHEAD_MIN;
+    _ra_last_read = 0;
+    _ra_run = 0;
+
+    // local images are written as fast as the cache would flush them, they stay write-through
+    // (like images in high score mode, which reopens the image for every write)
+    _wb_enabled = _disk_host != nullptr && _disk_host->get_type() != HOSTTYPE_LOCAL &&
+                  !Config.get_diskcache_write_through() && _high_score_sector == 0;
+    _wb_writable = false;
+    _wb_deadline = 0;
+    _wb_failed = false;
+    if (_wb_enabled)
+        _wb_journal_open();
+
     return _disktype;
 }
 
+void MediaTypeATR::invalidate()
+{
+    _ra_invalidate();
+    MediaType::invalidate();
+}
+
+void MediaTypeATR::unmount()
+{
+    if (flush(true))
+        Debug_printf("ATR unmount: %u written sectors lost\r\n", (unsigned)_wb_dirty.size());
+    _ra_invalidate();
+    _wb_dirty.clear();
+    if (_wb_journal != nullptr)
+    {
+        fclose(_wb_journal);
+        _wb_journal = nullptr;
+    }
+    MediaType::unmount();
+}
+
+MediaTypeATR::~MediaTypeATR()
+{
+    // worker may still be using this object
+    _io_sync();
+    if (_disk_fileh != nullptr)
+        flush(true);
+    if (_wb_journal != nullptr)
+        fclose(_wb_journal);
+}
+
 // Returns FALSE on error
 bool MediaTypeATR::create(FileHandler *f, uint16_t sectorSize, uint16_t numSectors)
 {
@@ -1,20 +1,117 @@
 #ifndef _MEDIATYPE_ATR_
 #define _MEDIATYPE_ATR_
 
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "diskType.h"
+#include "fnWorkerPool.h"
+
+#define ATR_READAHEAD_MIN 4         // sectors fetched ahead, initial and lowest window
+#define ATR_READAHEAD_MAX 64        // largest window
+#define ATR_READAHEAD_TRIGGER 2     // sequential reads before read-ahead starts
+
+#define ATR_WRITEBACK_MAX_DIRTY 256 // start flush when this many sectors wait
+#define ATR_WRITEBACK_RETRY_MS 100  // check again while background job is busy
+#define ATR_JOURNAL_DIR "/.journal" // on SD, see _wb_journal_open()
+#define ATR_JOURNAL_MAGIC "FNJRNL01"
+#define ATR_JOURNAL_MAGIC_LEN 8
 
 class MediaTypeATR : public MediaType
 {
 private:
     uint32_t _sector_to_offset(uint16_t sectorNum);
 
+    // Background job on worker pool, only one at a time. Any other file access
+    // waits for it first (_io_sync), the file handle is never shared.
+    enum io_kind
+    {
+        IO_READAHEAD,
+        IO_FLUSH
+    };
+    std::shared_ptr<fnJob> _io_job;
+    io_kind _io_kind = IO_READAHEAD;
+
+    void _io_sync();
+
+    /*
+     * Sequential read-ahead for images on network hosts
+     * After ATR_READAHEAD_TRIGGER sequential sector reads, next window of sectors
+     * is fetched with single backend read on worker pool and following reads are
+     * served from memory. Window doubles with every next block of the same
+     * sequence and halves when the sequence breaks with most of the block unused.
+     */
+    bool _ra_enabled = false;
+    std::vector<uint8_t> _ra_buf;           // cached sectors, _ra_first .. _ra_first + _ra_count - 1
+    uint16_t _ra_first = 0;
+    uint16_t _ra_count = 0;
+    uint16_t _ra_used = 0;                  // cached sectors read by computer
+    std::vector<uint8_t> _ra_fetch_buf;     // block being fetched by worker
+    uint16_t _ra_fetch_first = 0;
+    uint16_t _ra_fetch_count = 0;
+    uint16_t _ra_window = ATR_READAHEAD_MIN;
+    uint16_t _ra_last_read = 0;             // last sector asked by computer
+    int _ra_run = 0;                        // sequential reads in a row
+
+    void _ra_collect(bool ok);
+    void _ra_invalidate();
+    bool _ra_lookup(uint16_t sectornum, uint16_t sectorSize);
+    void _ra_schedule(uint16_t sectornum);
+    int _ra_fetch();
+
+    /*
+     * Write-back cache for images on network hosts
+     * Written sectors are kept in memory and flushed on worker pool after
+     * flush delay from the first unflushed write, merged into runs of
+     * contiguous sectors (one seek and write per run, one flush in total).
+     * Reads see the cached data. First write after mount goes straight to the
+     * image, so read-only image fails it as before. Optional journal on SD
+     * keeps the sectors until they are in the image, it is replayed on next
+     * mount after crash.
+     */
+    bool _wb_enabled = false;
+    bool _wb_writable = false;              // image took a write since mount
+    std::map<uint16_t, std::vector<uint8_t>> _wb_dirty;     // written, not flushed yet
+    std::map<uint16_t, std::vector<uint8_t>> _wb_flushing;  // being written by worker
+    // ms, flush due, 0 = nothing to flush
+    // set by worker too (_io_sync() from read() in async command), read by bus thread timer
+    std::atomic<uint64_t> _wb_deadline{0};
+    bool _wb_failed = false;                // last flush failed
+    int _wb_flush_runs = 0;                 // backend writes of last flush
+    std::string _wb_journal_path;           // empty if journal is disabled
+    FILE *_wb_journal = nullptr;
+
+    bool _wb_lookup(uint16_t sectornum, uint16_t sectorSize);
+    void _wb_collect(bool ok);
+    int _wb_write_runs();
+    void _wb_journal_open();
+    void _wb_journal_append(uint16_t sectornum, const uint8_t *data, uint16_t len, bool sync = true);
+    void _wb_journal_sync();
+    void _wb_journal_rewrite();
+    void _wb_journal_replay();
+
 public:
+    virtual ~MediaTypeATR();
+
     virtual bool read(uint16_t sectornum, uint16_t *readcount) override;
     virtual bool write(uint16_t sectornum, bool verify) override;
 
     virtual bool format(uint16_t *respopnsesize) override;
 
     virtual mediatype_t mount(FileHandler *f, uint32_t disksize) override;
+    virtual void unmount() override;
+
+    // sector can be served without backend access
+    virtual bool cached(uint16_t sectornum) override;
+
+    // write cached sectors to the image
+    virtual bool flush(bool wait) override;
+    virtual uint64_t flush_deadline() override { return _wb_deadline; }
+    virtual void invalidate() override;
 
     virtual void status(uint8_t statusbuff[4]) override;
 
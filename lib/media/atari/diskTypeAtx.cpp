@@ -1,19 +1,18 @@
-#ifdef BUILD_ATARI // temporary
+#ifdef BUILD_ATARI
 
 #include "diskTypeAtx.h"
 
 #include <memory.h>
 #include <string.h>
-// #include <esp_timer.h>
-// #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
-// #include <esp_random.h>
-// #endif
+#include <stdlib.h>
+#include <algorithm>
 
 #include "../../include/debug.h"
 
 #include "disk.h"
 
 #include "fnSystem.h"
+#include "fnTrace.h"
 
 #include "utils.h"
 
@@ -31,18 +30,6 @@
   0.20833... / 26042 = 0.0000079998976013... = 8 microseconds per angular position
 
 */
-/*
- Frequency with which to update the angular position counter.
- Counter is updated every 
- US_ANGULAR_UNIT_TIME * ANGULAR_POSITION_UPDATE_FREQ microseconds.
- ANGULAR_POSITION_UPDATE_FREQ must be at least '8' (updates every
- 8*8 = 64 microseconds) because the ESP timer fucntion won't allow
- frequencies lower than every 50 microseconds.
- "29" evenly divides 26042
-*/
-#define ANGULAR_POSITION_UPDATE_FREQ 29
-#define ANGULAR_POSITION_INVALID 65535
-
 // Most of the following timing constants come from S-Drive Max sources atx.c
 // (converted from milliseconds to microseconds)
 
@@ -66,12 +53,8 @@
 #define MAX_RETRIES_1050 1
 #define MAX_RETRIES_810 4
 
-AtxTrack::~AtxTrack()
-{
-    if (data != nullptr)
-        delete[] data;
+AtxTrack::~AtxTrack(){
 
-    data = nullptr;
 };
 
 AtxTrack::AtxTrack(){
@@ -92,150 +75,72 @@ AtxSector::AtxSector(sector_header_t &header)
 
 MediaTypeATX::~MediaTypeATX()
 {
-    // Destory any timer we may have
-    if (_atx_timer != nullptr)
-    {
-        esp_timer_stop(_atx_timer);
-        esp_timer_delete(_atx_timer);
-    }
 }
 
 // Constructor initializes the AtxTrack vector to assume we have 40 tracks
 MediaTypeATX::MediaTypeATX()
 {
-    _tracks.reserve(ATX_DEFAULT_NUMTRACKS);
-    int i = 0;
-    for (auto it = _tracks.begin(); i < ATX_DEFAULT_NUMTRACKS; i++)
-        _tracks.emplace(it++);
+    _tracks.resize(ATX_DEFAULT_NUMTRACKS);
 
     // Disallow HSIO
     _allow_hsio = false;
-
-    // Create a timer to track our fake disk rotating
-    esp_timer_create_args_t tcfg;
-    tcfg.arg = this;
-    tcfg.callback = on_timer;
-    tcfg.dispatch_method = esp_timer_dispatch_t::ESP_TIMER_TASK;
-    tcfg.name = nullptr;
-    esp_timer_create(&tcfg, &_atx_timer);
-    ESP_ERROR_CHECK(esp_timer_start_periodic(_atx_timer,
-        US_ANGULAR_UNIT_TIME * ANGULAR_POSITION_UPDATE_FREQ));
 }
 
-/*
-    Some notes on esp_timer_get_time() from:
-    https://github.com/espressif/arduino-esp32/pull/1424
-    * returns monotonic time in microseconds
-    * can be called from tasks and interrupts
-    * does not use any critical sections/mutexes
-    * is thread safe
-    * takes less than 1 microsecond to execute
-*/
-void MediaTypeATX::on_timer(void *info)
+// Angular position under the head at given time
+uint16_t MediaTypeATX::_head_position(uint64_t us_time)
 {
-    MediaTypeATX *pAtx = (MediaTypeATX *)info;
-
-    portENTER_CRITICAL(&pAtx->__atx_timerMux);
-
-    pAtx->__atx_position_time = esp_timer_get_time();
-    pAtx->__atx_current_angular_pos += ANGULAR_POSITION_UPDATE_FREQ;
-
-    if (pAtx->__atx_current_angular_pos >= ANGULAR_UNIT_TOTAL)
-    {
-        pAtx->__atx_current_angular_pos -= ANGULAR_UNIT_TOTAL;
-        pAtx->_atx_total_rotations++;
-    }
-
-    portEXIT_CRITICAL(&pAtx->__atx_timerMux);
+    if (us_time < _atx_spin_start_us)
+        return 0;
+    return ((us_time - _atx_spin_start_us) / US_ANGULAR_UNIT_TIME) % ANGULAR_UNIT_TOTAL;
 }
 
-uint16_t MediaTypeATX::_get_head_position()
+// First sector with given number the head reaches from given position, nullptr if there is none
+AtxSector *MediaTypeATX::_next_sector(AtxTrack &track, uint8_t sectornum, uint16_t pos)
 {
-    uint64_t us_now = esp_timer_get_time();
-
-    portENTER_CRITICAL(&__atx_timerMux);
-    uint64_t us_then = __atx_position_time;
-    uint16_t pos = __atx_current_angular_pos;
-    portEXIT_CRITICAL(&__atx_timerMux);
-
-    /*
-     Adjust the recorded angular position by the number of microseconds passed since
-     it was recorded.
-    */
-    uint64_t us_diff;
-
-    // Handle the rare case of a timer roll-over
-    if (us_now > us_then)
-    {
-        us_diff = us_now - us_then;
-    }
-    else
-    {
-        us_diff = UINT64_MAX - us_now + us_then;
-    }
-
-    pos += us_diff / US_ANGULAR_UNIT_TIME;
-    if (pos >= ANGULAR_UNIT_TOTAL)
-        pos -= ANGULAR_UNIT_TOTAL;
-
-    return pos;
+    auto idx = track.angle_index.find(sectornum);
+    if (idx == track.angle_index.end() || idx->second.empty())
+        return nullptr;
+
+    std::vector<uint16_t> &order = idx->second;
+    auto it = std::lower_bound(order.begin(), order.end(), pos,
+        [&track](uint16_t i, uint16_t p) { return track.sectors[i].position < p; });
+    // Past the last one, wait for the first one in next rotation
+    if (it == order.end())
+        it = order.begin();
+    return &track.sectors[*it];
 }
 
-void MediaTypeATX::_wait_full_rotation()
+// Index sectors of every track by number, copies of the same number ordered by angular position
+void MediaTypeATX::_build_angle_index()
 {
-    uint32_t pos = _get_head_position();
-
-    // Wait for a roll-over to occur
-    do
-    {
-        NOP();
-    } while (pos <= _get_head_position());
-
-    // Wait for the head to be over the previous position
-    do
-    {
-        NOP();
-    } while (pos > _get_head_position());
-}
-
-void MediaTypeATX::_wait_head_position(uint16_t pos, uint16_t extra_delay)
-{
-    pos += extra_delay;
-    if (pos >= ANGULAR_UNIT_TOTAL)
-        pos -= ANGULAR_UNIT_TOTAL;
-
-    uint16_t current = _get_head_position();
-
-    if (current == pos)
-    {
-        return;
-    }
-
-    while (abs(_get_head_position() - pos) > HEAD_TOLERANCE)
+    for (auto &track : _tracks)
     {
-        NOP();
+        track.angle_index.clear();
+        for (uint16_t i = 0; i < track.sectors.size(); i++)
+            track.angle_index[track.sectors[i].number].push_back(i);
+        for (auto &idx : track.angle_index)
+            std::sort(idx.second.begin(), idx.second.end(),
+                [&track](uint16_t a, uint16_t b) { return track.sectors[a].position < track.sectors[b].position; });
     }
 }
 
 void MediaTypeATX::_process_sector(AtxTrack &track, AtxSector *psector, uint16_t sectorsize)
 {
-    // Pause for the read head to be in the position of the sector
-    _wait_head_position(psector->position, ANGULAR_UNIT_TOTAL / _atx_sectors_per_track);
-
     // Copy data from the sector into the buffer if any is available
     if ((psector->status & ATX_SECTOR_STATUS_MISSING_DATA) == 0)
     {
         // Make sure we have a reasonable offset and data to copy
-        if (track.data != nullptr && psector->start_data >= track.offset_to_data_start)
+        if (psector->start_data >= track.offset_to_data_start &&
+            psector->start_data - track.offset_to_data_start + sectorsize <= track.data.size())
         {
             // Adjust the start_data value by the number of bytes into the Track Record the data chunk started
             uint32_t data_offset = psector->start_data - track.offset_to_data_start;
-            memcpy(_disk_sectorbuff, track.data + data_offset, sectorsize);
+            memcpy(_disk_sectorbuff, track.data.data() + data_offset, sectorsize);
         }
         else
         {
-            Debug_printf("## Invalid sector data offset (%u < %u) or track data buffer (%p)\r\n",
-                         psector->start_data, track.offset_to_data_start, track.data);
+            Debug_printf("## Invalid sector data offset (%u < %u) or track data size (%u)\r\n",
+                         psector->start_data, track.offset_to_data_start, (unsigned)track.data.size());
             // Act as if the ATX_SECTOR_STATUS_MISSING_DATA bit was set
             _disk_controller_status |= DISK_CTRL_STATUS_SECTOR_MISSING;
         }
@@ -244,10 +149,9 @@ void MediaTypeATX::_process_sector(AtxTrack &track, AtxSector *psector, uint16_t
         if (psector->weakoffset != ATX_WEAKOFFSET_NONE)
         {
             Debug_printf("## Weak sector data starting at offset %u\r\n", psector->weakoffset);
-            uint32_t rand = esp_random();
-            // Fill the buffer from the offset position to the end with our random 32 bit value
-            for (int x = psector->weakoffset; x < sectorsize; x += sizeof(uint32_t))
-                *((uint32_t *)(_disk_sectorbuff + x)) = rand;
+            // Fill the buffer from the offset position to the end with random data
+            for (int x = psector->weakoffset; x < sectorsize; x++)
+                _disk_sectorbuff[x] = rand();
         }
     }
     else
@@ -284,8 +188,9 @@ void MediaTypeATX::_process_sector(AtxTrack &track, AtxSector *psector, uint16_t
 }
 
 // Copies data for given track sector into disk buffer and sets status bits as appropriate
+// us_time is when the head starts searching, it's advanced to when the drive is done
 // Returns TRUE on error reading sector
-bool MediaTypeATX::_copy_track_sector_data(uint8_t tracknum, uint8_t sectornum, uint16_t sectorsize)
+bool MediaTypeATX::_copy_track_sector_data(uint8_t tracknum, uint8_t sectornum, uint16_t sectorsize, uint64_t &us_time)
 {
     Debug_printf("copy data track %d, sector %d\r\n", tracknum, sectornum);
 
@@ -295,46 +200,25 @@ bool MediaTypeATX::_copy_track_sector_data(uint8_t tracknum, uint8_t sectornum,
 
     AtxTrack &track = _tracks[tracknum];
 
-    _disk_controller_status = DISK_CTRL_STATUS_CLEAR;
-
     int retries = _atx_drive_model == ATX_DRIVE_MODEL_810 ? MAX_RETRIES_810 : MAX_RETRIES_1050;
     while (retries > 0)
     {
         retries--;
 
-        // Iterate through every sector stored for this track and find the one closest to the current drive head position
-        uint16_t current_pos = _get_head_position();
-        AtxSector *pSector = nullptr;
-        for (auto &it : track.sectors)
-        {
-            if (it.number == sectornum)
-            {
-                if (pSector == nullptr)
-                {
-                    pSector = &it;
-                }
-                else
-                // Compare the distance from the head to this sector and the head to the previous matching sector
-                {
-                    int diff_this = it.position - current_pos;
-                    int diff_last = pSector->position - current_pos;
-
-                    // Conditions under which to replace the last matching sector:
-                    if (
-                        (diff_this == 0) ||                                          // We're currently over the right sector
-                        (diff_this > 0 && diff_last < 0) ||                          // This sector is ahead of the current pos and the last was behind
-                        (diff_this > 0 && diff_last > 0 && diff_this < diff_last) || // Both are ahead but this one is closer
-                        (diff_this < 0 && diff_last < 0 && diff_this < diff_last)    // Both are behind but this one is closer
-                    )
-                    {
-                        pSector = &it;
-                    }
-                }
-            }
-        }
+        // Each attempt reports status of the copy it found (duplicate sectors may differ)
+        _disk_controller_status = DISK_CTRL_STATUS_CLEAR;
+
+        // Find the matching sector the head reaches first from its position
+        uint16_t current_pos = _head_position(us_time);
+        AtxSector *pSector = _next_sector(track, sectornum, current_pos);
 
         if (pSector != nullptr)
         {
+            // Head has to get to the sector and pass all of it
+            uint32_t wait = pSector->position >= current_pos ?
+                pSector->position - current_pos : ANGULAR_UNIT_TOTAL - current_pos + pSector->position;
+            us_time += (uint64_t)(wait + ANGULAR_UNIT_TOTAL / _atx_sectors_per_track) * US_ANGULAR_UNIT_TIME;
+
             _process_sector(track, pSector, sectorsize);
             // Skip any retires if our status is clear
             if (_disk_controller_status == DISK_CTRL_STATUS_CLEAR)
@@ -348,11 +232,11 @@ bool MediaTypeATX::_copy_track_sector_data(uint8_t tracknum, uint8_t sectornum,
 
         // Wait a full disk rotation before trying again
         if (retries != 0)
-            _wait_full_rotation();
+            us_time += (uint64_t)ANGULAR_UNIT_TOTAL * US_ANGULAR_UNIT_TIME;
     }
 
     // Delay for the CRC calculation
-    fnSystem.delay_microseconds(_atx_drive_model == ATX_DRIVE_MODEL_810 ? US_CRC_CALCULATION_810 : US_CRC_CALCULATION_1050);
+    us_time += _atx_drive_model == ATX_DRIVE_MODEL_810 ? US_CRC_CALCULATION_810 : US_CRC_CALCULATION_1050;
 
     // Return error condition if our controller status isn't clear
     return _disk_controller_status != DISK_CTRL_STATUS_CLEAR;
@@ -361,7 +245,12 @@ bool MediaTypeATX::_copy_track_sector_data(uint8_t tracknum, uint8_t sectornum,
 // Returns TRUE if an error condition occurred
 bool MediaTypeATX::read(uint16_t sectornum, uint16_t *readcount)
 {
-    Debug_printf("ATX READ (%d) rots=%u\r\n", sectornum, _atx_total_rotations);
+    fnTraceSpan span("media", "read");
+    span.arg("sector", sectornum);
+
+    uint64_t us_time = fnSystem.micros();
+    Debug_printf("ATX READ (%d) rots=%llu\r\n", sectornum,
+        (unsigned long long)((us_time - _atx_spin_start_us) / (ANGULAR_UNIT_TOTAL * US_ANGULAR_UNIT_TIME)));
 
     *readcount = 0;
 
@@ -371,28 +260,29 @@ bool MediaTypeATX::read(uint16_t sectornum, uint16_t *readcount)
     int tracknumber = (sectornum - 1) / _atx_sectors_per_track;
     int tracksector = (sectornum - 1) % _atx_sectors_per_track + 1; // sector numbers are 1-based
 
-    if (tracknumber >= _tracks.size())
+    if (sectornum == 0 || (size_t)tracknumber >= _tracks.size())
     {
-        Debug_printf("calculated track number %d > track count %d\r\n", tracknumber, _tracks.size());
+        Debug_printf("calculated track number %d > track count %d\r\n", tracknumber, (int)_tracks.size());
         return true;
     }
     int trackdiff = tracknumber < _atx_last_track ? _atx_last_track - tracknumber : tracknumber - _atx_last_track;
     _atx_last_track = tracknumber;
 
+    // Add a fake drive CPU request handling delay
+    us_time += _atx_drive_model == ATX_DRIVE_MODEL_810 ? US_DRIVE_REQUEST_DELAY_810 : US_DRIVE_REQUEST_DELAY_1050;
+
     // If needed, add a delay for moving to our fake track
     if (trackdiff > 0)
-    {
-        uint32_t us_delay = _atx_drive_model == ATX_DRIVE_MODEL_810 ? US_TRACK_STEP_810 * trackdiff + US_HEAD_SETTLE_810 : US_TRACK_STEP_1050 * trackdiff + US_HEAD_SETTLE_1050;
-        fnSystem.delay_microseconds(us_delay);
-    }
-
-    // Add a fake drive CPU request handling delay
-    fnSystem.delay_microseconds(
-        _atx_drive_model == ATX_DRIVE_MODEL_810 ? US_DRIVE_REQUEST_DELAY_810 : US_DRIVE_REQUEST_DELAY_1050);
+        us_time += _atx_drive_model == ATX_DRIVE_MODEL_810 ? US_TRACK_STEP_810 * trackdiff + US_HEAD_SETTLE_810 : US_TRACK_STEP_1050 * trackdiff + US_HEAD_SETTLE_1050;
 
     *readcount = sectorSize;
 
-    bool result = _copy_track_sector_data((uint8_t)tracknumber, (uint8_t)tracksector, sectorSize);
+    bool result = _copy_track_sector_data((uint8_t)tracknumber, (uint8_t)tracksector, sectorSize, us_time);
+
+    // Sleep once until the drive would be done, rather than spinning on each step
+    uint64_t us_now = fnSystem.micros();
+    if (us_time > us_now)
+        fnSystem.delay_microseconds(us_time - us_now);
 
     //util_dump_bytes(_disk_sectorbuff, sectorSize);
 
@@ -419,6 +309,26 @@ void MediaTypeATX::status(uint8_t statusbuff[4])
     statusbuff[2] = _atx_density == ATX_DENSITY_DOUBLE ? ATX_FORMAT_TIMEOUT_XF551 : ATX_FORMAT_TIMEOUT_810_1050;
 }
 
+// Read from image loaded in memory, returns number of bytes read
+size_t MediaTypeATX::_atx_read(void *buf, size_t len)
+{
+    size_t avail = _atx_offset < _atx_image.size() ? _atx_image.size() - _atx_offset : 0;
+    if (len > avail)
+        len = avail;
+    memcpy(buf, _atx_image.data() + _atx_offset, len);
+    _atx_offset += len;
+    return len;
+}
+
+// Returns FALSE if offset is past end of image
+bool MediaTypeATX::_atx_seek(uint32_t offset)
+{
+    if (offset > _atx_image.size())
+        return false;
+    _atx_offset = offset;
+    return true;
+}
+
 bool MediaTypeATX::_load_atx_chunk_weak_sector(chunk_header_t &chunk_hdr, AtxTrack &track)
 {
     #ifdef VERBOSE_ATX
@@ -477,10 +387,6 @@ bool MediaTypeATX::_load_atx_chunk_sector_data(chunk_header_t &chunk_hdr, AtxTra
     Debug_print("::_load_atx_chunk_sector_data\r\n");
     #endif
 
-    // Just in case we already read data for this track
-    if (track.data != nullptr)
-        delete[] track.data;
-
     // We take the number of bytes to read from the chunk length header value
     int data_size = chunk_hdr.length - sizeof(chunk_hdr);
 
@@ -488,15 +394,14 @@ bool MediaTypeATX::_load_atx_chunk_sector_data(chunk_header_t &chunk_hdr, AtxTra
     if (data_size == 0)
         return true;
     
-    // Attempt to the sector data
-    track.data = new uint8_t[data_size];
+    // Attempt to the sector data (replaces any we already read for this track)
+    track.data.resize(data_size);
 
     int i;
-    if ((i = fread(track.data, 1, data_size, _disk_fileh)) != data_size)
+    if ((i = _atx_read(track.data.data(), data_size)) != data_size)
     {
-        Debug_printf("failed reading %d sector data chunk bytes (%d, %d)\r\n", data_size, i, errno);
-        delete[] track.data;
-        track.data = nullptr;
+        Debug_printf("failed reading %d sector data chunk bytes (%d)\r\n", data_size, i);
+        track.data.clear();
         return false;
     }
 
@@ -531,15 +436,15 @@ bool MediaTypeATX::_load_atx_chunk_sector_list(chunk_header_t &chunk_hdr, AtxTra
     int readz = sizeof(sector_header) * track.sector_count;
     if(chunk_hdr.length != readz + sizeof(chunk_hdr))
     {
-        Debug_printf("WARNING: Chunk length %U != expected\r\n", chunk_hdr.length);
+        Debug_printf("WARNING: Chunk length %u != expected\r\n", chunk_hdr.length);
     }
 
     // Attempt to read sector_header * sector_count
     sector_header_t *sector_list = new sector_header_t[track.sector_count];
     int i;
-    if ((i = fread(sector_list, 1, readz, _disk_fileh)) != readz)
+    if ((i = _atx_read(sector_list, readz)) != readz)
     {
-        Debug_printf("failed reading sector list chunk bytes (%d, %d)\r\n", i, errno);
+        Debug_printf("failed reading sector list chunk bytes (%d)\r\n", i);
         delete[] sector_list;
         return false;
     }
@@ -574,10 +479,9 @@ bool MediaTypeATX::_load_atx_chunk_unknown(chunk_header_t &chunk_hdr, AtxTrack &
     if (chunk_size > 0)
     {
         Debug_printf("seeking +%u to skip this chunk\r\n", chunk_size);
-        int i;
-        if ((i = fseek(_disk_fileh, chunk_size, SEEK_CUR)) < 0)
+        if (!_atx_seek(_atx_offset + chunk_size))
         {
-            Debug_printf("seek failed (%d, %d)\r\n", i, errno);
+            Debug_print("seek failed\r\n");
             return false;
         }
         // Keep a count of how many bytes we've read into the Track Record
@@ -601,9 +505,9 @@ int MediaTypeATX::_load_atx_track_chunk(track_header_t &trk_hdr, AtxTrack &track
     chunk_header_t chunk_hdr;
 
     int i;
-    if ((i = fread(&chunk_hdr, 1, sizeof(chunk_hdr), _disk_fileh)) != sizeof(chunk_hdr))
+    if ((i = _atx_read(&chunk_hdr, sizeof(chunk_hdr))) != sizeof(chunk_hdr))
     {
-        Debug_printf("failed reading track chunk bytes (%d, %d)\r\n", i, errno);
+        Debug_printf("failed reading track chunk bytes (%d)\r\n", i);
         return -1;
     }
 
@@ -660,9 +564,9 @@ bool MediaTypeATX::_load_atx_track_record(uint32_t length)
     track_header_t trk_hdr;
 
     int i;
-    if ((i = fread(&trk_hdr, 1, sizeof(trk_hdr), _disk_fileh)) != sizeof(trk_hdr))
+    if ((i = _atx_read(&trk_hdr, sizeof(trk_hdr))) != sizeof(trk_hdr))
     {
-        Debug_printf("failed reading track header bytes (%d, %d)\r\n", i, errno);
+        Debug_printf("failed reading track header bytes (%d)\r\n", i);
         return false;
     }
 
@@ -708,9 +612,9 @@ bool MediaTypeATX::_load_atx_track_record(uint32_t length)
         #ifdef VERBOSE_ATX
         Debug_printf("seeking +%u to first chunk start pos\r\n", chunk_start_offset);
         #endif
-        if ((i = fseek(_disk_fileh, chunk_start_offset, SEEK_CUR)) < 0)
+        if (!_atx_seek(_atx_offset + chunk_start_offset))
         {
-            Debug_printf("failed seeking to first chunk in track record (%d, %d)\r\n", i, errno);
+            Debug_print("failed seeking to first chunk in track record\r\n");
             return false;
         }
         // Keep a count of how many bytes we've read into the Track Record
@@ -740,12 +644,13 @@ bool MediaTypeATX::_load_atx_record()
 
     record_header rec_hdr;
 
+    uint32_t record_start = _atx_offset;
     int i;
-    if ((i = fread(&rec_hdr, 1, sizeof(rec_hdr), _disk_fileh)) != sizeof(rec_hdr))
+    if ((i = _atx_read(&rec_hdr, sizeof(rec_hdr))) != sizeof(rec_hdr))
     {
-        if (errno != EOF)
+        if (i != 0)
         {
-            Debug_printf("failed reading record header bytes (%d, %d)\r\n", i, errno);
+            Debug_printf("failed reading record header bytes (%d)\r\n", i);
         }
         else
         {
@@ -756,20 +661,22 @@ bool MediaTypeATX::_load_atx_record()
         return false;
     }
 
+    if (rec_hdr.length < sizeof(rec_hdr))
+    {
+        Debug_printf("invalid record length %u\r\n", rec_hdr.length);
+        return false;
+    }
+
     if (rec_hdr.type != ATX_RECORDTYPE_TRACK)
     {
         Debug_print("record type is not TRACK - skipping\r\n");
-        // Skip forward to the next record
-        if ((i = fseek(_disk_fileh, rec_hdr.length - sizeof(rec_hdr), SEEK_CUR)) < 0)
-        {
-            Debug_printf("failed seeking past this record (%d, %d)\r\n", i, errno);
-            return false;
-        }
-        return true; // Return TRUE since this isn't an error
+        // Skip forward to the next record, this isn't an error
+        return _atx_seek(record_start + rec_hdr.length);
     }
 
-    // Try to read the track into memory
-    return _load_atx_track_record(rec_hdr.length);
+    // Try to read the track into memory, then continue with the next record
+    // whatever chunks were read (or skipped) in this one
+    return _load_atx_track_record(rec_hdr.length) && _atx_seek(record_start + rec_hdr.length);
 }
 
 /*
@@ -781,10 +688,9 @@ bool MediaTypeATX::_load_atx_data(atx_header_t &atx_hdr)
     Debug_println("MediaTypeATX::_load_atx_data starting read");
 
     // Seek to the start of the ATX record data
-    int i;
-    if ((i = fseek(_disk_fileh, atx_hdr.start, SEEK_SET)) < 0)
+    if (!_atx_seek(atx_hdr.start))
     {
-        Debug_printf("failed seeking to start of ATX data (%d, %d)\r\n", i, errno);
+        Debug_print("failed seeking to start of ATX data\r\n");
         return false;
     }
 
@@ -815,26 +721,31 @@ mediatype_t MediaTypeATX::mount(FileHandler *f, uint32_t disksize)
     _disktype = MEDIATYPE_UNKNOWN;
     _disk_last_sector = INVALID_SECTOR_VALUE;
 
-    // Load what should be the ATX header before attempting to load the rest
-    int i;
-    if ((i = fseek(f, 0, SEEK_SET)) < 0)
+    // Load the whole image, record parsing then doesn't wait for the host
+    if (disksize < sizeof(atx_header) || f->seek(0, SEEK_SET) != 0)
     {
-        Debug_printf("failed seeking to header on disk image (%d, %d)\r\n", i, errno);
+        Debug_print("failed seeking to header on disk image\r\n");
         return MEDIATYPE_UNKNOWN;
     }
 
-    atx_header hdr;
-
-    if ((i = fread(&hdr, 1, sizeof(hdr), f)) != sizeof(hdr))
+    _atx_image.resize(disksize);
+    size_t i;
+    if ((i = f->read(_atx_image.data(), 1, disksize)) != disksize)
     {
-        Debug_printf("failed reading header bytes (%d, %d)\r\n", i, errno);
+        Debug_printf("failed reading image bytes (%u of %u)\r\n", (unsigned)i, disksize);
+        _atx_image.clear();
         return MEDIATYPE_UNKNOWN;
     }
 
+    atx_header hdr;
+    _atx_offset = 0;
+    _atx_read(&hdr, sizeof(hdr));
+
     // Check the magic number (flip it around since it automatically gets re-ordered when loaded as a UINT32)
     if (ATX_MAGIC_HEADER != UINT32_FROM_LE_UINT32(hdr.magic))
     {
-        Debug_printf("ATX header doesnt match 'AT8X' (0x%008x)\r\n", hdr.magic);
+        Debug_printf("ATX header doesnt match 'AT8X' (0x%08x)\r\n", hdr.magic);
+        _atx_image.clear();
         return MEDIATYPE_UNKNOWN;
     }
 
@@ -864,14 +775,23 @@ mediatype_t MediaTypeATX::mount(FileHandler *f, uint32_t disksize)
     _disk_fileh = f;
 
     // Load all the actual ATX records into memory (return immediately if we fail)
-    if (_load_atx_data(hdr) == false)
+    bool loaded = _load_atx_data(hdr);
+    _atx_image.clear();
+    _atx_image.shrink_to_fit();
+    if (loaded == false)
     {
         _disk_fileh = nullptr;
         _tracks.clear();
         return MEDIATYPE_UNKNOWN;
     }
 
-    _disk_num_sectors = 720;
+    _build_angle_index();
+
+    // Disk starts spinning
+    _atx_spin_start_us = fnSystem.micros();
+    _atx_last_track = 0;
+
+    _disk_num_sectors = _atx_sectors_per_track * ATX_DEFAULT_NUMTRACKS;
     
     return _disktype = MEDIATYPE_ATX;
 }
@@ -1,11 +1,9 @@
 #ifndef _MEDIATYPE_ATX_
 #define _MEDIATYPE_ATX_
 
-// #include <esp_timer.h>
-
+#include <map>
 #include <vector>
 
-#include "network.h"
 #include "diskType.h"
 
 
@@ -151,11 +149,14 @@ public:
     uint32_t offset_to_data_start = 0;
 
     // Actual sector data
-    uint8_t * data = nullptr;
+    std::vector<uint8_t> data;
 
     // Actual sectors
     std::vector<AtxSector> sectors;
 
+    // Indexes into sectors by sector number, ordered by angular position (built after loading)
+    std::map<uint8_t, std::vector<uint16_t>> angle_index;
+
     ~AtxTrack();
     AtxTrack();
 };
@@ -174,13 +175,17 @@ private:
 
     uint8_t _atx_drive_model = ATX_DRIVE_MODEL_810;
 
-    // portMUX_TYPE __atx_timerMux = portMUX_INITIALIZER_UNLOCKED;
+    /*
+     Rotating disk is modeled from monotonic clock: angular position 0 passed
+     the head at _atx_spin_start_us and then every full rotation. Read computes
+     when the drive would deliver the sector and sleeps until then once, so it
+     should run on worker pool (see emulates_timing()).
+    */
+    uint64_t _atx_spin_start_us = 0;
 
-    uint64_t __atx_position_time;
-    uint16_t __atx_current_angular_pos = 0;
-    uint32_t _atx_total_rotations = 0;
-
-    // esp_timer_handle_t _atx_timer = nullptr;
+    // Whole image while loading
+    std::vector<uint8_t> _atx_image;
+    uint32_t _atx_offset = 0;
 
     std::vector<AtxTrack> _tracks;
 
@@ -189,6 +194,9 @@ private:
     // ATX header.end - normally the size of the entire ATX file
     uint32_t _atx_size = 0;
 
+    size_t _atx_read(void *buf, size_t len);
+    bool _atx_seek(uint32_t offset);
+
     bool _load_atx_data(atx_header_t &atx_hdr);
     bool _load_atx_record();
     bool _load_atx_track_record(uint32_t length);
@@ -199,13 +207,13 @@ private:
     bool _load_atx_chunk_weak_sector(chunk_header_t &chunk_hdr, AtxTrack &track);
     bool _load_atx_chunk_extended_sector(chunk_header_t &chunk_hdr, AtxTrack &track);
     bool _load_atx_chunk_unknown(chunk_header_t &chunk_hdr, AtxTrack &track);
+    void _build_angle_index();
 
-    bool _copy_track_sector_data(uint8_t tracknum, uint8_t sectornum, uint16_t sectorsize);
+    bool _copy_track_sector_data(uint8_t tracknum, uint8_t sectornum, uint16_t sectorsize, uint64_t &us_time);
     void _process_sector(AtxTrack &track, AtxSector *sectorp, uint16_t sectorsize);
 
-    uint16_t _get_head_position();
-    void _wait_full_rotation();
-    void _wait_head_position(uint16_t pos, uint16_t extra_delay);
+    uint16_t _head_position(uint64_t us_time);
+    AtxSector *_next_sector(AtxTrack &track, uint8_t sectornum, uint16_t pos);
 
 public:
     virtual bool read(uint16_t sectornum, uint16_t *readcount) override;
@@ -215,7 +223,7 @@ public:
 
     virtual void status(uint8_t statusbuff[4]) override;
 
-    static void on_timer(void *info);
+    virtual bool emulates_timing() override { return true; }
 
     MediaTypeATX();
     ~MediaTypeATX();
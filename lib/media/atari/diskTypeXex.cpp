@@ -9,6 +9,7 @@
 #include "../../include/debug.h"
 
 #include "fnSystem.h"
+#include "fnTrace.h"
 
 #include "utils.h"
 
@@ -50,23 +51,20 @@
     13-15: Extension
 */
 
-void MediaTypeXEX::_fake_vtoc()
+void MediaTypeXEX::_fake_vtoc(uint8_t *buf)
 {
-    uint16_t data_per_sector = _disk_sector_size - SECTOR_LINK_SIZE;
-    uint16_t numsectors = _disk_image_size / data_per_sector;
-    numsectors += _disk_image_size % data_per_sector > 0 ? 1 : 0;
-
+    uint16_t numsectors = _xex_data_sectors;
     uint16_t freesectors = 0x2D0 - numsectors;
 
     Debug_printf("num XEX sectors = %d\r\n", numsectors);
 
-    memset(_disk_sectorbuff,0,sizeof(_disk_sectorbuff));
+    memset(buf, 0, SECTOR_SIZE);
 
-    _disk_sectorbuff[0] = 0x02;
-    _disk_sectorbuff[1] = 0xd0;
-    _disk_sectorbuff[2] = 0x02;
-    _disk_sectorbuff[3] = freesectors & 0xFF;
-    _disk_sectorbuff[4] = freesectors << 8;
+    buf[0] = 0x02;
+    buf[1] = 0xd0;
+    buf[2] = 0x02;
+    buf[3] = freesectors & 0xFF;
+    buf[4] = freesectors << 8;
 
     // Fill VTOC
     for (int i=10; i<100; i++)
@@ -81,43 +79,98 @@ void MediaTypeXEX::_fake_vtoc()
                 b |= 0;
             b <<= 1;
         }
-        _disk_sectorbuff[i] = b;
+        buf[i] = b;
     }
 }
 
-void MediaTypeXEX::_fake_directory_entry()
+void MediaTypeXEX::_fake_directory_entry(uint8_t *buf)
 {
-    // Calculate the number of sectors required for XEX file
-    uint16_t data_per_sector = _disk_sector_size - SECTOR_LINK_SIZE;
-    uint16_t numsectors = _disk_image_size / data_per_sector;
-    numsectors += _disk_image_size % data_per_sector > 0 ? 1 : 0;
+    uint16_t numsectors = _xex_data_sectors;
 
-    Debug_printf("num XEX sectors = %d\r\n", numsectors);
+    memset(buf, 0, SECTOR_SIZE);
+
+    buf[0] = 0x46; // Entry in use; 16-bit sector links; created by DOS 2
+
+    buf[1] = LOBYTE_FROM_UINT16(numsectors);
+    buf[2] = HIBYTE_FROM_UINT16(numsectors);
+
+    buf[3] = LOBYTE_FROM_UINT16(FIRST_XEX_SECTOR);
+    buf[4] = HIBYTE_FROM_UINT16(FIRST_XEX_SECTOR);
+
+    buf[5] = 'A';
+    buf[6] = 'U';
+    buf[7] = 'T';
+    buf[8] = 'O';
+    buf[9] = 'R';
+    buf[10] = 'U';
+    buf[11] = 'N';
+    buf[12] = 0x20;
+    buf[13] = 0x20;
+    buf[14] = 0x20;
+    buf[15] = 0x20;
+}
+
+// Fill in the sector link data after read bytes of XEX file
+void MediaTypeXEX::_data_sector_links(uint8_t *buf, uint16_t sectornum, int read)
+{
+    // Provide number of bytes read
+    buf[_disk_sector_size - 1] = read;
+
+    // Only provide a next sector pointer if we read a full sector of data
+    if (read == _disk_sector_size - SECTOR_LINK_SIZE)
+    {
+        uint16_t next_sector = sectornum + 1;
+        buf[_disk_sector_size - 2] = LOBYTE_FROM_UINT16(next_sector);
+        buf[_disk_sector_size - 3] = HIBYTE_FROM_UINT16(next_sector);
+    }
+}
+
+// Load chunk of XEX file and lay it out into data sectors, false if it can't be read
+bool MediaTypeXEX::_preload(uint16_t chunk)
+{
+    int data_bytes = _disk_sector_size - SECTOR_LINK_SIZE;
+    uint16_t first = chunk * XEX_PRELOAD_CHUNK;
+    uint16_t count = _xex_data_sectors - first < XEX_PRELOAD_CHUNK ? _xex_data_sectors - first : XEX_PRELOAD_CHUNK;
+    size_t offset = (size_t)first * data_bytes;
+    size_t size = _disk_image_size - offset < (size_t)count * data_bytes ? _disk_image_size - offset : (size_t)count * data_bytes;
+
+    fnTraceSpan span("media", "preload");
+    span.arg("offset", offset);
+    span.arg("size", size);
+
+    std::vector<uint8_t> file(size);
+    if (_disk_fileh->seek(offset, SEEK_SET) != 0 ||
+        _disk_fileh->read(file.data(), 1, file.size()) != file.size())
+        return false;
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        uint8_t *sector = _xex_data.data() + (size_t)(first + i) * _disk_sector_size;
+        size_t pos = (size_t)i * data_bytes;
+        int read = file.size() - pos < (size_t)data_bytes ? file.size() - pos : data_bytes;
+        memcpy(sector, file.data() + pos, read);
+        _data_sector_links(sector, FIRST_XEX_SECTOR + first + i, read);
+    }
+    _xex_chunk_loaded[chunk] = true;
+    return true;
+}
 
-    _disk_sectorbuff[0] = 0x46; // Entry in use; 16-bit sector links; created by DOS 2
-
-    _disk_sectorbuff[1] = LOBYTE_FROM_UINT16(numsectors);
-    _disk_sectorbuff[2] = HIBYTE_FROM_UINT16(numsectors);
-
-    _disk_sectorbuff[3] = LOBYTE_FROM_UINT16(FIRST_XEX_SECTOR);
-    _disk_sectorbuff[4] = HIBYTE_FROM_UINT16(FIRST_XEX_SECTOR);
-
-    _disk_sectorbuff[5] = 'A';
-    _disk_sectorbuff[6] = 'U';
-    _disk_sectorbuff[7] = 'T';
-    _disk_sectorbuff[8] = 'O';
-    _disk_sectorbuff[9] = 'R';
-    _disk_sectorbuff[10] = 'U';
-    _disk_sectorbuff[11] = 'N';
-    _disk_sectorbuff[12] = 0x20;
-    _disk_sectorbuff[13] = 0x20;
-    _disk_sectorbuff[14] = 0x20;
-    _disk_sectorbuff[15] = 0x20;
+// Sectors built at mount and data sectors of loaded chunks need no backend access
+bool MediaTypeXEX::cached(uint16_t sectornum)
+{
+    if (sectornum < FIRST_XEX_SECTOR)
+        return true;
+    if (_xex_data.empty())
+        return false;
+    uint16_t i = sectornum - FIRST_XEX_SECTOR;
+    return i >= _xex_data_sectors || _xex_chunk_loaded[i / XEX_PRELOAD_CHUNK];
 }
 
 // Returns TRUE if an error condition occurred
 bool MediaTypeXEX::read(uint16_t sectornum, uint16_t *readcount)
 {
+    fnTraceSpan span("media", "read");
+    span.arg("sector", sectornum);
     Debug_printf("XEX READ (%d)\r\n", sectornum);
 
 
@@ -134,18 +187,9 @@ bool MediaTypeXEX::read(uint16_t sectornum, uint16_t *readcount)
 
         *readcount = BOOT_SECTOR_SIZE;
 
-        Debug_printf("copying %d bytes from bootloader\r\n", bootcopy);
-        memcpy(_disk_sectorbuff, _xex_bootloader + offset, bootcopy);
-
-        // PicoBoot uses the first byte as a flag for whether it should read double or single density sectors
-        // Single = 0x80, Double = 0x00
-        if(SECTOR_SIZE == 256 && sectornum == 1 && _disk_sectorbuff[0] == 0x80)
-        {
-            Debug_print("setting PicoBoot double density flag\r\n");
-            _disk_sectorbuff[0] = 0x00;
-        }
-
         // Note that we may not have read an entire sector's worth of bytes. That's okay.
+        if (bootcopy > 0)
+            memcpy(_disk_sectorbuff, _xex_bootloader + offset, bootcopy);
         _disk_last_sector = INVALID_SECTOR_VALUE; // Reset this so we're forced to seek
         return false;
     }
@@ -155,16 +199,35 @@ bool MediaTypeXEX::read(uint16_t sectornum, uint16_t *readcount)
     // We're going to fake a DOS2.0 directory if we're seeking to the directory area
     if (sectornum == VTOC_SECTOR)
     {
-        Debug_printf("faking DOS 2 VTOC\r\n");
-        _fake_vtoc();
+        memcpy(_disk_sectorbuff, _xex_vtoc, _disk_sector_size);
         _disk_last_sector = INVALID_SECTOR_VALUE;
         return false;
     }
     else if (sectornum >= DIRECTORY_START && sectornum <= DIRECTORY_END)
     {
-        Debug_print("faking DOS 2 directory\r\n");
-        _fake_directory_entry();
-        _disk_last_sector = INVALID_SECTOR_VALUE; // Reset this so we're forced to seek        
+        memcpy(_disk_sectorbuff, _xex_dirent, _disk_sector_size);
+        _disk_last_sector = INVALID_SECTOR_VALUE; // Reset this so we're forced to seek
+        return false;
+    }
+    else if (sectornum < FIRST_XEX_SECTOR)
+    {
+        // nothing on the disk before the directory
+        _disk_last_sector = INVALID_SECTOR_VALUE;
+        return true;
+    }
+
+    // Loaded chunk by chunk, past the end of file there are empty sectors
+    if (!_xex_data.empty())
+    {
+        uint16_t i = sectornum - FIRST_XEX_SECTOR;
+        if (i >= _xex_data_sectors)
+            return false;
+        if (!_xex_chunk_loaded[i / XEX_PRELOAD_CHUNK] && !_preload(i / XEX_PRELOAD_CHUNK))
+        {
+            Debug_println("failed to load XEX chunk");
+            return true;
+        }
+        memcpy(_disk_sectorbuff, _xex_data.data() + (size_t)i * _disk_sector_size, _disk_sector_size);
         return false;
     }
 
@@ -185,20 +248,8 @@ bool MediaTypeXEX::read(uint16_t sectornum, uint16_t *readcount)
         int read = _disk_fileh->read(_disk_sectorbuff, 1, data_bytes);
         Debug_printf("received %d bytes\r\n", read);
 
-        // Fill in the sector link data pointing to the next sector
         if(read >= 0)
-        {
-            // Provide number of bytes read
-            _disk_sectorbuff[_disk_sector_size - 1] = read;
-
-            // Only provide a next sector pointer if we read a full sector of data
-            if(read == data_bytes)
-            {
-                uint16_t next_sector = sectornum + 1;
-                _disk_sectorbuff[_disk_sector_size - 2] = LOBYTE_FROM_UINT16(next_sector);
-                _disk_sectorbuff[_disk_sector_size - 3] = HIBYTE_FROM_UINT16(next_sector);
-            }
-        }
+            _data_sector_links(_disk_sectorbuff, sectornum, read);
         else
             err = true;
     }
@@ -218,6 +269,9 @@ void MediaTypeXEX::status(uint8_t statusbuff[4])
 
 void MediaTypeXEX::unmount()
 {
+    _xex_data.clear();
+    _xex_data.shrink_to_fit();
+    _xex_chunk_loaded.clear();
     // Call the parent unmount
     this->MediaType::unmount();
 }
@@ -249,12 +303,34 @@ mediatype_t MediaTypeXEX::mount(FileHandler *f, uint32_t disksize)
 
     // Calculate the number of fake disk sectors
     uint16_t data_per_sector = _disk_sector_size - SECTOR_LINK_SIZE;
-    _disk_num_sectors = FIRST_XEX_SECTOR + _disk_image_size / data_per_sector;
-    _disk_num_sectors += _disk_image_size % data_per_sector > 0 ? 1 : 0;
+    _xex_data_sectors = _disk_image_size / data_per_sector;
+    _xex_data_sectors += _disk_image_size % data_per_sector > 0 ? 1 : 0;
+    _disk_num_sectors = FIRST_XEX_SECTOR + _xex_data_sectors;
 
     if (_disk_num_sectors < 720)
         _disk_num_sectors = 720;
 
+    // PicoBoot uses the first byte as a flag for whether it should read double or single density sectors
+    // Single = 0x80, Double = 0x00
+    if (SECTOR_SIZE == 256 && _xex_bootloadersize > 0 && _xex_bootloader[0] == 0x80)
+    {
+        Debug_print("setting PicoBoot double density flag\r\n");
+        _xex_bootloader[0] = 0x00;
+    }
+
+    // Everything but the file itself is known now
+    _fake_vtoc(_xex_vtoc);
+    _fake_directory_entry(_xex_dirent);
+
+    // Data sectors are loaded on first read, mount runs on the bus thread
+    _xex_data.clear();
+    _xex_chunk_loaded.clear();
+    if (_disk_image_size <= XEX_PRELOAD_MAX)
+    {
+        _xex_data.assign((size_t)_xex_data_sectors * _disk_sector_size, 0);
+        _xex_chunk_loaded.assign((_xex_data_sectors + XEX_PRELOAD_CHUNK - 1) / XEX_PRELOAD_CHUNK, false);
+    }
+
     Debug_printf("mounted XEX with %d-byte bootloader; XEX size=%d\r\n", _xex_bootloadersize, _disk_image_size);
     Debug_printf("disk sectors = %d\r\n", _disk_num_sectors);
 
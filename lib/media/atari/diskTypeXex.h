@@ -1,19 +1,41 @@
 #ifndef _MEDIATYPE_XEX_
 #define _MEDIATYPE_XEX_
 
+#include <vector>
+
 #include "diskType.h"
 
+#define XEX_PRELOAD_MAX 1048576 // larger files are read sector by sector
+#define XEX_PRELOAD_CHUNK 64    // data sectors loaded by one backend read
+
+/*
+ * Virtual DOS 2 disk with boot loader and XEX file as AUTORUN
+ * Boot sectors, VTOC and directory are built at mount. XEX file up to
+ * XEX_PRELOAD_MAX is loaded into linked data sectors in chunks of
+ * XEX_PRELOAD_CHUNK sectors on first read of the chunk, so mount does no
+ * file I/O and a single command never waits for more than one chunk.
+ * Loaded sectors are then served from memory without backend access.
+ */
+
 class MediaTypeXEX : public MediaType
 {
 private:
     uint8_t _xex_bootloader[384];
     int _xex_bootloadersize = 0;
+    uint8_t _xex_vtoc[256];
+    uint8_t _xex_dirent[256];           // every directory sector has the AUTORUN entry
+    std::vector<uint8_t> _xex_data;     // data sectors with links, empty = read from file
+    std::vector<bool> _xex_chunk_loaded;
+    uint16_t _xex_data_sectors = 0;
 
-    void _fake_vtoc();
-    void _fake_directory_entry();
+    void _fake_vtoc(uint8_t *buf);
+    void _fake_directory_entry(uint8_t *buf);
+    void _data_sector_links(uint8_t *buf, uint16_t sectornum, int read);
+    bool _preload(uint16_t chunk);
 
 public:
     virtual bool read(uint16_t sectornum, uint16_t *readcount) override;
+    virtual bool cached(uint16_t sectornum) override;
 
     virtual mediatype_t mount(FileHandler *f, uint32_t disksize) override;
     virtual void unmount() override;
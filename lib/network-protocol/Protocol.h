@@ -153,6 +153,11 @@ public:
      */
     virtual void errno_to_error();
 
+    /**
+     * @brief return socket descriptor to wait on for incoming data, -1 if protocol has none.
+     */
+    virtual int get_fd() { return -1; }
+
     /**
      * Pointer to current login;
      */
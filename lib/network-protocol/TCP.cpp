@@ -427,4 +427,13 @@ bool NetworkProtocolTCP::special_close_client_connection()
     client.stop();
 
     return false;
-}
\ No newline at end of file
+}
+
+int NetworkProtocolTCP::get_fd()
+{
+    if (client.connected())
+        return client.fd();
+    if (server != nullptr)
+        return server->fd();
+    return -1;
+}
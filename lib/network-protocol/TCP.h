@@ -85,6 +85,11 @@ public:
      */
     virtual bool special_80(uint8_t *sp_buf, unsigned short len, cmdFrame_t *cmdFrame);
 
+    /**
+     * @brief return client socket, or listening socket if no client is connected.
+     */
+    virtual int get_fd();
+
 protected:
     /**
      * a fnTcpServer object representing a listening TCP server socket.
@@ -83,6 +83,11 @@ public:
      */
     virtual bool special_80(uint8_t *sp_buf, unsigned short len, cmdFrame_t *cmdFrame);
 
+    /**
+     * @brief return UDP socket descriptor.
+     */
+    virtual int get_fd() { return udp.fd(); }
+
 protected:
     
     /**
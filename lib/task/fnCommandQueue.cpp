@@ -0,0 +1,61 @@
+
+#include "fnCommandQueue.h"
+#include "fnEventLoop.h"
+
+// global bus command queue
+fnCommandQueue busQueue;
+
+
+int fnCommandQueue::run(command_t cmd)
+{
+    std::shared_ptr<entry> e = std::make_shared<entry>();
+    e->cmd = cmd;
+    std::future<int> f = e->result.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // called from bus thread, execute directly below
+        if (!(_owner_set && _owner == std::this_thread::get_id()))
+        {
+            _queue.push_back(e);
+            e = nullptr;
+        }
+    }
+
+    if (e != nullptr)
+        return cmd();
+
+    // let the main loop know
+    eventLoop.wakeup();
+    return f.get();
+}
+
+int fnCommandQueue::service()
+{
+    std::shared_ptr<entry> e;
+    int count = 0;
+
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_owner_set)
+            {
+                _owner = std::this_thread::get_id();
+                _owner_set = true;
+            }
+            if (_queue.empty())
+                return count;
+            e = _queue.front();
+            _queue.pop_front();
+        }
+        e->result.set_value(e->cmd());
+        count++;
+    }
+}
+
+bool fnCommandQueue::pending()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return !_queue.empty();
+}
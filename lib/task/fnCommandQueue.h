@@ -0,0 +1,49 @@
+#ifndef _FN_COMMANDQUEUE_H
+#define _FN_COMMANDQUEUE_H
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <thread>
+
+/*
+ * Command queue to run code on the bus (main loop) thread
+ *
+ * Other threads (web server) must not touch bus devices, mounted images or
+ * configuration directly. Instead they post a command with run(), main loop
+ * picks it up in service() and the caller waits until the command has been
+ * executed there. While the caller is blocked, the command may safely use
+ * objects owned by the caller (e.g. mongoose connection).
+ */
+
+class fnCommandQueue
+{
+public:
+    typedef std::function<int()> command_t;
+
+    // run command on the bus thread and wait for its result
+    int run(command_t cmd);
+    // execute pending commands, called by main loop, returns number of executed commands
+    int service();
+    // true if commands are waiting to be executed
+    bool pending();
+
+private:
+    struct entry
+    {
+        command_t cmd;
+        std::promise<int> result;
+    };
+
+    std::mutex _mutex;
+    std::deque<std::shared_ptr<entry>> _queue;
+    std::thread::id _owner;   // thread which services the queue
+    bool _owner_set = false;
+};
+
+// commands to be executed by the bus thread
+extern fnCommandQueue busQueue;
+
+#endif // _FN_COMMANDQUEUE_H
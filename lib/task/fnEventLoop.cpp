@@ -0,0 +1,216 @@
+
+#include "fnEventLoop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "compat_inet.h"
+
+#include "fnSystem.h"
+#include "debug.h"
+
+// global event loop
+fnEventLoop eventLoop;
+
+
+fnEventLoop::fnEventLoop()
+{
+    _deadline = 0;
+    _wakeup_rd = -1;
+    _wakeup_wr = -1;
+}
+
+fnEventLoop::~fnEventLoop()
+{
+#if defined(_WIN32)
+    if (_wakeup_rd >= 0)
+        closesocket(_wakeup_rd);
+#else
+    if (_wakeup_rd >= 0)
+        close(_wakeup_rd);
+    if (_wakeup_wr >= 0)
+        close(_wakeup_wr);
+#endif
+}
+
+// Wakeup channel is created on first use, on Windows sockets are not available
+// before WSAStartup() is called from main_setup()
+bool fnEventLoop::_init_wakeup()
+{
+    if (_wakeup_rd >= 0)
+        return true;
+
+#if defined(_WIN32)
+    // UDP socket connected to itself
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s == INVALID_SOCKET)
+    {
+        Debug_printf("fnEventLoop: failed to create wakeup socket: %d\n", compat_getsockerr());
+        return false;
+    }
+    struct sockaddr_in addr;
+    int addrlen = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(s, (struct sockaddr *)&addr, &addrlen) < 0 ||
+        connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        Debug_printf("fnEventLoop: failed to setup wakeup socket: %d\n", compat_getsockerr());
+        closesocket(s);
+        return false;
+    }
+    unsigned long on = 1;
+    ioctlsocket(s, FIONBIO, &on);
+    _wakeup_rd = _wakeup_wr = (int)s;
+#else
+    int p[2];
+    if (pipe(p) < 0)
+    {
+        Debug_printf("fnEventLoop: failed to create wakeup pipe: %d\n", errno);
+        return false;
+    }
+    fcntl(p[0], F_SETFL, O_NONBLOCK);
+    fcntl(p[1], F_SETFL, O_NONBLOCK);
+    _wakeup_rd = p[0];
+    _wakeup_wr = p[1];
+#endif
+    return true;
+}
+
+void fnEventLoop::_drain_wakeup()
+{
+    char buf[32];
+#if defined(_WIN32)
+    while (recv(_wakeup_rd, buf, sizeof(buf), 0) > 0)
+        ;
+#else
+    while (read(_wakeup_rd, buf, sizeof(buf)) > 0)
+        ;
+#endif
+}
+
+void fnEventLoop::begin()
+{
+    _fds.clear();
+    _deadline = 0;
+    if (_init_wakeup())
+        add_fd(_wakeup_rd, EVENT_READ);
+}
+
+void fnEventLoop::add_fd(int fd, int events)
+{
+    if (fd < 0)
+        return;
+
+    short pevents = 0;
+    if (events & EVENT_READ)
+        pevents |= POLLIN;
+    if (events & EVENT_WRITE)
+        pevents |= POLLOUT;
+
+    // merge with already registered fd
+    for (auto &pfd : _fds)
+    {
+        if ((int)pfd.fd == fd)
+        {
+            pfd.events |= pevents;
+            return;
+        }
+    }
+
+    fn_pollfd_t pfd;
+    pfd.fd = fd;
+    pfd.events = pevents;
+    pfd.revents = 0;
+    _fds.push_back(pfd);
+}
+
+void fnEventLoop::add_deadline(uint64_t ms)
+{
+    if (ms == 0)
+        return;
+    if (_deadline == 0 || ms < _deadline)
+        _deadline = ms;
+}
+
+void fnEventLoop::add_timeout(uint32_t ms)
+{
+    add_deadline(fnSystem.millis() + ms);
+}
+
+int fnEventLoop::wait(uint32_t max_ms)
+{
+    int timeout_ms = max_ms;
+
+    if (_deadline != 0)
+    {
+        uint64_t now = fnSystem.millis();
+        if (_deadline <= now)
+            timeout_ms = 0;
+        else if (_deadline - now < max_ms)
+            timeout_ms = (int)(_deadline - now);
+    }
+
+    uint64_t start_us = timeout_ms > 0 ? fnSystem.micros() : 0;
+
+#if defined(_WIN32)
+    int result = WSAPoll(_fds.data(), (ULONG)_fds.size(), timeout_ms);
+#else
+    int result = poll(_fds.data(), _fds.size(), timeout_ms);
+#endif
+
+    if (result < 0)
+    {
+        int err = compat_getsockerr();
+#if defined(_WIN32)
+        if (err != WSAEINTR)
+#else
+        if (err != EINTR)
+#endif
+            Debug_printf("fnEventLoop::wait() poll error %d: %s\n", err, compat_sockstrerror(err));
+        return 0;
+    }
+
+    // timed out, scheduling latency of the loop thread
+    if (result == 0 && timeout_ms > 0)
+    {
+        uint64_t slept = fnSystem.micros() - start_us;
+        _wake_latency.record(slept > timeout_ms * 1000ULL ? slept - timeout_ms * 1000ULL : 0);
+    }
+
+    if (result > 0 && _wakeup_rd >= 0 && ready(_wakeup_rd))
+    {
+        _drain_wakeup();
+        result--;
+    }
+    return result;
+}
+
+bool fnEventLoop::ready(int fd)
+{
+    for (auto &pfd : _fds)
+    {
+        if ((int)pfd.fd == fd)
+            return pfd.revents != 0;
+    }
+    return false;
+}
+
+void fnEventLoop::wakeup()
+{
+    if (_wakeup_wr < 0)
+        return;
+    char c = 0;
+#if defined(_WIN32)
+    send(_wakeup_wr, &c, 1, 0);
+#else
+    // write() is async-signal-safe, pipe is non-blocking
+    ssize_t n = write(_wakeup_wr, &c, 1);
+    (void)n;
+#endif
+}
@@ -0,0 +1,81 @@
+#ifndef _FN_EVENTLOOP_H
+#define _FN_EVENTLOOP_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "fnMetrics.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+typedef WSAPOLLFD fn_pollfd_t;
+#else
+#include <poll.h>
+typedef struct pollfd fn_pollfd_t;
+#endif
+
+/*
+ * Event loop (reactor) for the main service loop
+ *
+ * Instead of spinning through the services, the main loop asks every service
+ * what it is waiting for (file descriptors to become readable/writable and
+ * timer deadlines) and then sleeps in a single poll() call until one of those
+ * events happens.
+ *
+ * Typical iteration:
+ *   eventLoop.begin();           // clear wait set
+ *   xxx.prepare_wait();          // services call add_fd(), add_deadline(), add_timeout()
+ *   eventLoop.wait();            // sleep until something happens
+ *
+ * wakeup() can be called from other threads (or signal handler) to interrupt
+ * the wait.
+ */
+
+#define EVENTLOOP_MAX_WAIT_MS 1000 // upper limit for single wait, in case somebody forgets to add deadline
+
+class fnEventLoop
+{
+public:
+    enum event_flags
+    {
+        EVENT_READ = 0x01,
+        EVENT_WRITE = 0x02
+    };
+
+    fnEventLoop();
+    ~fnEventLoop();
+
+    // start new wait set
+    void begin();
+    // wait for fd to become readable and/or writable
+    void add_fd(int fd, int events = EVENT_READ);
+    // wake up at absolute time (fnSystem.millis() based), 0 is ignored
+    void add_deadline(uint64_t ms);
+    // wake up after ms milliseconds, 0 to not sleep at all
+    void add_timeout(uint32_t ms);
+    // sleep until any of the requested events, returns number of ready fds
+    int wait(uint32_t max_ms = EVENTLOOP_MAX_WAIT_MS);
+    // check if fd was reported ready by last wait()
+    bool ready(int fd);
+    // interrupt wait(), safe to call from other threads and signal handler
+    void wakeup();
+    // how late (us) wait() returned after its timeout expired
+    fnHistogram &wake_latency() { return _wake_latency; }
+
+private:
+    bool _init_wakeup();
+    void _drain_wakeup();
+
+    std::vector<fn_pollfd_t> _fds;
+    uint64_t _deadline;
+    fnHistogram _wake_latency;
+
+    // wakeup channel: pipe on Linux/macOS, loopback UDP socket on Windows
+    int _wakeup_rd;
+    int _wakeup_wr;
+};
+
+// global event loop
+extern fnEventLoop eventLoop;
+
+#endif // _FN_EVENTLOOP_H
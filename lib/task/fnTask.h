@@ -30,6 +30,9 @@ public:
     done_reason get_done_reason() {return _reason;};
     virtual int get_progress() {return 0;};         // optional
     virtual void * get_result() {return nullptr;};  // optional
+    // RUNNING task waits for worker pool job, step() is not called meanwhile
+    // and main loop may sleep, job completion wakes it up
+    virtual bool waiting() {return false;};         // optional
 
 protected:
     // task state management
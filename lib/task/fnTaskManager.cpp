@@ -180,6 +180,8 @@ bool fnTaskManager::service()
             break;
 
         case fnTask::TASK_RUNNING:
+            if (task->waiting())
+                break;
             idle = false;
             result = task->step();
             if (result < 0)
@@ -0,0 +1,94 @@
+
+#include "fnWorkerPool.h"
+#include "fnEventLoop.h"
+#include "fnTrace.h"
+#include "fnRealtime.h"
+
+#include "debug.h"
+
+// global worker pool
+fnWorkerPool workerPool;
+
+
+void fnJob::wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [this]() { return done(); });
+}
+
+fnWorkerPool::~fnWorkerPool()
+{
+    end();
+}
+
+std::shared_ptr<fnJob> fnWorkerPool::submit(std::function<int()> work)
+{
+    std::shared_ptr<fnJob> job = std::make_shared<fnJob>();
+    job->_work = work;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_stop)
+    {
+        // shutting down, run it here
+        job->_result = work();
+        job->_done = true;
+        return job;
+    }
+    if (_threads.empty())
+    {
+        Debug_printf("Starting %d worker threads\n", WORKERPOOL_THREADS);
+        for (int i = 0; i < WORKERPOOL_THREADS; i++)
+            _threads.emplace_back(&fnWorkerPool::_worker, this);
+    }
+    _queue.push_back(job);
+    _cv.notify_one();
+    return job;
+}
+
+void fnWorkerPool::end()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    for (auto &t : _threads)
+    {
+        if (t.joinable())
+            t.join();
+    }
+    _threads.clear();
+}
+
+void fnWorkerPool::_worker()
+{
+    std::shared_ptr<fnJob> job;
+    fnTracer.set_thread_name("worker");
+    // blocking jobs must not compete with the bus thread
+    fnRealtime::normal_priority();
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait(lock, [this]() { return _stop || !_queue.empty(); });
+            if (_queue.empty())
+                return; // stopping
+            job = _queue.front();
+            _queue.pop_front();
+        }
+
+        int result = job->_work();
+
+        {
+            std::lock_guard<std::mutex> lock(job->_mutex);
+            job->_result = result;
+            job->_done.store(true, std::memory_order_release);
+        }
+        job->_cv.notify_all();
+        job = nullptr;
+
+        // let the bus thread pick up the result
+        eventLoop.wakeup();
+    }
+}
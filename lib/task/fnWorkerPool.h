@@ -0,0 +1,70 @@
+#ifndef _FN_WORKERPOOL_H
+#define _FN_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define WORKERPOOL_THREADS 4 // number of worker threads
+
+/*
+ * Worker pool for blocking backend I/O
+ *
+ * Slow operations (connect, DNS lookup, TLS handshake, ...) are submitted
+ * as jobs and executed by worker threads, so the bus thread can keep
+ * serving other devices. When a job finishes, the event loop is woken up
+ * and the bus thread picks up the result via fnJob::done()/result().
+ *
+ * Job function must not touch bus state, only the objects owned by the
+ * device which submitted it.
+ */
+
+class fnJob
+{
+    friend class fnWorkerPool;
+
+public:
+    // true when job has finished
+    bool done() { return _done.load(std::memory_order_acquire); }
+    // job function return value, valid after done()
+    int result() { return _result; }
+    // block until job has finished
+    void wait();
+
+private:
+    std::function<int()> _work;
+    std::atomic<bool> _done{false};
+    int _result = 0;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+};
+
+class fnWorkerPool
+{
+public:
+    ~fnWorkerPool();
+
+    // queue job for execution, worker threads are started on first use
+    std::shared_ptr<fnJob> submit(std::function<int()> work);
+    // stop worker threads, waits for running jobs
+    void end();
+
+private:
+    void _worker();
+
+    std::vector<std::thread> _threads;
+    std::deque<std::shared_ptr<fnJob>> _queue;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop = false;
+};
+
+// global worker pool
+extern fnWorkerPool workerPool;
+
+#endif // _FN_WORKERPOOL_H
@@ -2,10 +2,14 @@
 
 // #include <lwip/netdb.h>
 
+#include <cstring>
+
 #include "../../include/debug.h"
 
 
 // Return a single IP4 address given a hostname
+// Called from bus, web server and worker pool threads, getaddrinfo() is used
+// instead of gethostbyname() which returns pointer to shared static data
 in_addr_t get_ip4_addr_by_name(const char *hostname)
 {
     in_addr_t result = IPADDR_NONE;
@@ -13,9 +17,12 @@ in_addr_t get_ip4_addr_by_name(const char *hostname)
     #ifdef DEBUG
     Debug_printf("Resolving hostname \"%s\"\r\n", hostname);
     #endif
-    struct hostent *info = gethostbyname(hostname);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
 
-    if(info == nullptr)
+    struct addrinfo *info = nullptr;
+    if(getaddrinfo(hostname, nullptr, &hints, &info) != 0 || info == nullptr)
     {
         #ifdef DEBUG
         Debug_println("Name failed to resolve");
@@ -23,13 +30,12 @@ in_addr_t get_ip4_addr_by_name(const char *hostname)
     }
     else
     {
-        if(info->h_addr_list[0] != nullptr)
-        {
-            result = *((in_addr_t*)(info->h_addr_list[0]));
-            #ifdef DEBUG
-            Debug_printf("Resolved to address %s\r\n", compat_inet_ntoa(result));
-            #endif
-        }
+        result = ((struct sockaddr_in *)info->ai_addr)->sin_addr.s_addr;
+        #ifdef DEBUG
+        Debug_printf("Resolved to address %s\r\n", compat_inet_ntoa(result));
+        #endif
     }
+    if(info != nullptr)
+        freeaddrinfo(info);
     return result;
-}
\ No newline at end of file
+}
@@ -35,6 +35,7 @@ class fnTcpServer
     void stop();
 
     operator bool(){ return _listening; }
+    int fd() const { return _sockfd; }
 };
 
 
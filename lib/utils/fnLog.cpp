@@ -0,0 +1,348 @@
+
+#include "fnLog.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include "compat_string.h"
+#include "compat_gettimeofday.h"
+
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+
+// global debug log
+fnLog fnLogger;
+
+/*
+ * Ring of log records (bounded multi-producer, single consumer queue)
+ * Every record has a sequence number telling whose turn it is: producer owns the
+ * record when seq equals the round base of its position (position & ~mask), the
+ * writer owns it when seq is base + 1, and releases it for the next round by
+ * setting base + LOG_RING_SIZE. All zeros is a valid empty ring.
+ */
+struct log_record
+{
+    std::atomic<uint64_t> seq;
+    uint64_t timestamp;     // us since epoch
+    uint16_t len;
+    char text[LOG_RECORD_TEXT];
+};
+
+static log_record _ring[LOG_RING_SIZE];
+static std::atomic<uint64_t> _enqueue_pos{0};
+static uint64_t _dequeue_pos = 0;
+static std::atomic<uint64_t> _dropped{0};
+static std::atomic<int> _level{LOG_LEVEL_VERBOSE};
+static std::atomic<const std::vector<std::string> *> _filter{nullptr}; // nullptr = pass all
+static std::atomic<bool> _running{false};
+static std::atomic<bool> _direct{false};   // writer was stopped, print directly
+
+static const char *_level_names[LOG_LEVEL_INVALID] = {
+    "none",
+    "debug",
+    "verbose"
+};
+
+
+// add record to the ring, false if the ring is full
+static bool _push(uint64_t timestamp, const char *text, size_t len)
+{
+    log_record *r;
+    uint64_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        r = &_ring[pos & LOG_RING_MASK];
+        uint64_t seq = r->seq.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)(seq - (pos & ~(uint64_t)LOG_RING_MASK));
+        if (diff == 0)
+        {
+            if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+            return false; // full
+        else
+            pos = _enqueue_pos.load(std::memory_order_relaxed);
+    }
+
+    r->timestamp = timestamp;
+    r->len = (uint16_t)len;
+    memcpy(r->text, text, len);
+    r->seq.store((pos & ~(uint64_t)LOG_RING_MASK) + 1, std::memory_order_release);
+    return true;
+}
+
+fnLog::~fnLog()
+{
+    end();
+}
+
+void fnLog::begin()
+{
+    if (_running)
+        return;
+    _direct = false;
+    _running = true;
+    _thread = std::thread(&fnLog::_writer, this);
+}
+
+void fnLog::end()
+{
+    if (_running)
+    {
+        _running = false;
+        _cv.notify_one();
+        if (_thread.joinable())
+            _thread.join();
+    }
+    // anything logged from now on is printed by the caller
+    std::lock_guard<std::mutex> lock(_print_mutex);
+    while (_drain_one())
+        ;
+    _direct = true;
+    fflush(stdout);
+}
+
+void fnLog::set_level(fnLogLevel level)
+{
+    if (level >= LOG_LEVEL_NONE && level < LOG_LEVEL_INVALID)
+        _level.store(level, std::memory_order_relaxed);
+}
+
+fnLogLevel fnLog::get_level()
+{
+    return (fnLogLevel)_level.load(std::memory_order_relaxed);
+}
+
+uint64_t fnLog::get_dropped()
+{
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+void fnLog::set_filter(const std::string &filter)
+{
+    std::lock_guard<std::mutex> lock(_print_mutex);
+    _filter_str = filter;
+    std::unique_ptr<std::vector<std::string>> items(new std::vector<std::string>);
+    size_t start = 0;
+    while (start <= filter.size())
+    {
+        size_t end = filter.find(',', start);
+        if (end == std::string::npos)
+            end = filter.size();
+        std::string item = filter.substr(start, end - start);
+        // trim spaces
+        item.erase(0, item.find_first_not_of(' '));
+        item.erase(item.find_last_not_of(' ') + 1);
+        if (!item.empty())
+            items->push_back(item);
+        start = end + 1;
+    }
+    // published filter is never changed, replaced ones are freed on exit
+    _filter.store(items->empty() ? nullptr : items.get(), std::memory_order_release);
+    if (!items->empty())
+        _filters.push_back(std::move(items));
+}
+
+std::string fnLog::get_filter()
+{
+    std::lock_guard<std::mutex> lock(_print_mutex);
+    return _filter_str;
+}
+
+fnLogLevel fnLog::level_from_string(const char *str)
+{
+    int i = 0;
+    for (; i < LOG_LEVEL_INVALID; i++)
+        if (strcasecmp(_level_names[i], str) == 0)
+            break;
+    return (fnLogLevel)i;
+}
+
+const char *fnLog::level_name(fnLogLevel level)
+{
+    if (level < LOG_LEVEL_NONE || level >= LOG_LEVEL_INVALID)
+        return "invalid";
+    return _level_names[level];
+}
+
+// source path contains filter item, '/' matches '\' too
+static bool _path_contains(const char *path, const char *item)
+{
+    for (; *path; path++)
+    {
+        const char *p = path;
+        const char *i = item;
+        while (*p && *i && (*p == *i || ((*p == '/' || *p == '\\') && (*i == '/' || *i == '\\'))))
+        {
+            p++;
+            i++;
+        }
+        if (*i == '\0')
+            return true;
+    }
+    return false;
+}
+
+static bool _filter_match(const std::vector<std::string> *filter, const char *file)
+{
+    if (filter == nullptr || file == nullptr)
+        return true;
+
+    bool include_only = false;
+    for (const std::string &item : *filter)
+    {
+        if (item[0] == '-')
+        {
+            if (_path_contains(file, item.c_str() + 1))
+                return false;
+        }
+        else
+        {
+            if (_path_contains(file, item.c_str()))
+                return true;
+            include_only = true;
+        }
+    }
+    // with include items, sources not matching any of them are filtered out
+    return !include_only;
+}
+
+void fnLog::vlog(fnLogLevel level, const char *file, const char *fmt, va_list args)
+{
+    // drop unwanted messages before they cost formatting and ring records
+    if (level > _level.load(std::memory_order_relaxed) ||
+        !_filter_match(_filter.load(std::memory_order_acquire), file))
+        return;
+
+    struct timeval tv;
+    compat_gettimeofday(&tv, NULL);
+    uint64_t timestamp = (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+
+    char buf[1024];
+    const char *text = buf;
+    std::string big;
+    size_t len;
+
+    if (fmt == nullptr)
+    {
+        text = va_arg(args, const char *);
+        len = strlen(text);
+    }
+    else
+    {
+        va_list args2;
+        va_copy(args2, args);
+        int n = vsnprintf(buf, sizeof(buf), fmt, args);
+        if (n < 0)
+            n = 0;
+        if ((size_t)n >= sizeof(buf))
+        {
+            // long message (hex dump), rare enough to allocate
+            big.resize(n + 1);
+            vsnprintf(&big[0], n + 1, fmt, args2);
+            text = big.c_str();
+        }
+        va_end(args2);
+        len = (size_t)n;
+    }
+
+    if (_direct.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(_print_mutex);
+        _print(timestamp, text, len);
+        fflush(stdout);
+        return;
+    }
+
+    // split into records, give up on the rest of the message when the ring is full
+    do
+    {
+        size_t chunk = len > LOG_RECORD_TEXT ? LOG_RECORD_TEXT : len;
+        if (!_push(timestamp, text, chunk))
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+        text += chunk;
+        len -= chunk;
+    } while (len > 0);
+
+    if (_running.load(std::memory_order_relaxed))
+        _cv.notify_one();
+}
+
+void fnLog::_print(uint64_t timestamp, const char *text, size_t len)
+{
+    if (len == 0)
+        return;
+
+    if (_line_start)
+    {
+        struct tm tm;
+        char buffer[32];
+        time_t t = (time_t)(timestamp / 1000000ULL);
+#if defined(_WIN32)
+        localtime_s(&tm, &t);
+#else
+        localtime_r(&t, &tm);
+#endif
+        size_t endpos = strftime(buffer, sizeof(buffer), "%H:%M:%S", &tm);
+        snprintf(buffer + endpos, sizeof(buffer) - endpos, ".%06d", (int)(timestamp % 1000000ULL));
+        printf("%s > ", buffer);
+    }
+    fwrite(text, 1, len, stdout);
+    _line_start = text[len - 1] == '\n';
+}
+
+// print one record from the ring, false if there is none
+bool fnLog::_drain_one()
+{
+    log_record &r = _ring[_dequeue_pos & LOG_RING_MASK];
+    uint64_t base = _dequeue_pos & ~(uint64_t)LOG_RING_MASK;
+    if (r.seq.load(std::memory_order_acquire) != base + 1)
+        return false;
+
+    _print(r.timestamp, r.text, r.len);
+
+    r.seq.store(base + LOG_RING_SIZE, std::memory_order_release);
+    _dequeue_pos++;
+    return true;
+}
+
+void fnLog::_writer()
+{
+    for (;;)
+    {
+        bool running = _running.load();
+        int count = 0;
+        {
+            std::lock_guard<std::mutex> lock(_print_mutex);
+            while (_drain_one())
+                count++;
+
+            uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+            if (dropped != _dropped_reported)
+            {
+                if (!_line_start)
+                    printf("\n");
+                printf("*** %llu debug messages dropped ***\n", (unsigned long long)(dropped - _dropped_reported));
+                _line_start = true;
+                _dropped_reported = dropped;
+                count++;
+            }
+        }
+
+        if (count > 0)
+        {
+            fflush(stdout);
+            continue;
+        }
+        if (!running)
+            return;
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait_for(lock, std::chrono::milliseconds(LOG_WRITER_IDLE_MS));
+    }
+}
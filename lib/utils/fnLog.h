@@ -0,0 +1,87 @@
+#ifndef _FN_LOG_H
+#define _FN_LOG_H
+
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define LOG_RING_SIZE 1024      // number of records, must be power of 2
+#define LOG_RECORD_TEXT 240     // longer messages are split into more records
+#define LOG_WRITER_IDLE_MS 100  // writer checks for records at least this often
+
+enum fnLogLevel
+{
+    LOG_LEVEL_NONE = 0,
+    LOG_LEVEL_DEBUG,            // Debug_print, Debug_printf, Debug_println
+    LOG_LEVEL_VERBOSE,          // Debug_printv
+    LOG_LEVEL_INVALID
+};
+
+/*
+ * Asynchronous debug log
+ *
+ * Debug_print* macros format the message into a record of a bounded lock-free
+ * ring and return, background writer thread prints the records. If the ring
+ * is full, the message is dropped (and counted) rather than blocking the caller.
+ * Records hold formatted text, not format string and arguments: arguments are
+ * often pointers to the caller's temporary buffers, gone when the writer runs.
+ *
+ * Messages above the log level or not passing the subsystem filter are discarded
+ * at the call site, before formatting. Subsystem filter is a comma separated list
+ * of source path parts ("bus/sio,network-protocol"), entries starting with '-'
+ * exclude matching sources. Empty filter passes all.
+ *
+ * The ring lives in static storage initialized at compile time, so messages from
+ * constructors of other global objects are kept until the writer is started.
+ */
+
+class fnLog
+{
+public:
+    ~fnLog();
+
+    // start writer thread, prints messages logged so far
+    void begin();
+    // print pending messages and stop writer, next messages are printed directly
+    void end();
+
+    void set_level(fnLogLevel level);
+    fnLogLevel get_level();
+    void set_filter(const std::string &filter);
+    std::string get_filter();
+
+    static fnLogLevel level_from_string(const char *str);
+    static const char *level_name(fnLogLevel level);
+
+    // if fmt is nullptr, first argument is the string to log
+    void vlog(fnLogLevel level, const char *file, const char *fmt, va_list args);
+
+    // number of messages dropped because the ring was full
+    uint64_t get_dropped();
+
+private:
+    void _print(uint64_t timestamp, const char *text, size_t len);
+    bool _drain_one();
+    void _writer();
+
+    // output state, used by writer thread (or callers after end())
+    std::mutex _print_mutex;
+    // every filter set, callers may still be matching against a replaced one
+    std::vector<std::unique_ptr<std::vector<std::string>>> _filters;
+    std::string _filter_str;
+    bool _line_start = true;
+    uint64_t _dropped_reported = 0;
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+};
+
+extern fnLog fnLogger;
+
+#endif // _FN_LOG_H
@@ -0,0 +1,388 @@
+
+#include "fnMetrics.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+#include "fujiHost.h"
+#include "fnLog.h"
+#include "fnBlockCache.h"
+
+// global bus metrics
+fnMetrics busMetrics;
+
+// histogram buckets exported to Prometheus, in microseconds
+static const uint64_t _prometheus_buckets[] = {
+    500, 1000, 2500, 5000, 10000, 25000, 50000, 100000,
+    250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+static const double _quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+static const char *_host_type_name(int host_type)
+{
+    switch (host_type)
+    {
+    case HOSTTYPE_LOCAL:
+        return "local";
+    case HOSTTYPE_TNFS:
+        return "tnfs";
+    case HOSTTYPE_SMB:
+        return "smb";
+    case HOSTTYPE_FTP:
+        return "ftp";
+    default:
+        return "none";
+    }
+}
+
+
+int fnHistogram::bucket_index(uint64_t value_us)
+{
+    if (value_us < 2 * HIST_SUB_COUNT)
+        return (int)value_us;
+
+    int msb = 63 - __builtin_clzll(value_us);
+    if (msb >= HIST_MAX_BITS)
+        return HIST_BUCKETS - 1;
+    int shift = msb - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (int)(value_us >> shift) - HIST_SUB_COUNT;
+}
+
+uint64_t fnHistogram::bucket_upper(int index)
+{
+    if (index < 2 * HIST_SUB_COUNT)
+        return (uint64_t)index;
+
+    int shift = index / HIST_SUB_COUNT - 1;
+    uint64_t mantissa = (uint64_t)(index % HIST_SUB_COUNT + HIST_SUB_COUNT);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void fnHistogram::record(uint64_t value_us)
+{
+    _buckets[bucket_index(value_us)].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value_us, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t fnHistogram::quantile(double q)
+{
+    uint64_t total = count();
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(q * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += _buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return bucket_upper(i);
+    }
+    // count was updated while we were reading
+    return bucket_upper(HIST_BUCKETS - 1);
+}
+
+uint64_t fnHistogram::count_below(uint64_t limit_us)
+{
+    uint64_t n = 0;
+    for (int i = 0; i < HIST_BUCKETS && bucket_upper(i) <= limit_us; i++)
+        n += _buckets[i].load(std::memory_order_relaxed);
+    return n;
+}
+
+
+// Install object allocated on first use, any thread may record, the one losing
+// the race frees its copy and uses the winner's
+template <typename T>
+static T *_install(std::atomic<T *> &slot)
+{
+    T *p = slot.load(std::memory_order_acquire);
+    if (p == nullptr)
+    {
+        T *fresh = new T;
+        if (slot.compare_exchange_strong(p, fresh, std::memory_order_acq_rel, std::memory_order_acquire))
+            p = fresh;
+        else
+            delete fresh;
+    }
+    return p;
+}
+
+// Per device metrics, allocated on first use
+fnMetrics::device_metrics *fnMetrics::_device(uint8_t device)
+{
+    return _install(_devices[device]);
+}
+
+void fnMetrics::command_latency(uint8_t device, uint8_t command, uint8_t host_type, uint64_t latency_us)
+{
+    if (host_type >= METRICS_HOST_TYPES)
+        host_type = 0;
+
+    _install(_device(device)->latency[command][host_type])->record(latency_us);
+}
+
+void fnMetrics::nak(uint8_t device)
+{
+    _device(device)->naks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void fnMetrics::data_checksum_error(uint8_t device)
+{
+    _device(device)->data_checksum_errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+void fnMetrics::deadline_missed(uint8_t device)
+{
+    _device(device)->deadlines_missed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void fnMetrics::baudrate_toggled(int baudrate)
+{
+    _baudrate_toggles.fetch_add(1, std::memory_order_relaxed);
+    _baudrate.store(baudrate, std::memory_order_relaxed);
+}
+
+void fnMetrics::netsio_credit_wait(uint64_t wait_us, bool stalled)
+{
+    _netsio_credit_waits.fetch_add(1, std::memory_order_relaxed);
+    _netsio_credit_wait_us.fetch_add(wait_us, std::memory_order_relaxed);
+    if (stalled)
+        _netsio_credit_stalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+void fnMetrics::disk_readahead(bool hit)
+{
+    if (hit)
+        _readahead_hits.fetch_add(1, std::memory_order_relaxed);
+    else
+        _readahead_misses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void fnMetrics::disk_readahead_fetch(unsigned int sectors)
+{
+    _readahead_fetches.fetch_add(1, std::memory_order_relaxed);
+    _readahead_sectors.fetch_add(sectors, std::memory_order_relaxed);
+}
+
+void fnMetrics::disk_writeback_flush(bool ok, unsigned int sectors, unsigned int runs)
+{
+    if (!ok)
+    {
+        _writeback_failures.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    _writeback_flushes.fetch_add(1, std::memory_order_relaxed);
+    _writeback_sectors.fetch_add(sectors, std::memory_order_relaxed);
+    _writeback_runs.fetch_add(runs, std::memory_order_relaxed);
+}
+
+// printf-like append to string
+static void _append(std::string &out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void _append(std::string &out, const char *fmt, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n > 0)
+        out.append(buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+void fnMetrics::format_prometheus(std::string &out)
+{
+    out.reserve(out.size() + 16384);
+
+    _append(out, "# HELP fujinet_sio_command_duration_seconds Time from command frame to end of command processing.\n");
+    _append(out, "# TYPE fujinet_sio_command_duration_seconds histogram\n");
+    for (int d = 0; d < 256; d++)
+    {
+        device_metrics *dm = _devices[d].load(std::memory_order_acquire);
+        if (dm == nullptr)
+            continue;
+        for (int c = 0; c < 256; c++)
+        {
+            for (int t = 0; t < METRICS_HOST_TYPES; t++)
+            {
+                fnHistogram *h = dm->latency[c][t].load(std::memory_order_acquire);
+                if (h == nullptr)
+                    continue;
+
+                char labels[64];
+                snprintf(labels, sizeof(labels), "device=\"0x%02x\",command=\"0x%02x\",host=\"%s\"",
+                         d, c, _host_type_name(t));
+                // read count first, buckets updated later can only make them bigger
+                uint64_t count = h->count();
+                uint64_t sum = h->sum();
+                for (uint64_t limit : _prometheus_buckets)
+                {
+                    uint64_t n = h->count_below(limit);
+                    _append(out, "fujinet_sio_command_duration_seconds_bucket{%s,le=\"%g\"} %llu\n",
+                            labels, limit / 1e6, (unsigned long long)(n < count ? n : count));
+                }
+                _append(out, "fujinet_sio_command_duration_seconds_bucket{%s,le=\"+Inf\"} %llu\n",
+                        labels, (unsigned long long)count);
+                _append(out, "fujinet_sio_command_duration_seconds_sum{%s} %.6f\n", labels, sum / 1e6);
+                _append(out, "fujinet_sio_command_duration_seconds_count{%s} %llu\n",
+                        labels, (unsigned long long)count);
+            }
+        }
+    }
+
+    // quantiles at full histogram resolution, for single instance use without Prometheus
+    _append(out, "# HELP fujinet_sio_command_duration_quantile_seconds Command duration quantiles since start.\n");
+    _append(out, "# TYPE fujinet_sio_command_duration_quantile_seconds gauge\n");
+    for (int d = 0; d < 256; d++)
+    {
+        device_metrics *dm = _devices[d].load(std::memory_order_acquire);
+        if (dm == nullptr)
+            continue;
+        for (int c = 0; c < 256; c++)
+        {
+            for (int t = 0; t < METRICS_HOST_TYPES; t++)
+            {
+                fnHistogram *h = dm->latency[c][t].load(std::memory_order_acquire);
+                if (h == nullptr)
+                    continue;
+                for (double q : _quantiles)
+                    _append(out, "fujinet_sio_command_duration_quantile_seconds{device=\"0x%02x\",command=\"0x%02x\",host=\"%s\",quantile=\"%g\"} %.6f\n",
+                            d, c, _host_type_name(t), q, h->quantile(q) / 1e6);
+            }
+        }
+    }
+
+    // counters per device
+    struct
+    {
+        const char *name;
+        const char *help;
+        std::atomic<uint64_t> device_metrics::*counter;
+    } counters[] = {
+        {"fujinet_sio_naks_total", "NAKs sent by device.", &device_metrics::naks},
+        {"fujinet_sio_data_checksum_errors_total", "Data frames received with bad checksum.", &device_metrics::data_checksum_errors},
+        {"fujinet_sio_deadlines_missed_total", "Commands answered with timed ERROR.", &device_metrics::deadlines_missed},
+    };
+    for (auto &counter : counters)
+    {
+        _append(out, "# HELP %s %s\n", counter.name, counter.help);
+        _append(out, "# TYPE %s counter\n", counter.name);
+        for (int d = 0; d < 256; d++)
+        {
+            device_metrics *dm = _devices[d].load(std::memory_order_acquire);
+            if (dm != nullptr)
+                _append(out, "%s{device=\"0x%02x\"} %llu\n", counter.name, d,
+                        (unsigned long long)(dm->*counter.counter).load(std::memory_order_relaxed));
+        }
+    }
+
+    _append(out, "# HELP fujinet_sio_command_checksum_errors_total Command frames received with bad checksum.\n");
+    _append(out, "# TYPE fujinet_sio_command_checksum_errors_total counter\n");
+    _append(out, "fujinet_sio_command_checksum_errors_total %llu\n",
+            (unsigned long long)_command_checksum_errors.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_sio_baudrate_toggles_total Switches between standard and high speed SIO.\n");
+    _append(out, "# TYPE fujinet_sio_baudrate_toggles_total counter\n");
+    _append(out, "fujinet_sio_baudrate_toggles_total %llu\n",
+            (unsigned long long)_baudrate_toggles.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_sio_baudrate Current SIO baud rate.\n");
+    _append(out, "# TYPE fujinet_sio_baudrate gauge\n");
+    _append(out, "fujinet_sio_baudrate %d\n", _baudrate.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_netsio_credit_window Credit window asked from NetSIO hub.\n");
+    _append(out, "# TYPE fujinet_netsio_credit_window gauge\n");
+    _append(out, "fujinet_netsio_credit_window %d\n", _netsio_credit_window.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_netsio_credit_waits_total Writes blocked waiting for NetSIO credit.\n");
+    _append(out, "# TYPE fujinet_netsio_credit_waits_total counter\n");
+    _append(out, "fujinet_netsio_credit_waits_total %llu\n",
+            (unsigned long long)_netsio_credit_waits.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_netsio_credit_wait_seconds_total Time spent waiting for NetSIO credit.\n");
+    _append(out, "# TYPE fujinet_netsio_credit_wait_seconds_total counter\n");
+    _append(out, "fujinet_netsio_credit_wait_seconds_total %.6f\n",
+            _netsio_credit_wait_us.load(std::memory_order_relaxed) / 1e6);
+
+    _append(out, "# HELP fujinet_netsio_credit_stalls_total Credit requests not answered by NetSIO hub in time.\n");
+    _append(out, "# TYPE fujinet_netsio_credit_stalls_total counter\n");
+    _append(out, "fujinet_netsio_credit_stalls_total %llu\n",
+            (unsigned long long)_netsio_credit_stalls.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_disk_readahead_hits_total Disk sector reads served from read-ahead buffer.\n");
+    _append(out, "# TYPE fujinet_disk_readahead_hits_total counter\n");
+    _append(out, "fujinet_disk_readahead_hits_total %llu\n",
+            (unsigned long long)_readahead_hits.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_disk_readahead_misses_total Disk sector reads with read-ahead enabled that went to the backend.\n");
+    _append(out, "# TYPE fujinet_disk_readahead_misses_total counter\n");
+    _append(out, "fujinet_disk_readahead_misses_total %llu\n",
+            (unsigned long long)_readahead_misses.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_disk_readahead_fetches_total Backend reads fetching sectors ahead.\n");
+    _append(out, "# TYPE fujinet_disk_readahead_fetches_total counter\n");
+    _append(out, "fujinet_disk_readahead_fetches_total %llu\n",
+            (unsigned long long)_readahead_fetches.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_disk_readahead_sectors_total Sectors fetched ahead.\n");
+    _append(out, "# TYPE fujinet_disk_readahead_sectors_total counter\n");
+    _append(out, "fujinet_disk_readahead_sectors_total %llu\n",
+            (unsigned long long)_readahead_sectors.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_disk_writeback_flushes_total Write-back cache flushes written to the image.\n");
+    _append(out, "# TYPE fujinet_disk_writeback_flushes_total counter\n");
+    _append(out, "fujinet_disk_writeback_flushes_total %llu\n",
+            (unsigned long long)_writeback_flushes.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_disk_writeback_failures_total Write-back cache flushes that failed.\n");
+    _append(out, "# TYPE fujinet_disk_writeback_failures_total counter\n");
+    _append(out, "fujinet_disk_writeback_failures_total %llu\n",
+            (unsigned long long)_writeback_failures.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_disk_writeback_sectors_total Sectors written by write-back cache flushes.\n");
+    _append(out, "# TYPE fujinet_disk_writeback_sectors_total counter\n");
+    _append(out, "fujinet_disk_writeback_sectors_total %llu\n",
+            (unsigned long long)_writeback_sectors.load(std::memory_order_relaxed));
+
+    _append(out, "# HELP fujinet_disk_writeback_runs_total Backend writes of contiguous sector runs by write-back cache flushes.\n");
+    _append(out, "# TYPE fujinet_disk_writeback_runs_total counter\n");
+    _append(out, "fujinet_disk_writeback_runs_total %llu\n",
+            (unsigned long long)_writeback_runs.load(std::memory_order_relaxed));
+
+    blockcache_stats bc = blockCache.get_stats();
+    _append(out, "# HELP fujinet_block_cache_hits_total Image block reads served from shared block cache.\n");
+    _append(out, "# TYPE fujinet_block_cache_hits_total counter\n");
+    _append(out, "fujinet_block_cache_hits_total %llu\n", (unsigned long long)bc.hits);
+
+    _append(out, "# HELP fujinet_block_cache_misses_total Image blocks read from backend into shared block cache.\n");
+    _append(out, "# TYPE fujinet_block_cache_misses_total counter\n");
+    _append(out, "fujinet_block_cache_misses_total %llu\n", (unsigned long long)bc.misses);
+
+    _append(out, "# HELP fujinet_block_cache_evictions_total Blocks dropped to stay within block cache budget.\n");
+    _append(out, "# TYPE fujinet_block_cache_evictions_total counter\n");
+    _append(out, "fujinet_block_cache_evictions_total %llu\n", (unsigned long long)bc.evictions);
+
+    _append(out, "# HELP fujinet_block_cache_bytes Bytes held by shared block cache.\n");
+    _append(out, "# TYPE fujinet_block_cache_bytes gauge\n");
+    _append(out, "fujinet_block_cache_bytes %llu\n", (unsigned long long)bc.used);
+
+    _append(out, "# HELP fujinet_block_cache_images Disk images open through shared block cache.\n");
+    _append(out, "# TYPE fujinet_block_cache_images gauge\n");
+    _append(out, "fujinet_block_cache_images %u\n", bc.images);
+
+    _append(out, "# HELP fujinet_block_cache_local_bytes Bytes held in local copies of prefetched images.\n");
+    _append(out, "# TYPE fujinet_block_cache_local_bytes gauge\n");
+    _append(out, "fujinet_block_cache_local_bytes %llu\n", (unsigned long long)bc.local);
+
+    _append(out, "# HELP fujinet_block_cache_local_images Prefetched images read from local copy only.\n");
+    _append(out, "# TYPE fujinet_block_cache_local_images gauge\n");
+    _append(out, "fujinet_block_cache_local_images %u\n", bc.local_images);
+
+    _append(out, "# HELP fujinet_log_dropped_total Debug messages dropped because the log ring was full.\n");
+    _append(out, "# TYPE fujinet_log_dropped_total counter\n");
+    _append(out, "fujinet_log_dropped_total %llu\n", (unsigned long long)fnLogger.get_dropped());
+}
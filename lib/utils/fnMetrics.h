@@ -0,0 +1,108 @@
+#ifndef _FN_METRICS_H
+#define _FN_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define HIST_SUB_BITS 5                             // 32 sub-buckets per power of 2, ~3% precision
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 27                            // values up to 2^27 us (134 s), longer are clamped
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+#define METRICS_HOST_TYPES 8                        // fujiHostType values tracked per command
+
+/*
+ * Latency histogram with HDR-style log-linear buckets
+ * Values (microseconds) below 2 * HIST_SUB_COUNT are counted exactly, bigger values
+ * fall into one of HIST_SUB_COUNT buckets per power of 2. Recorded by one thread,
+ * can be read by others at any time.
+ */
+class fnHistogram
+{
+public:
+    void record(uint64_t value_us);
+
+    uint64_t count() { return _count.load(std::memory_order_relaxed); }
+    uint64_t sum() { return _sum.load(std::memory_order_relaxed); }
+    // value at quantile (0.0 - 1.0), upper bound of the bucket
+    uint64_t quantile(double q);
+    // number of values <= limit, values sharing a bucket with limit are counted if bucket ends at or below it
+    uint64_t count_below(uint64_t limit_us);
+
+    static int bucket_index(uint64_t value_us);
+    static uint64_t bucket_upper(int index);
+
+private:
+    std::atomic<uint64_t> _buckets[HIST_BUCKETS] = {};
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _sum{0};
+};
+
+/*
+ * Bus metrics
+ * Command latency histograms keyed by (device id, command byte, host type of the
+ * mounted image) and error counters. Updated without locking, histograms and per
+ * device counters are allocated on first use and installed atomically, rendered in
+ * Prometheus text format by the web server thread (/metrics).
+ */
+class fnMetrics
+{
+public:
+    // latency from command frame to end of command processing
+    void command_latency(uint8_t device, uint8_t command, uint8_t host_type, uint64_t latency_us);
+    // device sent NAK
+    void nak(uint8_t device);
+    // data frame from computer with bad checksum
+    void data_checksum_error(uint8_t device);
+    // async command missed its deadline, timed ERROR sent
+    void deadline_missed(uint8_t device);
+    // command frame with bad checksum
+    void command_checksum_error() { _command_checksum_errors.fetch_add(1, std::memory_order_relaxed); }
+    // switched between standard and high speed
+    void baudrate_toggled(int baudrate);
+    void baudrate_changed(int baudrate) { _baudrate.store(baudrate, std::memory_order_relaxed); }
+    // NetSIO flow control: credit window asked from hub, time blocked waiting for credit
+    void netsio_credit_window(int window) { _netsio_credit_window.store(window, std::memory_order_relaxed); }
+    void netsio_credit_wait(uint64_t wait_us, bool stalled);
+    // disk image read-ahead: sector read served from memory (hit) or from backend, sectors fetched ahead
+    void disk_readahead(bool hit);
+    void disk_readahead_fetch(unsigned int sectors);
+    // disk image write-back: flush finished, sectors written in runs of contiguous sectors
+    void disk_writeback_flush(bool ok, unsigned int sectors, unsigned int runs);
+
+    // append all metrics in Prometheus text exposition format
+    void format_prometheus(std::string &out);
+
+private:
+    struct device_metrics
+    {
+        std::atomic<fnHistogram *> latency[256][METRICS_HOST_TYPES] = {};
+        std::atomic<uint64_t> naks{0};
+        std::atomic<uint64_t> data_checksum_errors{0};
+        std::atomic<uint64_t> deadlines_missed{0};
+    };
+
+    std::atomic<device_metrics *> _devices[256] = {};
+    std::atomic<uint64_t> _command_checksum_errors{0};
+    std::atomic<uint64_t> _baudrate_toggles{0};
+    std::atomic<int> _baudrate{0};
+    std::atomic<int> _netsio_credit_window{0};
+    std::atomic<uint64_t> _netsio_credit_waits{0};
+    std::atomic<uint64_t> _netsio_credit_wait_us{0};
+    std::atomic<uint64_t> _netsio_credit_stalls{0};
+    std::atomic<uint64_t> _readahead_hits{0};
+    std::atomic<uint64_t> _readahead_misses{0};
+    std::atomic<uint64_t> _readahead_fetches{0};
+    std::atomic<uint64_t> _readahead_sectors{0};
+    std::atomic<uint64_t> _writeback_flushes{0};
+    std::atomic<uint64_t> _writeback_failures{0};
+    std::atomic<uint64_t> _writeback_sectors{0};
+    std::atomic<uint64_t> _writeback_runs{0};
+
+    device_metrics *_device(uint8_t device);
+};
+
+extern fnMetrics busMetrics;
+
+#endif // _FN_METRICS_H
@@ -0,0 +1,61 @@
+#ifndef _FN_SPSC_RING_H
+#define _FN_SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Bounded lock-free ring for one producer thread and one consumer thread
+ * N must be power of 2. push() fails when the ring is full, producer decides
+ * what to do with the item. Consumer side functions (pop, peek, clear) must
+ * not be called from the producer thread and vice versa.
+ */
+
+template <typename T, size_t N>
+class fnSpscRing
+{
+    static_assert((N & (N - 1)) == 0, "ring size must be power of 2");
+
+public:
+    // producer
+    bool push(const T &item)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == N)
+            return false;
+        _items[head & (N - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer
+    bool pop(T &item)
+    {
+        if (!peek(item))
+            return false;
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool peek(T &item)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+            return false;
+        item = _items[tail & (N - 1)];
+        return true;
+    }
+
+    void clear() { _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release); }
+
+    // either side
+    size_t size() { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+    bool empty() { return size() == 0; }
+
+private:
+    T _items[N];
+    std::atomic<size_t> _head{0}; // next slot to write
+    std::atomic<size_t> _tail{0}; // next slot to read
+};
+
+#endif // _FN_SPSC_RING_H
@@ -0,0 +1,140 @@
+
+#include "fnTrace.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+#include "fnSystem.h"
+
+#include "../../include/debug.h"
+
+// global tracer
+fnTrace fnTracer;
+
+static std::atomic<int> _next_thread_id{1};
+
+
+int fnTrace::thread_id()
+{
+    static thread_local int tid = 0;
+    if (tid == 0)
+        tid = _next_thread_id.fetch_add(1, std::memory_order_relaxed);
+    return tid;
+}
+
+void fnTrace::start()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_events.empty())
+        _events.resize(TRACE_BUFFER_EVENTS);
+    _next = 0;
+    _count = 0;
+    _enabled = true;
+    Debug_printf("Tracing started, keeping last %d events\n", TRACE_BUFFER_EVENTS);
+}
+
+void fnTrace::stop()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_enabled)
+        Debug_printf("Tracing stopped, %u events\n", (unsigned)_count);
+    _enabled = false;
+}
+
+void fnTrace::set_thread_name(const char *name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _thread_names[thread_id()] = name;
+}
+
+void fnTrace::add(const trace_event &event)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_enabled)
+        return;
+    _events[_next] = event;
+    _next = (_next + 1) % TRACE_BUFFER_EVENTS;
+    if (_count < TRACE_BUFFER_EVENTS)
+        _count++;
+}
+
+size_t fnTrace::event_count()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _count;
+}
+
+void fnTrace::format_json(std::string &out)
+{
+    // copy the ring under the lock, spans ending meanwhile are not held up by formatting
+    std::vector<trace_event> events;
+    std::map<int, std::string> thread_names;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        events.reserve(_count);
+        // oldest first
+        size_t first = (_next + TRACE_BUFFER_EVENTS - _count) % TRACE_BUFFER_EVENTS;
+        for (size_t i = 0; i < _count; i++)
+            events.push_back(_events[(first + i) % TRACE_BUFFER_EVENTS]);
+        thread_names = _thread_names;
+    }
+
+    char buf[384];
+
+    out.reserve(out.size() + events.size() * 160 + 256);
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"FujiNet-PC\"}}";
+
+    for (auto &t : thread_names)
+    {
+        snprintf(buf, sizeof(buf), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                 t.first, t.second.c_str());
+        out += buf;
+    }
+
+    for (const trace_event &e : events)
+    {
+        int n = snprintf(buf, sizeof(buf),
+                         ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRIu64 ",\"dur\":%" PRIu64 ",\"pid\":1,\"tid\":%d",
+                         e.name, e.cat, e.start_us, e.dur_us, e.tid);
+        for (int a = 0; a < TRACE_SPAN_ARGS && e.arg_names[a] != nullptr; a++)
+            n += snprintf(buf + n, sizeof(buf) - n, "%s\"%s\":%" PRId64, a == 0 ? ",\"args\":{" : ",",
+                          e.arg_names[a], e.arg_values[a]);
+        if (e.arg_names[0] != nullptr)
+            n += snprintf(buf + n, sizeof(buf) - n, "}");
+        snprintf(buf + n, sizeof(buf) - n, "}");
+        out += buf;
+    }
+    out += "\n]}\n";
+}
+
+
+fnTraceSpan::fnTraceSpan(const char *cat, const char *name)
+{
+    _active = fnTracer.enabled();
+    if (!_active)
+        return;
+    _event.cat = cat;
+    _event.name = name;
+    _event.tid = fnTrace::thread_id();
+    _event.arg_names[0] = nullptr;
+    _event.arg_names[1] = nullptr;
+    _event.start_us = fnSystem.micros();
+}
+
+fnTraceSpan::~fnTraceSpan()
+{
+    if (!_active)
+        return;
+    _event.dur_us = fnSystem.micros() - _event.start_us;
+    fnTracer.add(_event);
+}
+
+void fnTraceSpan::arg(const char *name, int64_t value)
+{
+    if (!_active || _nargs >= TRACE_SPAN_ARGS)
+        return;
+    _event.arg_names[_nargs] = name;
+    _event.arg_values[_nargs] = value;
+    _nargs++;
+}
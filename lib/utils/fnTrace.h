@@ -0,0 +1,82 @@
+#ifndef _FN_TRACE_H
+#define _FN_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define TRACE_BUFFER_EVENTS 32768   // most recent events kept while tracing, older are overwritten
+#define TRACE_SPAN_ARGS 2
+
+/*
+ * Timeline tracing
+ * Spans of bus commands, media I/O and network calls are collected into an in-memory
+ * buffer while tracing is enabled and exported as Chrome trace-event JSON, which can be
+ * opened in chrome://tracing or ui.perfetto.dev. When tracing is off, a span costs one
+ * atomic load.
+ *
+ *   fnTraceSpan span("sio", "command");
+ *   span.arg("device", dev);
+ */
+
+struct trace_event
+{
+    const char *cat;                // string literals only, pointers are stored
+    const char *name;
+    uint64_t start_us;
+    uint64_t dur_us;
+    int tid;
+    const char *arg_names[TRACE_SPAN_ARGS];
+    int64_t arg_values[TRACE_SPAN_ARGS];
+};
+
+class fnTrace
+{
+public:
+    void start();
+    void stop();
+    bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+
+    // name calling thread in the trace (bus, web, worker)
+    void set_thread_name(const char *name);
+
+    void add(const trace_event &event);
+    size_t event_count();
+
+    // append buffered events as trace-event JSON
+    void format_json(std::string &out);
+
+    // small sequential id of calling thread
+    static int thread_id();
+
+private:
+    std::atomic<bool> _enabled{false};
+    std::mutex _mutex;
+    std::vector<trace_event> _events;   // ring, allocated on start
+    size_t _next = 0;                   // next slot to write
+    size_t _count = 0;                  // valid events in ring
+    std::map<int, std::string> _thread_names;
+};
+
+extern fnTrace fnTracer;
+
+// Records a complete event from construction to destruction if tracing is enabled
+class fnTraceSpan
+{
+public:
+    fnTraceSpan(const char *cat, const char *name);
+    ~fnTraceSpan();
+
+    // attach numeric argument shown with the event, up to TRACE_SPAN_ARGS
+    void arg(const char *name, int64_t value);
+
+private:
+    trace_event _event;
+    int _nargs = 0;
+    bool _active;
+};
+
+#endif // _FN_TRACE_H
@@ -11,6 +11,7 @@
 #include "compat_gettimeofday.h"
 
 #include "../../include/debug.h"
+#include "fnLog.h"
 
 #include "samlib.h"
 
@@ -143,6 +144,18 @@ unsigned char util_checksum(const char *chunk, int length)
     return (unsigned char)chkSum;
 }
 
+// 32-bit FNV-1a hash, used to name local files kept for disk images
+uint32_t util_fnv1a(const std::string &s)
+{
+    uint32_t hash = 2166136261u;
+    for (char c : s)
+    {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 std::string util_crunch(std::string filename)
 {
     std::string basename_long;
@@ -913,59 +926,10 @@ std::string prependSlash(const std::string& str) {
 }
 
 // helper function for Debug_print* macros on fujinet-pc
-void util_debug_printf(const char *fmt, ...)
+void util_debug_printf(int level, const char *file, const char *fmt, ...)
 {
-    static bool print_ts = true;
     va_list argp;
-
-    if (!print_ts)
-    {
-        if (fmt != nullptr)
-        {
-            print_ts = fmt[strlen(fmt)-1] == '\n';
-        }
-        else
-        {
-            va_start(argp, fmt);
-            const char *s = va_arg(argp, const char*);
-            print_ts = s[strlen(s)-1] == '\n';
-            va_end(argp);
-        }
-        if (print_ts)
-            printf("\n");
-    }
-
-    if (print_ts) 
-    {
-        // printf("DEBUG > ");
-        timeval tv;
-        tm tm;
-        char buffer[32];
-
-        compat_gettimeofday(&tv, NULL);
-#if defined(_WIN32)
-        time_t t = (time_t)tv.tv_sec;
-        localtime_s(&tm, &t);
-#else
-        localtime_r(&tv.tv_sec, &tm);
-#endif
-        size_t endpos = strftime(buffer, sizeof(buffer), "%H:%M:%S", &tm);
-        snprintf(buffer + endpos, sizeof(buffer) - endpos, ".%06d", (int)(tv.tv_usec));
-        printf("%s > ", buffer);
-    }
-
     va_start(argp, fmt);
-    if (fmt != nullptr)
-    {
-        print_ts = fmt[strlen(fmt)-1] == '\n';
-        vprintf(fmt, argp);
-    }
-    else
-    {
-        const char *s = va_arg(argp, const char*);
-        print_ts = s[strlen(s)-1] == '\n';
-        printf("%s", s);
-    }
+    fnLogger.vlog((fnLogLevel)level, file, fmt, argp);
     va_end(argp);
-    fflush(stdout);
 }
@@ -51,6 +51,7 @@ long util_parseInt(FILE *f, char skipChar);
 long util_parseInt(FILE *f);
 
 unsigned char util_checksum(const char *chunk, int length);
+uint32_t util_fnv1a(const std::string &s);
 std::string util_crunch(std::string filename);
 std::string util_entry(std::string crunched, size_t fileSize, bool is_dir, bool is_locked);
 std::string util_long_entry(std::string filename, size_t fileSize, bool is_dir);
@@ -106,6 +107,7 @@ bool isApproximatelyInteger(double value, double tolerance = 1e-6);
 std::string prependSlash(const std::string& str);
 
 // helper function for Debug_print* macros on fujinet-pc
-void util_debug_printf(const char *fmt, ...);
+// if fmt is nullptr, first argument is the string to print
+void util_debug_printf(int level, const char *file, const char *fmt, ...);
 
 #endif // _FN_UTILS_H
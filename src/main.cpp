@@ -25,6 +25,12 @@
 #include "httpService.h"
 
 #include "fnTaskManager.h"
+#include "fnEventLoop.h"
+#include "fnCommandQueue.h"
+#include "fnLog.h"
+#include "fnTrace.h"
+#include "fnRealtime.h"
+#include "fujiSnapshot.h"
 #include "version.h"
 
 #ifdef BLUETOOTH_SUPPORT
@@ -41,12 +47,25 @@
 
 volatile sig_atomic_t fn_shutdown = 0;
 
+// real-time profile for the bus thread (-R), in addition to configuration
+static bool realtime_requested = false;
+
+#ifdef BUILD_ATARI
+// SIO trace to record (-r) or to replay as benchmark (-p)
+static const char *sio_record_path = nullptr;
+static const char *sio_replay_path = nullptr;
+#endif
+
 void main_shutdown_handler()
 {
     Debug_println("Shutdown handler called");
+    // Stop web server thread
+    fnHTTPD.stop();
     // Give devices an opportunity to clean up before rebooting
 
     SYSTEM_BUS.shutdown();
+    // Print remaining debug messages
+    fnLogger.end();
 }
 
 void sighandler(int signum)
@@ -54,6 +73,7 @@ void sighandler(int signum)
     fn_shutdown = 1 + fn_shutdown;
     if (fn_shutdown >= 3)
         _exit(EXIT_FAILURE); // emergency exit
+    eventLoop.wakeup(); // interrupt service loop wait
 }
 
 void print_version()
@@ -109,7 +129,7 @@ void main_setup(int argc, char *argv[])
 {
     // program arguments
     int opt;
-    while ((opt = getopt(argc, argv, "Vu:c:s:")) != -1) {
+    while ((opt = getopt(argc, argv, "Vu:c:s:Rr:p:")) != -1) {
         switch (opt) {
             case 'V':
                 print_version();
@@ -123,12 +143,32 @@ void main_setup(int argc, char *argv[])
             case 's':
                 Config.store_general_SD_path(optarg);
                 break;
+            case 'R':
+                realtime_requested = true;
+                break;
+#ifdef BUILD_ATARI
+            case 'r':
+                sio_record_path = optarg;
+                break;
+            case 'p':
+                sio_replay_path = optarg;
+                break;
+#endif
             default: /* '?' */
-                fprintf(stderr, "Usage: %s [-V] [-u URL] [-c config_file] [-s SD_directory]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-V] [-u URL] [-c config_file] [-s SD_directory] [-R]"
+#ifdef BUILD_ATARI
+                                " [-r record_sio_trace | -p replay_sio_trace]"
+#endif
+                                "\n", argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
 
+    // Start debug log writer
+    fnLogger.begin();
+    // main thread services the bus
+    fnTracer.set_thread_name("bus");
+
 #ifdef DEBUG
     // fnUartDebug.begin(DEBUG_SPEED);
     unsigned long startms = fnSystem.millis();
@@ -199,6 +239,15 @@ void main_setup(int argc, char *argv[])
     // Load our stored configuration
     Config.load();
 
+    fnLogLevel log_level = fnLog::level_from_string(Config.get_general_log_level().c_str());
+    if (log_level != LOG_LEVEL_INVALID)
+        fnLogger.set_level(log_level);
+    fnLogger.set_filter(Config.get_general_log_filter());
+
+    // trace from the start to capture slow boots
+    if (Config.get_general_trace_enabled())
+        fnTracer.start();
+
     // Now that our main service is running, try connecting to WiFi or BlueTooth
     if (Config.get_bt_status())
     {
@@ -251,6 +300,18 @@ void main_setup(int argc, char *argv[])
 
     // Go setup SIO
     SIO.setup();
+
+    if (sio_replay_path != nullptr)
+    {
+        // benchmark: play recorded computer's side of SIO, exit with report when done
+        if (!fnSioCom.start_replay(sio_replay_path))
+        {
+            fprintf(stderr, "Cannot replay SIO trace \"%s\"\n", sio_replay_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (sio_record_path != nullptr)
+        fnSioCom.start_recording(sio_record_path);
 #endif // BUILD_ATARI
 
 #ifdef BUILD_COCO
@@ -412,6 +473,16 @@ void main_setup(int argc, char *argv[])
 
     fn_shutdown = 0;
 
+    // devices are set up, lock the bus thread and its memory in place
+    if (realtime_requested || Config.get_general_realtime_enabled())
+    {
+#ifdef BUILD_ATARI
+        fnSioCom.preallocate();
+#endif
+        realtimeProfile.enable(Config.get_general_realtime_cpu());
+        realtimeProfile.probe_latency();
+    }
+
 #ifdef DEBUG
     unsigned long endms = fnSystem.millis();
     Debug_printf("Available heap: %u\n", fnSystem.get_free_heap_size());
@@ -426,14 +497,21 @@ void main_setup(int argc, char *argv[])
 
 #endif /* BUILD_S100*/
 
+// Web server commands must wait while disk images are used by worker pool
+static bool bus_commands_allowed()
+{
+#ifdef BUILD_ATARI
+    return !SIO.async_exclusive_pending();
+#else
+    return true;
+#endif
+}
+
 // Main high-priority service loop
 void fn_service_loop(void *param)
 {
     while (!fn_shutdown)
     {
-        // We don't have any delays in this loop, so IDLE threads will be starved
-        // Shouldn't be a problem, but something to keep in mind...
-
         // Go service BT if it's active
 #ifdef BLUETOOTH_SUPPORT
         if (fnBtManager.isActive())
@@ -442,9 +520,23 @@ void fn_service_loop(void *param)
     #endif
         SYSTEM_BUS.service();
 
-        fnHTTPD.service();
+#ifdef BUILD_ATARI
+        if (sio_replay_path != nullptr && fnSioCom.replay_finished())
+        {
+            // exit status tells scripts (test/sio_replay) whether output matched the recording
+            if (!fnSioCom.replay_report())
+                exit(EXIT_FAILURE);
+            break;
+        }
+#endif
 
-        taskMgr.service();
+        // Run commands from web server, publish state for it
+        int commands = 0;
+        if (bus_commands_allowed())
+            commands = busQueue.service();
+        fujiState.update(commands > 0);
+
+        bool idle = taskMgr.service();
 
         if (fnSystem.check_deferred_reboot())
         {
@@ -455,6 +547,18 @@ void fn_service_loop(void *param)
             // indicate to the controlling script (run-fujinet) that this program (fujinet) should be started again
             fnSystem.reboot(); // calls exit(75)
         }
+
+        // Sleep until bus, web server or timers need attention
+        eventLoop.begin();
+        SYSTEM_BUS.prepare_wait();
+        fujiState.prepare_wait();
+        if (busQueue.pending() && bus_commands_allowed())
+            eventLoop.add_timeout(0);
+        if (!idle)
+            eventLoop.add_timeout(0); // tasks are running
+        eventLoop.add_deadline(fnSystem.get_deferred_reboot_time());
+        if (!fn_shutdown)
+            eventLoop.wait();
     }
 }
 
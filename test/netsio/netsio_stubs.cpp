@@ -0,0 +1,56 @@
+/**
+ * #FujiNet Tests - NetSIO port stubs
+ *
+ * Minimal definitions of what NetSioPort uses from the rest of the program,
+ * so the port can be tested without the bus, web server and WiFi.
+ */
+
+#include <chrono>
+#include <thread>
+
+#include "fnSystem.h"
+#include "fnEventLoop.h"
+#include "fnTrace.h"
+#include "fnMetrics.h"
+#include "fnWiFi.h"
+#include "../../include/debug.h"
+
+SystemManager fnSystem;
+fnEventLoop eventLoop;
+fnMetrics busMetrics;
+DummyWiFiManager fnWiFi;
+
+SystemManager::SystemManager() {}
+
+uint64_t SystemManager::millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t SystemManager::micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SystemManager::delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void SystemManager::reboot(uint32_t, bool) {}
+
+DummyWiFiManager::~DummyWiFiManager() {}
+bool DummyWiFiManager::connected() { return true; }
+
+fnEventLoop::fnEventLoop() {}
+fnEventLoop::~fnEventLoop() {}
+void fnEventLoop::add_fd(int, int) {}
+void fnEventLoop::add_deadline(uint64_t) {}
+void fnEventLoop::add_timeout(uint32_t) {}
+
+fnTraceSpan::fnTraceSpan(const char *, const char *) { _active = false; }
+fnTraceSpan::~fnTraceSpan() {}
+
+void fnMetrics::netsio_credit_wait(uint64_t, bool) {}
+
+void util_debug_printf(int, const char *, const char *, ...) {}
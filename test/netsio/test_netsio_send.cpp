@@ -0,0 +1,89 @@
+/**
+ * #FujiNet Tests - NetSIO stream send
+ *
+ * Hub closes TCP connection while FujiNet is sending, send_msg() has to
+ * give up with -1 instead of waiting for the dead socket forever.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#include "sio/siocom/netsio.h"
+
+// exposes protected parts of the port
+class TestNetSioPort : public NetSioPort
+{
+public:
+    using NetSioPort::open_socket;
+    using NetSioPort::send_msg;
+};
+
+static int listen_local(uint16_t &port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+        return -1;
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static int fail(const char *msg)
+{
+    printf("FAIL: %s\n", msg);
+    return 1;
+}
+
+int main()
+{
+#if defined(_WIN32)
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    uint16_t port;
+    int lfd = listen_local(port);
+    if (lfd < 0)
+        return fail("can't listen on loopback");
+
+    TestNetSioPort netsio;
+    netsio.set_host("tcp:127.0.0.1", port);
+    if (!netsio.open_socket())
+        return fail("can't connect to hub");
+    int hub = accept(lfd, nullptr, nullptr);
+    if (hub < 0)
+        return fail("hub can't accept connection");
+
+    // hub stops reading and drops the connection while send buffers are full
+    std::thread closer([hub]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        struct linger lg = {1, 0}; // reset, don't wait for unread data
+        setsockopt(hub, SOL_SOCKET, SO_LINGER, (char *)&lg, sizeof(lg));
+        closesocket(hub);
+    });
+
+    uint8_t msg[1024];
+    memset(msg, 0x55, sizeof(msg));
+    ssize_t result = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (result >= 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+        result = netsio.send_msg(msg, sizeof(msg));
+    closer.join();
+    closesocket(lfd);
+
+    if (result != -1)
+        return fail("send_msg() did not fail after hub closed connection");
+    // port is closed, no more waiting on dead socket
+    if (netsio.send_msg(msg, 1) != -1)
+        return fail("send_msg() on closed connection did not fail");
+
+    printf("PASS: send_msg() returned -1 after hub closed connection\n");
+    return 0;
+}
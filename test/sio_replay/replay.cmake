@@ -0,0 +1,38 @@
+# Replay recorded SIO session against the built program and check the report
+#
+# Run by ctest (see "Tests" in CMakeLists.txt) from the build directory, which has
+# the web UI data with CONFIG boot disk ("build_webui" target):
+#   cmake -DFUJINET=<fujinet> -DTRACE=<trace> -DCONFIG=<fnconfig.ini> -DWORK_DIR=<dir>
+#         [-DCOMMANDS=<n>] -P replay.cmake
+#
+# config_boot.siotrace: computer reads boot sectors 1-3 of CONFIG disk (D1:) at
+# standard speed, FujiNet answers with sectors of data/autorun.atr
+
+if(NOT EXISTS "data/autorun.atr")
+    message(FATAL_ERROR "No web UI data in build directory, build \"build_webui\" target first")
+endif()
+
+# fresh copy of config and empty SD, FujiNet may write both
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}/SD")
+configure_file("${CONFIG}" "${WORK_DIR}/fnconfig.ini" COPYONLY)
+
+execute_process(
+    COMMAND "${FUJINET}" -u http://127.0.0.1:18000 -c "${WORK_DIR}/fnconfig.ini" -s "${WORK_DIR}/SD" -p "${TRACE}"
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE errors
+    RESULT_VARIABLE result
+    TIMEOUT 60
+)
+message("${output}")
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Replay failed (${result}):\n${errors}")
+endif()
+
+if(NOT DEFINED COMMANDS)
+    set(COMMANDS 3)
+endif()
+if(NOT output MATCHES "SIO replay: ${COMMANDS} commands \\(0 not for FujiNet, 0 unanswered\\), 0 stalls, 0 output bytes differ")
+    message(FATAL_ERROR "Replay report does not match the recording")
+endif()